@@ -0,0 +1,123 @@
+#include "admission.hpp"
+#include "connection.hpp"
+#include "metrics.hpp"
+
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+
+// descriptors of a loop that are not connections or cached files: its
+// listener, epoll or ring, eventfd, logger and the like
+const size_t FD_RESERVE = 32;
+// connections shed per call, so a flood cannot hold the loop
+const size_t SHED_BATCH = 256;
+
+const char SHED_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+int open_spare() {
+    return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+}
+
+Admission::~Admission() {
+    if (spare_fd_ >= 0) ::close(spare_fd_);
+}
+
+void Admission::configure(size_t limit) {
+    limit_ = limit > 0 ? limit : 1;
+    if (spare_fd_ < 0) spare_fd_ = open_spare();
+}
+
+void Admission::pause(int64_t now_ms, int backoff_ms) {
+    backoff_until_ = backoff_ms > 0 ? now_ms + backoff_ms : 0;
+    if (paused_) return;
+    paused_ = true;
+    metrics_accept_paused(true);
+}
+
+bool Admission::can_resume(size_t open, int64_t now_ms) const {
+    if (backoff_until_) return now_ms >= backoff_until_ && open < limit_;
+    return open < resume_at();
+}
+
+void Admission::resume() {
+    if (!paused_) return;
+    paused_ = false;
+    backoff_until_ = 0;
+    metrics_accept_paused(false);
+}
+
+int Admission::recheck_in(int64_t now_ms) const {
+    if (!paused_) return -1;
+    if (!backoff_until_) return FD_BACKOFF_MS;
+    return now_ms >= backoff_until_ ? 0 : (int)(backoff_until_ - now_ms);
+}
+
+bool reclaimable(const Connection& c, int64_t idle_before) {
+    return c.state == ConnState::READING_REQUEST && c.in_buf.empty() &&
+           c.requests > 0 && c.idle_since <= idle_before;
+}
+
+bool Admission::out_of_fds(int err) {
+    return err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM;
+}
+
+// The 503 is best effort: written to a fresh socket buffer it nearly always
+// fits, and a client whose request arrives after the close sees a reset.
+size_t Admission::shed(int listen_fd) {
+    size_t shed = 0;
+    while (shed < SHED_BATCH && spare_fd_ >= 0) {
+        ::close(spare_fd_);
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            ::send(fd, SHED_RESPONSE, sizeof(SHED_RESPONSE) - 1,
+                   MSG_NOSIGNAL | MSG_DONTWAIT);
+            ::close(fd);
+            ++shed;
+            metrics_shed();
+        }
+        spare_fd_ = open_spare();
+        if (fd < 0) break;
+    }
+    return shed;
+}
+
+size_t connection_limit(const ServerConfig& cfg, size_t threads,
+                        size_t file_cache_entries) {
+    if (threads == 0) threads = 1;
+    size_t limit = SIZE_MAX;
+    if (cfg.max_connections > 0)
+        limit = (cfg.max_connections + threads - 1) / threads;
+
+    size_t fds = SIZE_MAX;
+    struct rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        size_t taken = file_cache_entries + FD_RESERVE;
+        fds = rl.rlim_cur / threads;
+        fds = fds > taken ? fds - taken : 1;
+        // a splicing io_uring connection also holds a pipe pair
+        if (cfg.engine == EventEngine::URING && cfg.zero_copy) fds /= 3;
+    }
+    // pselect cannot watch fd numbers past FD_SETSIZE; a connection that
+    // still gets one is turned away when it is registered
+    if (cfg.engine == EventEngine::PSELECT &&
+        fds > (FD_SETSIZE - FD_RESERVE) / threads)
+        fds = (FD_SETSIZE - FD_RESERVE) / threads;
+    return fds < limit ? (fds > 0 ? fds : 1) : limit;
+}
+
+Admission& admission() {
+    static thread_local Admission a;
+    return a;
+}
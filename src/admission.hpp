@@ -0,0 +1,111 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include "config.hpp"
+#include "metrics.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Connection;
+
+// After accept() failed for lack of descriptors, accepting rests this long
+// before the listener is tried again.
+const int FD_BACKOFF_MS = 100;
+// A keep-alive connection quiet for this long may be hung up to make room
+// at the limit; one that just got its response is likely to ask again.
+const int RECLAIM_IDLE_MS = 1000;
+
+// How many connections one event loop takes. At the limit the loop stops
+// watching its listener, so the queue waits in the kernel (or goes to a
+// sibling loop) instead of into a worker that cannot serve it; keep-alive
+// connections idle for RECLAIM_IDLE_MS are hung up to make room, and
+// accepting resumes once the loop is back under resume_at().
+//
+// When accept() fails with EMFILE/ENFILE the queued connection would stay
+// readable and wake the loop again at once. A spare descriptor kept open
+// for this is given back to take each queued connection off the listener,
+// answer it with a static 503 and close it; then accepting backs off for
+// FD_BACKOFF_MS.
+class Admission {
+public:
+    ~Admission();
+
+    void configure(size_t limit);
+
+    size_t limit() const { return limit_; }
+    // open connections below which a full loop accepts again
+    size_t resume_at() const { return limit_ - limit_ / 8; }
+    bool full(size_t open) const { return open >= limit_; }
+
+    bool paused() const { return paused_; }
+    // backoff_ms > 0: paused for lack of descriptors rather than by the limit
+    void pause(int64_t now_ms, int backoff_ms = 0);
+    bool can_resume(size_t open, int64_t now_ms) const;
+    void resume();
+    // Paused: from the resume mark up, connections idle for RECLAIM_IDLE_MS
+    // are hung up to make room, by close_idle(max, idle_before) as
+    // reclaim_idle() below; open() counts the loop's connections. true
+    // once accepting may resume.
+    template <typename Open, typename CloseIdle>
+    bool make_room(int64_t now_ms, Open open, CloseIdle close_idle);
+    // ms until a paused loop should look again: when a back-off ends, or
+    // FD_BACKOFF_MS for idle connections to age; -1 while accepting
+    int recheck_in(int64_t now_ms) const;
+
+    // errno of a failed accept() that means no descriptor was left for it
+    static bool out_of_fds(int err);
+    // answers and closes what is queued on listen_fd; returns how many
+    size_t shed(int listen_fd);
+
+private:
+    size_t  limit_ = SIZE_MAX;
+    int     spare_fd_ = -1;
+    bool    paused_ = false;
+    int64_t backoff_until_ = 0;
+};
+
+template <typename Open, typename CloseIdle>
+bool Admission::make_room(int64_t now_ms, Open open, CloseIdle close_idle) {
+    if (open() >= resume_at()) {
+        size_t n = close_idle(open() - resume_at() + 1,
+                              now_ms - RECLAIM_IDLE_MS);
+        if (n > 0) metrics_reclaimed(n);
+    }
+    return can_resume(open(), now_ms);
+}
+
+// a keep-alive connection waiting for its next request since idle_before
+// or earlier; one that has not sent its first request yet is still owed
+// an answer
+bool reclaimable(const Connection& c, int64_t idle_before);
+
+// While draining, or at the connection limit, idle keep-alive connections
+// are hung up: at most max of the reclaimable() ones among fds. conn(fd)
+// is the Connection of fd, nullptr if it is on its way out already, and
+// close(fd) is how the engine hangs one up. Returns how many.
+template <typename ConnOf, typename Close>
+size_t reclaim_idle(const std::vector<int>& fds, ConnOf conn, Close close,
+                    size_t max, int64_t idle_before) {
+    static thread_local std::vector<int> idle;
+    idle.clear();
+    for (int fd : fds) {
+        if (idle.size() >= max) break;
+        const Connection* c = conn(fd);
+        if (c && reclaimable(*c, idle_before)) idle.push_back(fd);
+    }
+    for (int fd : idle) close(fd);
+    return idle.size();
+}
+
+// Per-loop connection limit: cfg.max_connections split across the loops
+// of a worker, or when unset whatever RLIMIT_NOFILE leaves after the file
+// cache and a reserve for the loop's own descriptors.
+size_t connection_limit(const ServerConfig& cfg, size_t threads,
+                        size_t file_cache_entries);
+
+// one per event-loop thread
+Admission& admission();
+
+#endif
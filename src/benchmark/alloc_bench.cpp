@@ -0,0 +1,229 @@
+// Сколько раз куча трогается на один запрос в установившемся режиме.
+// Через socketpair прогоняется тот же автомат соединения, что в
+// worker_loop: ConnTable, буферы из BufferPool, разбор, кэши, сборка
+// заголовков, отправка (writev/sendfile), журнал доступа, таймеры.
+// malloc/calloc/realloc перехватываются и считаются для текущего потока,
+// так что фоновый поток логгера в счёт не идёт. Первые WARMUP запросов
+// каждого сценария прогревают кэши и пул и считаются отдельно.
+//
+// Сборка и запуск: ./run_alloc_bench.sh
+
+#include "../config.hpp"
+#include "../connection.hpp"
+#include "../conn_table.hpp"
+#include "../buffer_pool.hpp"
+#include "../content_cache.hpp"
+#include "../file_cache.hpp"
+#include "../timer_wheel.hpp"
+#include "../logger.hpp"
+#include "../clock.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static __thread uint64_t t_allocs = 0;
+
+extern "C" {
+void* __libc_malloc(size_t n);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t n);
+
+void* malloc(size_t n) {
+    ++t_allocs;
+    return __libc_malloc(n);
+}
+
+void* calloc(size_t n, size_t size) {
+    ++t_allocs;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t n) {
+    ++t_allocs;
+    return __libc_realloc(p, n);
+}
+}
+
+static const size_t WARMUP = 1000;
+
+static void write_file(const std::string& path, size_t size, char fill) {
+    std::string data(size, fill);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ::write(fd, data.data(), data.size()) != (ssize_t)size) {
+        std::perror(path.c_str());
+        std::exit(1);
+    }
+    ::close(fd);
+}
+
+// одна пара сокетов: сторона сервера живёт в ConnTable, как в worker_loop
+class Bench {
+public:
+    explicit Bench(const ServerConfig& cfg)
+        : cfg_(cfg), timers_(monotonic_ms()) {}
+
+    void open() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) != 0) {
+            std::perror("socketpair");
+            std::exit(1);
+        }
+        server_ = sv[0];
+        client_ = sv[1];
+        Connection& c = conns_.open(server_);
+        c.fd = server_;
+        take_buffers(c);
+        update_timer(c, cfg_, timers_, monotonic_ms());
+    }
+
+    void close() {
+        Connection* c = conns_.find(server_);
+        if (c) {
+            release_file(*c);
+            return_buffers(*c);
+            timers_.cancel(server_);
+            conns_.close(server_);
+        }
+        ::close(server_);
+        ::close(client_);
+        server_ = client_ = -1;
+    }
+
+    // запрос -> ответ целиком; false, если сервер закрыл соединение
+    bool exchange(const std::string& req, std::string* response = nullptr) {
+        if (server_ < 0) open();
+        if (::write(client_, req.data(), req.size()) != (ssize_t)req.size()) {
+            std::perror("write");
+            std::exit(1);
+        }
+        Connection& c = *conns_.find(server_);
+        bool want_close = false;
+        c.would_block = false;
+        handle_read(c, cfg_, want_close);
+        while (!want_close && (c.state == ConnState::SENDING_HEADERS ||
+                               c.state == ConnState::SENDING_BODY)) {
+            c.would_block = false;
+            handle_write(c, cfg_, want_close);
+            drain(response);
+        }
+        drain(response);
+        if (want_close) {
+            close();
+            return false;
+        }
+        update_timer(c, cfg_, timers_, monotonic_ms());
+        return true;
+    }
+
+private:
+    void drain(std::string* response) {
+        for (;;) {
+            ssize_t n = ::read(client_, sink_, sizeof(sink_));
+            if (n <= 0) return;
+            if (response) response->append(sink_, n);
+        }
+    }
+
+    const ServerConfig& cfg_;
+    ConnTable<Connection> conns_;
+    TimerWheel timers_;
+    int server_ = -1;
+    int client_ = -1;
+    char sink_[256 * 1024];
+};
+
+struct Scenario {
+    const char* name;
+    std::string request;
+};
+
+int main(int argc, char* argv[]) {
+    size_t iters = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+    char dir[] = "/tmp/alloc_bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string root = dir;
+    mkdir((root + "/assets").c_str(), 0755);
+    write_file(root + "/index.html", 2048, 'a');
+    write_file(root + "/assets/application-3f9a2c71.css", 6000, 'b');
+    write_file(root + "/assets/application-3f9a2c71.css.gz", 900, 'c');
+    write_file(root + "/big.bin", 256 * 1024, 'd');
+
+    ServerConfig cfg;
+    cfg.doc_root = root;
+    cfg.log_path = root + "/server.log";
+    cfg.access_log_path = root + "/access.log";
+    cfg.mem_cache_max_file = 16 * 1024;
+
+    init_logger(cfg.log_path, cfg.access_log_path);
+    start_async_logger();
+    content_cache().build(cfg);
+    content_cache().set_ttl(cfg.file_cache_ttl_ms);
+    file_cache().configure(cfg.file_cache_entries, cfg.file_cache_ttl_ms);
+
+    Bench bench(cfg);
+
+    // ETag для условного запроса берётся из настоящего ответа
+    std::string first;
+    bench.exchange("GET /index.html HTTP/1.1\r\nHost: b\r\n\r\n", &first);
+    size_t at = first.find("ETag: ");
+    std::string etag = first.substr(at + 6, first.find("\r\n", at) - at - 6);
+
+    const std::string host = "Host: bench.local\r\nUser-Agent: alloc_bench\r\n";
+    Scenario scenarios[] = {
+        {"memory 200",
+         "GET /index.html HTTP/1.1\r\n" + host + "\r\n"},
+        {"memory 200 gzip",
+         "GET /assets/application-3f9a2c71.css HTTP/1.1\r\n" + host +
+         "Accept-Encoding: gzip, deflate, br\r\n\r\n"},
+        {"file 200 sendfile",
+         "GET /big.bin HTTP/1.1\r\n" + host + "\r\n"},
+        {"304 If-None-Match",
+         "GET /index.html HTTP/1.1\r\n" + host + "If-None-Match: " + etag +
+         "\r\n\r\n"},
+        {"404",
+         "GET /missing.html HTTP/1.1\r\n" + host + "\r\n"},
+        {"new connection",
+         "GET /index.html HTTP/1.1\r\n" + host + "Connection: close\r\n\r\n"},
+    };
+
+    std::printf("%-20s %-10s %-14s %-14s %-10s\n", "Scenario", "Requests",
+                "warmup allocs", "allocs/request", "ns/request");
+    for (const Scenario& s : scenarios) {
+        uint64_t before = t_allocs;
+        for (size_t i = 0; i < WARMUP; ++i) bench.exchange(s.request);
+        uint64_t warm = t_allocs - before;
+
+        before = t_allocs;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iters; ++i) bench.exchange(s.request);
+        auto end = std::chrono::steady_clock::now();
+        uint64_t allocs = t_allocs - before;
+
+        double ns = std::chrono::duration<double, std::nano>(end - start)
+                        .count() / iters;
+        std::printf("%-20s %-10zu %-14llu %-14.4f %-10.0f\n", s.name, iters,
+                    (unsigned long long)warm, (double)allocs / iters, ns);
+    }
+
+    const BufferPoolStats& ps = buffer_pool().stats();
+    std::printf("buffer pool: created=%llu reused=%llu dropped=%llu\n",
+                (unsigned long long)ps.created, (unsigned long long)ps.reused,
+                (unsigned long long)ps.dropped);
+
+    bench.close();
+    stop_async_logger();
+    std::string cleanup = "rm -rf " + root;
+    return std::system(cleanup.c_str()) == 0 ? 0 : 1;
+}
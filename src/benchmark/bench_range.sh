@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# Случайный доступ по Range к большому файлу против полной выкачки:
+# RPS, трафик и задержки для разных размеров диапазона.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+RESULT_FILE="${RESULT_FILE:-./results_range.csv}"
+TEST_FILE="file_10m.bin"
+ENGINE="${ENGINE:-epoll}"
+
+WORKERS="${WORKERS:-4}"
+CONCURRENCY="${CONCURRENCY:-100}"
+DURATION="${DURATION:-10}"
+# размеры диапазонов в байтах; 0 = файл целиком
+RANGE_SIZES=(0 4096 65536 1048576)
+
+cleanup_server() {
+    pkill -9 -f "http_server" >/dev/null 2>&1
+    sleep 0.5
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+if [ ! -f "$DOC_ROOT/$TEST_FILE" ]; then
+    ./gen_files.sh
+fi
+FILE_SIZE=$(stat -c %s "$DOC_ROOT/$TEST_FILE")
+
+mkdir -p "$LOG_DIR" "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
+cleanup_server
+$SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $WORKERS \
+            --log "$LOG_FILE" --engine "$ENGINE" &
+SERVER_PID=$!
+sleep 2
+
+rm -f "$RESULT_FILE"
+for size in "${RANGE_SIZES[@]}"; do
+    if [ "$size" = "0" ]; then
+        name="full"
+        RANGE_ARGS=""
+    else
+        name="range_$size"
+        RANGE_ARGS="--range $size:$FILE_SIZE"
+    fi
+    echo -n "$name ... "
+    "$BENCH_BIN" --port 8081 --threads $(nproc) --connections $CONCURRENCY \
+                 --duration $DURATION --path /$TEST_FILE $RANGE_ARGS \
+                 --csv "$RESULT_FILE" --label Scenario=$name \
+                 --label RangeBytes=$size | grep -E "^RPS" | tr -s ' '
+done
+
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+pkill -x http_server >/dev/null 2>&1
+
+# трафик, который клиент скачал бы, читая те же фрагменты целыми файлами
+awk -F, -v fsize=$FILE_SIZE 'NR == 1 {
+    for (i = 1; i <= NF; ++i) col[$i] = i
+    printf "%-16s %12s %14s %14s %10s\n", "Scenario", "RPS", "KB/request", "Saved_MB/s", "P99_ms"
+    next
+}
+{
+    rps = $col["RPS"]
+    kb = rps > 0 ? $col["TransferRate_KBps"] / rps : 0
+    saved = $col["RangeBytes"] > 0 ? rps * (fsize - $col["RangeBytes"]) / 1048576 : 0
+    printf "%-16s %12.1f %14.1f %14.1f %10.3f\n", $col["Scenario"], rps, kb, saved, $col["P99_ms"]
+}' "$RESULT_FILE"
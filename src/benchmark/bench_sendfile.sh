@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# Сравнение copy (read+send) и zero-copy (sendfile) путей отдачи тела:
+# сколько процессорного времени воркеров уходит на 1 GB ответа.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+RESULT_FILE="${RESULT_FILE:-./results_sendfile.csv}"
+TEST_FILE="file_10m.bin"
+ENGINE="${ENGINE:-epoll}"
+
+REQUESTS=2000
+WORKERS=4
+CONCURRENCY=100
+CLK_TCK=$(getconf CLK_TCK)
+
+cleanup_server() {
+    pkill -9 -f "http_server" >/dev/null 2>&1
+    sleep 0.5
+}
+
+# суммарные utime+stime (в тиках) всех воркеров мастера $1
+workers_cpu_ticks() {
+    local total=0
+    for pid in $(pgrep -P "$1"); do
+        if [ -r /proc/$pid/stat ]; then
+            local t=$(sed 's/.*) //' /proc/$pid/stat | awk '{print $12 + $13}')
+            total=$((total + t))
+        fi
+    done
+    echo $total
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+if [ ! -f "$DOC_ROOT/$TEST_FILE" ]; then
+    ./gen_files.sh
+fi
+
+mkdir -p "$LOG_DIR"
+echo "Sendfile,RPS,TransferRate_KBps,Bytes,CPU_s,CPU_s_per_GB" > $RESULT_FILE
+
+for mode in off on; do
+    echo -n "sendfile=$mode ... "
+
+    cleanup_server
+    $SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $WORKERS \
+                --log "$LOG_FILE" --engine "$ENGINE" --sendfile $mode &
+    SERVER_PID=$!
+    sleep 2
+
+    CPU_BEFORE=$(workers_cpu_ticks $SERVER_PID)
+    OUTPUT=$(ab -n $REQUESTS -c $CONCURRENCY -r -k http://127.0.0.1:8081/$TEST_FILE 2>&1)
+    CPU_AFTER=$(workers_cpu_ticks $SERVER_PID)
+
+    RPS=$(echo "$OUTPUT" | grep "Requests per second:" | awk '{print $4}')
+    TRATE=$(echo "$OUTPUT" | grep "Transfer rate:" | awk '{print $3}')
+    BYTES=$(echo "$OUTPUT" | grep "Total transferred:" | awk '{print $3}')
+
+    if [ -z "$BYTES" ] || [ "$BYTES" = "0" ]; then
+        echo "FAILED (ab error)"
+        echo "$mode,0,0,0,0,0" >> $RESULT_FILE
+    else
+        CPU_S=$(awk -v d=$((CPU_AFTER - CPU_BEFORE)) -v hz=$CLK_TCK \
+                    'BEGIN {printf "%.3f", d / hz}')
+        PER_GB=$(awk -v c=$CPU_S -v b=$BYTES \
+                     'BEGIN {printf "%.3f", c / (b / 1073741824)}')
+        echo "RPS: $RPS, CPU: ${CPU_S}s, ${PER_GB} CPU-s/GB"
+        echo "$mode,$RPS,$TRATE,$BYTES,$CPU_S,$PER_GB" >> $RESULT_FILE
+    fi
+
+    kill $SERVER_PID
+    wait $SERVER_PID 2>/dev/null
+    sleep 1
+done
+
+OFF=$(awk -F, '$1 == "off" {print $6}' $RESULT_FILE)
+ON=$(awk -F, '$1 == "on" {print $6}' $RESULT_FILE)
+awk -v off=$OFF -v on=$ON 'BEGIN {
+    printf "CPU saved by sendfile: %.3f CPU-s/GB", off - on
+    if (off > 0) printf " (%.1f%%)", (off - on) * 100 / off
+    printf "\n"
+}'
@@ -0,0 +1,782 @@
+// Нагрузочный генератор HTTP/1.1 на epoll: несколько потоков, у каждого
+// свой набор соединений.
+//
+//   закрытая петля (по умолчанию): на каждом соединении всегда --pipeline
+//   запросов в полёте, новый уходит сразу после ответа;
+//   открытая петля (--rate R): запросы порождаются с фиксированной частотой
+//   R/с независимо от ответов, задержка считается от запланированного
+//   момента отправки (без coordinated omission).
+//
+// Задержки пишутся в лог-линейную гистограмму (HDR-подобную, ошибка < 1%),
+// итог печатается и дописывается строкой в CSV и/или пишется в JSON.
+//
+// Сборка и запуск: см. run_bench.sh, либо
+//   g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o ../build/http_bench
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <strings.h>
+#include <time.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 128 поддиапазонов на каждую степень двойки; значения в микросекундах
+class Histogram {
+public:
+    static const int SUB_BITS = 7;
+    static const uint64_t SUB = 1u << SUB_BITS;
+    static const int MAX_SHIFT = 40;
+
+    Histogram() : counts_((MAX_SHIFT + 2) * SUB, 0) {}
+
+    void record(uint64_t v) {
+        ++counts_[index_of(v)];
+        ++count_;
+        sum_ += v;
+        if (v > max_) max_ = v;
+    }
+
+    void merge(const Histogram& o) {
+        for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += o.counts_[i];
+        count_ += o.count_;
+        sum_ += o.sum_;
+        if (o.max_ > max_) max_ = o.max_;
+    }
+
+    uint64_t percentile(double p) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * count_ + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t v = value_of(i);
+                return v < max_ ? v : max_;
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+
+private:
+    static size_t index_of(uint64_t v) {
+        if (v < SUB) return (size_t)v;
+        int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        if (shift > MAX_SHIFT) return (MAX_SHIFT + 2) * SUB - 1;
+        return (size_t)(shift + 1) * SUB + ((v >> shift) - SUB);
+    }
+
+    // середина поддиапазона
+    static uint64_t value_of(size_t idx) {
+        if (idx < SUB) return idx;
+        int shift = (int)(idx / SUB) - 1;
+        uint64_t sub = idx % SUB + SUB;
+        return (sub << shift) + ((1ULL << shift) >> 1);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct Target {
+    std::string path;
+    unsigned    weight = 1;
+    std::string request;
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t    port = 8080;
+    int         threads = 1;
+    int         connections = 10;
+    double      duration_s = 0;
+    uint64_t    requests = 0;
+    double      rate = 0;          // 0 = закрытая петля
+    int         pipeline = 1;
+    bool        keep_alive = true;
+    uint64_t    range_len = 0;     // >0: случайный Range такой длины
+    uint64_t    range_span = 0;    // в пределах первых range_span байт
+    std::vector<Target> targets;
+    std::string csv_path;
+    std::string json_path;
+    std::vector<std::pair<std::string, std::string>> labels;
+};
+
+struct ThreadStats {
+    Histogram hist;
+    uint64_t  completed = 0;
+    uint64_t  non2xx = 0;
+    uint64_t  errors = 0;
+    uint64_t  connects = 0;
+    uint64_t  bytes = 0;
+    std::vector<uint64_t> conn_bytes;   // по слотам соединений
+};
+
+struct ClientConn {
+    int  fd = -1;
+    bool connecting = false;
+
+    std::string wbuf;
+    size_t      wsent = 0;
+
+    std::deque<int64_t> inflight;   // моменты отправки (ns)
+
+    std::string head;
+    bool        in_body = false;
+    uint64_t    body_left = 0;
+    bool        close_after = false;
+};
+
+static std::atomic<bool>     g_stop{false};
+static std::atomic<uint64_t> g_issued{0};
+
+class Worker {
+public:
+    Worker(const Options& opt, int conns, double rate, uint32_t seed)
+        : opt_(opt), conns_(conns), rate_(rate), rng_(seed | 1) {
+        stats_.conn_bytes.assign(conns, 0);
+        for (const Target& t : opt_.targets) total_weight_ += t.weight;
+    }
+
+    void run() {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            perror("epoll_create1");
+            return;
+        }
+
+        if (rate_ > 0) {
+            timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+            int64_t period = (int64_t)(1e9 / rate_);
+            if (period < 1) period = 1;
+            itimerspec its{};
+            its.it_value.tv_nsec = 1;
+            its.it_interval.tv_sec = period / 1000000000LL;
+            its.it_interval.tv_nsec = period % 1000000000LL;
+            timerfd_settime(timer_fd_, 0, &its, nullptr);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u32 = TIMER_TAG;
+            epoll_ctl(epfd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+            period_ns_ = period;
+            next_arrival_ = now_ns();
+        }
+
+        for (size_t i = 0; i < conns_.size(); ++i) open_conn(i);
+
+        std::vector<epoll_event> events(256);
+        while (!g_stop.load(std::memory_order_relaxed)) {
+            if (rate_ == 0 && opt_.requests > 0 && idle()) break;
+
+            int n = epoll_wait(epfd_, events.data(), (int)events.size(), 100);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                uint32_t tag = events[i].data.u32;
+                if (tag == TIMER_TAG) {
+                    on_timer();
+                    continue;
+                }
+                on_event(tag, events[i].events);
+            }
+            if (rate_ > 0) dispatch_pending();
+        }
+
+        for (ClientConn& c : conns_)
+            if (c.fd >= 0) ::close(c.fd);
+        if (timer_fd_ >= 0) ::close(timer_fd_);
+        ::close(epfd_);
+    }
+
+    const ThreadStats& stats() const { return stats_; }
+
+private:
+    static const uint32_t TIMER_TAG = 0xffffffffu;
+
+    bool idle() const {
+        if (g_issued.load(std::memory_order_relaxed) < opt_.requests)
+            return false;
+        for (const ClientConn& c : conns_)
+            if (!c.inflight.empty()) return false;
+        return true;
+    }
+
+    uint32_t next_rand() {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 17;
+        rng_ ^= rng_ << 5;
+        return rng_;
+    }
+
+    const Target& pick_target() {
+        if (opt_.targets.size() == 1) return opt_.targets[0];
+        unsigned r = next_rand() % total_weight_;
+        for (const Target& t : opt_.targets) {
+            if (r < t.weight) return t;
+            r -= t.weight;
+        }
+        return opt_.targets.back();
+    }
+
+    bool may_issue() {
+        if (opt_.requests == 0) return true;
+        return g_issued.fetch_add(1, std::memory_order_relaxed) < opt_.requests;
+    }
+
+    void open_conn(size_t idx) {
+        ClientConn& c = conns_[idx];
+        c = ClientConn();
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            ++stats_.errors;
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opt_.port);
+        inet_pton(AF_INET, opt_.host.c_str(), &addr.sin_addr);
+
+        int r = ::connect(fd, (sockaddr*)&addr, sizeof(addr));
+        if (r < 0 && errno != EINPROGRESS) {
+            ++stats_.errors;
+            ::close(fd);
+            return;
+        }
+        c.fd = fd;
+        c.connecting = true;
+        ++stats_.connects;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u32 = (uint32_t)idx;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void close_conn(size_t idx, bool failed) {
+        ClientConn& c = conns_[idx];
+        if (failed) {
+            stats_.errors += c.inflight.empty() ? 1 : c.inflight.size();
+            // в открытой петле потерянные запросы не переотправляются
+        }
+        ::close(c.fd);
+        c.fd = -1;
+        if (!g_stop.load(std::memory_order_relaxed)) open_conn(idx);
+    }
+
+    void queue_request(ClientConn& c, int64_t start) {
+        const Target& t = pick_target();
+        if (opt_.range_len == 0) {
+            c.wbuf += t.request;
+        } else {
+            uint64_t slots = opt_.range_span - opt_.range_len + 1;
+            uint64_t from = ((uint64_t)next_rand() << 32 | next_rand()) % slots;
+            char range[64];
+            int n = std::snprintf(range, sizeof(range),
+                                  "Range: bytes=%llu-%llu\r\n\r\n",
+                                  (unsigned long long)from,
+                                  (unsigned long long)(from + opt_.range_len - 1));
+            c.wbuf.append(t.request, 0, t.request.size() - 2);
+            c.wbuf.append(range, n);
+        }
+        c.inflight.push_back(start);
+    }
+
+    // закрытая петля: держим pipeline запросов в полёте
+    void refill(ClientConn& c) {
+        if (rate_ > 0 || c.close_after) return;
+        int64_t t = now_ns();
+        while ((int)c.inflight.size() < opt_.pipeline && may_issue())
+            queue_request(c, t);
+    }
+
+    void on_timer() {
+        uint64_t expirations = 0;
+        if (::read(timer_fd_, &expirations, sizeof(expirations)) < 0) return;
+        for (uint64_t i = 0; i < expirations; ++i) {
+            pending_.push_back(next_arrival_);
+            next_arrival_ += period_ns_;
+        }
+    }
+
+    // открытая петля: запланированные запросы уходят на свободные соединения
+    void dispatch_pending() {
+        size_t n = conns_.size();
+        for (size_t k = 0; k < n && !pending_.empty(); ++k) {
+            size_t idx = (rr_ + k) % n;
+            ClientConn& c = conns_[idx];
+            if (c.fd < 0 || c.connecting || c.close_after) continue;
+            bool queued = false;
+            while ((int)c.inflight.size() < opt_.pipeline &&
+                   !pending_.empty()) {
+                queue_request(c, pending_.front());
+                pending_.pop_front();
+                queued = true;
+            }
+            if (queued) flush(idx);
+        }
+        rr_ = (rr_ + 1) % n;
+    }
+
+    bool flush(size_t idx) {
+        ClientConn& c = conns_[idx];
+        while (c.wsent < c.wbuf.size()) {
+            ssize_t n = ::send(c.fd, c.wbuf.data() + c.wsent,
+                               c.wbuf.size() - c.wsent, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.wsent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            } else {
+                close_conn(idx, true);
+                return false;
+            }
+        }
+        c.wbuf.clear();
+        c.wsent = 0;
+        return true;
+    }
+
+    void on_event(uint32_t idx, uint32_t events) {
+        ClientConn& c = conns_[idx];
+        if (c.fd < 0) return;
+
+        if (c.connecting) {
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                close_conn(idx, true);
+                return;
+            }
+            c.connecting = false;
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.u32 = idx;
+            epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+            refill(c);
+            if (!flush(idx)) return;
+        }
+
+        if (events & EPOLLOUT) {
+            if (!flush(idx)) return;
+        }
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) read_responses(idx);
+    }
+
+    void read_responses(size_t idx) {
+        static thread_local char buf[64 * 1024];
+        for (;;) {
+            ClientConn& c = conns_[idx];
+            if (c.fd < 0) return;
+            ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                stats_.bytes += n;
+                stats_.conn_bytes[idx] += n;
+                if (!consume(idx, buf, (size_t)n)) return;
+            } else if (n == 0) {
+                close_conn(idx, !c.inflight.empty());
+                return;
+            } else {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                close_conn(idx, true);
+                return;
+            }
+        }
+    }
+
+    // разбирает поток ответов; false, если соединение закрыто
+    bool consume(size_t idx, const char* p, size_t len) {
+        ClientConn& c = conns_[idx];
+        while (len > 0) {
+            if (c.in_body) {
+                size_t take = len < c.body_left ? len : (size_t)c.body_left;
+                c.body_left -= take;
+                p += take;
+                len -= take;
+                if (c.body_left == 0 && !complete(idx)) return false;
+                continue;
+            }
+
+            size_t old = c.head.size();
+            c.head.append(p, len);
+            size_t end = c.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+            if (end == std::string::npos) {
+                if (c.head.size() > 64 * 1024) {
+                    close_conn(idx, true);
+                    return false;
+                }
+                return true;
+            }
+            size_t head_len = end + 4;
+            size_t used = head_len - old;
+            p += used;
+            len -= used;
+            if (!parse_head(c, head_len)) {
+                close_conn(idx, true);
+                return false;
+            }
+            c.head.clear();
+            if (c.body_left == 0 && !complete(idx)) return false;
+        }
+        return true;
+    }
+
+    static bool header_is(const char* line, const char* name, size_t name_len) {
+        return strncasecmp(line, name, name_len) == 0;
+    }
+
+    bool parse_head(ClientConn& c, size_t head_len) {
+        const char* h = c.head.c_str();
+        if (head_len < 12 || std::strncmp(h, "HTTP/1.", 7) != 0) return false;
+        int status = std::atoi(h + 9);
+        if (status < 200 || status >= 300) ++stats_.non2xx;
+
+        c.body_left = 0;
+        c.in_body = true;
+        const char* line = std::strstr(h, "\r\n");
+        while (line && line + 2 < h + head_len) {
+            line += 2;
+            if (header_is(line, "Content-Length:", 15)) {
+                c.body_left = std::strtoull(line + 15, nullptr, 10);
+            } else if (header_is(line, "Connection:", 11)) {
+                const char* v = line + 11;
+                while (*v == ' ') ++v;
+                if (header_is(v, "close", 5)) c.close_after = true;
+            }
+            line = std::strstr(line, "\r\n");
+        }
+        return true;
+    }
+
+    bool complete(size_t idx) {
+        ClientConn& c = conns_[idx];
+        c.in_body = false;
+        if (!c.inflight.empty()) {
+            int64_t start = c.inflight.front();
+            c.inflight.pop_front();
+            int64_t lat = now_ns() - start;
+            stats_.hist.record(lat > 0 ? (uint64_t)lat / 1000 : 0);
+            ++stats_.completed;
+        }
+
+        if (c.close_after || !opt_.keep_alive) {
+            // оставшиеся конвейерные запросы сервер уже не обработает
+            stats_.errors += c.inflight.size();
+            c.inflight.clear();
+            close_conn(idx, false);
+            return false;
+        }
+
+        refill(c);
+        return flush(idx);
+    }
+
+    const Options&          opt_;
+    std::vector<ClientConn> conns_;
+    double                  rate_;
+    uint32_t                rng_;
+    unsigned                total_weight_ = 0;
+    int                     epfd_ = -1;
+    int                     timer_fd_ = -1;
+    int64_t                 period_ns_ = 0;
+    int64_t                 next_arrival_ = 0;
+    std::deque<int64_t>     pending_;
+    size_t                  rr_ = 0;
+    ThreadStats             stats_;
+};
+
+static void usage(const char* prog) {
+    std::fprintf(stderr,
+        "Usage: %s [--host IP] [--port N] [--threads N] [--connections N]\n"
+        "          [--duration SEC] [--requests N] [--rate RPS] [--pipeline N]\n"
+        "          [--keep-alive on|off] [--path URL[:WEIGHT]]...\n"
+        "          [--range LEN:SPAN]\n"
+        "          [--csv FILE] [--json FILE] [--label NAME=VALUE]...\n",
+        prog);
+}
+
+static bool parse_args(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        bool has_val = i + 1 < argc;
+        if (!std::strcmp(a, "--host") && has_val) {
+            opt.host = argv[++i];
+        } else if (!std::strcmp(a, "--port") && has_val) {
+            opt.port = (uint16_t)std::atoi(argv[++i]);
+        } else if (!std::strcmp(a, "--threads") && has_val) {
+            opt.threads = std::atoi(argv[++i]);
+        } else if (!std::strcmp(a, "--connections") && has_val) {
+            opt.connections = std::atoi(argv[++i]);
+        } else if (!std::strcmp(a, "--duration") && has_val) {
+            opt.duration_s = std::atof(argv[++i]);
+        } else if (!std::strcmp(a, "--requests") && has_val) {
+            opt.requests = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(a, "--rate") && has_val) {
+            opt.rate = std::atof(argv[++i]);
+        } else if (!std::strcmp(a, "--pipeline") && has_val) {
+            opt.pipeline = std::atoi(argv[++i]);
+        } else if (!std::strcmp(a, "--keep-alive") && has_val) {
+            opt.keep_alive = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(a, "--range") && has_val) {
+            // LEN:SPAN, например 65536:10485760
+            const char* spec = argv[++i];
+            char* end = nullptr;
+            opt.range_len = std::strtoull(spec, &end, 10);
+            if (*end != ':') return false;
+            opt.range_span = std::strtoull(end + 1, nullptr, 10);
+            if (opt.range_len == 0 || opt.range_span < opt.range_len)
+                return false;
+        } else if (!std::strcmp(a, "--path") && has_val) {
+            Target t;
+            t.path = argv[++i];
+            size_t colon = t.path.rfind(':');
+            if (colon != std::string::npos) {
+                t.weight = (unsigned)std::atoi(t.path.c_str() + colon + 1);
+                t.path.resize(colon);
+            }
+            if (t.weight == 0 || t.path.empty() || t.path[0] != '/')
+                return false;
+            opt.targets.push_back(t);
+        } else if (!std::strcmp(a, "--csv") && has_val) {
+            opt.csv_path = argv[++i];
+        } else if (!std::strcmp(a, "--json") && has_val) {
+            opt.json_path = argv[++i];
+        } else if (!std::strcmp(a, "--label") && has_val) {
+            std::string kv = argv[++i];
+            size_t eq = kv.find('=');
+            if (eq == std::string::npos) return false;
+            opt.labels.emplace_back(kv.substr(0, eq), kv.substr(eq + 1));
+        } else {
+            return false;
+        }
+    }
+
+    if (opt.threads < 1 || opt.connections < 1 || opt.pipeline < 1)
+        return false;
+    if (opt.threads > opt.connections) opt.threads = opt.connections;
+    if (opt.targets.empty()) {
+        Target t;
+        t.path = "/";
+        opt.targets.push_back(t);
+    }
+    if (opt.duration_s <= 0 && opt.requests == 0) opt.duration_s = 10;
+    if (opt.rate > 0 && opt.duration_s <= 0) return false;
+
+    std::string host_hdr = opt.host + ":" + std::to_string(opt.port);
+    for (Target& t : opt.targets) {
+        t.request = "GET " + t.path + " HTTP/1.1\r\nHost: " + host_hdr +
+                    "\r\nUser-Agent: http_bench\r\n";
+        if (!opt.keep_alive) t.request += "Connection: close\r\n";
+        t.request += "\r\n";
+    }
+    return true;
+}
+
+struct Summary {
+    double   elapsed_s = 0;
+    uint64_t completed = 0;
+    uint64_t non2xx = 0;
+    uint64_t errors = 0;
+    uint64_t connects = 0;
+    uint64_t bytes = 0;
+    double   rps = 0;
+    double   kbps = 0;
+    double   conn_kbps_mean = 0;
+    double   conn_kbps_min = 0;
+    double   mean_ms = 0;
+    double   p50_ms = 0;
+    double   p90_ms = 0;
+    double   p99_ms = 0;
+    double   p999_ms = 0;
+    double   max_ms = 0;
+};
+
+static void write_csv(const Options& opt, const Summary& s) {
+    FILE* probe = std::fopen(opt.csv_path.c_str(), "r");
+    bool need_header = true;
+    if (probe) {
+        need_header = std::fgetc(probe) == EOF;
+        std::fclose(probe);
+    }
+
+    FILE* f = std::fopen(opt.csv_path.c_str(), "a");
+    if (!f) {
+        perror(opt.csv_path.c_str());
+        return;
+    }
+    if (need_header) {
+        for (const auto& l : opt.labels) std::fprintf(f, "%s,", l.first.c_str());
+        std::fprintf(f, "Concurrency,Threads,Pipeline,TargetRate,Requests,"
+                        "Non2xx,Errors,Duration_s,RPS,TransferRate_KBps,"
+                        "TimePerRequest_ms,SpeedPerConn_KBps,"
+                        "SpeedPerConnMin_KBps,P50_ms,P90_ms,P99_ms,"
+                        "P999_ms,Max_ms\n");
+    }
+    for (const auto& l : opt.labels) std::fprintf(f, "%s,", l.second.c_str());
+    std::fprintf(f, "%d,%d,%d,%.0f,%llu,%llu,%llu,%.3f,%.2f,%.2f,%.3f,%.2f,"
+                    "%.2f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                 opt.connections, opt.threads, opt.pipeline, opt.rate,
+                 (unsigned long long)s.completed,
+                 (unsigned long long)s.non2xx,
+                 (unsigned long long)s.errors, s.elapsed_s, s.rps, s.kbps,
+                 s.mean_ms, s.conn_kbps_mean, s.conn_kbps_min, s.p50_ms,
+                 s.p90_ms, s.p99_ms, s.p999_ms, s.max_ms);
+    std::fclose(f);
+}
+
+static void write_json(const Options& opt, const Summary& s,
+                       const Histogram& h) {
+    FILE* f = std::fopen(opt.json_path.c_str(), "w");
+    if (!f) {
+        perror(opt.json_path.c_str());
+        return;
+    }
+    std::fprintf(f, "{\n");
+    for (const auto& l : opt.labels)
+        std::fprintf(f, "  \"%s\": \"%s\",\n", l.first.c_str(), l.second.c_str());
+    std::fprintf(f,
+        "  \"concurrency\": %d,\n  \"threads\": %d,\n  \"pipeline\": %d,\n"
+        "  \"target_rate\": %.0f,\n  \"keep_alive\": %s,\n"
+        "  \"requests\": %llu,\n  \"non2xx\": %llu,\n  \"errors\": %llu,\n"
+        "  \"connects\": %llu,\n  \"bytes\": %llu,\n"
+        "  \"duration_s\": %.3f,\n  \"rps\": %.2f,\n"
+        "  \"transfer_rate_kbps\": %.2f,\n"
+        "  \"speed_per_conn_kbps\": %.2f,\n"
+        "  \"speed_per_conn_min_kbps\": %.2f,\n"
+        "  \"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+        "\"p99\": %.3f, \"p99.9\": %.3f, \"max\": %.3f},\n",
+        opt.connections, opt.threads, opt.pipeline, opt.rate,
+        opt.keep_alive ? "true" : "false",
+        (unsigned long long)s.completed, (unsigned long long)s.non2xx,
+        (unsigned long long)s.errors, (unsigned long long)s.connects,
+        (unsigned long long)s.bytes, s.elapsed_s, s.rps, s.kbps,
+        s.conn_kbps_mean, s.conn_kbps_min, s.mean_ms, s.p50_ms, s.p90_ms,
+        s.p99_ms, s.p999_ms, s.max_ms);
+
+    // кривая процентилей для графика распределения задержек
+    static const double QUANTILES[] = {
+        0, 10, 20, 30, 40, 50, 60, 70, 75, 80, 85, 90, 95, 97.5, 99,
+        99.5, 99.9, 99.95, 99.99, 100
+    };
+    const size_t nq = sizeof(QUANTILES) / sizeof(QUANTILES[0]);
+    std::fprintf(f, "  \"percentiles\": [");
+    for (size_t i = 0; i < nq; ++i) {
+        std::fprintf(f, "%s{\"p\": %g, \"ms\": %.3f}", i ? ", " : "",
+                     QUANTILES[i], h.percentile(QUANTILES[i]) / 1000.0);
+    }
+    std::fprintf(f, "]\n}\n");
+    std::fclose(f);
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Worker*> workers;
+    for (int t = 0; t < opt.threads; ++t) {
+        int conns = opt.connections / opt.threads +
+                    (t < opt.connections % opt.threads ? 1 : 0);
+        workers.push_back(new Worker(opt, conns, opt.rate / opt.threads,
+                                     0x9e3779b9u * (t + 1)));
+    }
+
+    int64_t start = now_ns();
+    std::vector<std::thread> threads;
+    for (Worker* w : workers) threads.emplace_back([w] { w->run(); });
+
+    if (opt.duration_s > 0) {
+        int64_t deadline = start + (int64_t)(opt.duration_s * 1e9);
+        while (now_ns() < deadline) {
+            int64_t left_us = (deadline - now_ns()) / 1000;
+            usleep(left_us > 100000 ? 100000 : (useconds_t)left_us);
+        }
+        g_stop = true;
+    }
+    for (std::thread& th : threads) th.join();
+    int64_t end = now_ns();
+
+    Histogram hist;
+    Summary s;
+    std::vector<uint64_t> conn_bytes;
+    for (Worker* w : workers) {
+        const ThreadStats& st = w->stats();
+        hist.merge(st.hist);
+        s.completed += st.completed;
+        s.non2xx += st.non2xx;
+        s.errors += st.errors;
+        s.connects += st.connects;
+        s.bytes += st.bytes;
+        conn_bytes.insert(conn_bytes.end(), st.conn_bytes.begin(),
+                          st.conn_bytes.end());
+        delete w;
+    }
+
+    s.elapsed_s = (end - start) / 1e9;
+    s.rps = s.completed / s.elapsed_s;
+    s.kbps = s.bytes / 1024.0 / s.elapsed_s;
+    s.conn_kbps_mean = s.kbps / opt.connections;
+    uint64_t min_bytes = conn_bytes.empty() ? 0 : conn_bytes[0];
+    for (uint64_t b : conn_bytes) if (b < min_bytes) min_bytes = b;
+    s.conn_kbps_min = min_bytes / 1024.0 / s.elapsed_s;
+    s.mean_ms = hist.mean() / 1000.0;
+    s.p50_ms = hist.percentile(50) / 1000.0;
+    s.p90_ms = hist.percentile(90) / 1000.0;
+    s.p99_ms = hist.percentile(99) / 1000.0;
+    s.p999_ms = hist.percentile(99.9) / 1000.0;
+    s.max_ms = hist.max() / 1000.0;
+
+    std::printf("Requests:      %llu (non-2xx %llu, errors %llu, connects %llu)\n",
+                (unsigned long long)s.completed, (unsigned long long)s.non2xx,
+                (unsigned long long)s.errors, (unsigned long long)s.connects);
+    std::printf("Duration:      %.3f s\n", s.elapsed_s);
+    std::printf("RPS:           %.2f\n", s.rps);
+    std::printf("Transfer:      %.2f KB/s (%.2f KB/s per connection, min %.2f)\n",
+                s.kbps, s.conn_kbps_mean, s.conn_kbps_min);
+    std::printf("Latency (ms):  mean %.3f  p50 %.3f  p90 %.3f  p99 %.3f  "
+                "p99.9 %.3f  max %.3f\n",
+                s.mean_ms, s.p50_ms, s.p90_ms, s.p99_ms, s.p999_ms, s.max_ms);
+
+    if (!opt.csv_path.empty()) write_csv(opt, s);
+    if (!opt.json_path.empty()) write_json(opt, s, hist);
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Микробенчмарк разбора заголовков запроса: ns на запрос для
+// RequestParser (целиком и по фрагментам) и для прежнего разбора через
+// find("\r\n\r\n") + std::istringstream.
+//
+// Сборка и запуск: ./run_parser_bench.sh
+
+#include "../request_parser.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const char* SAMPLES[] = {
+    "GET /file_10m.bin HTTP/1.0\r\n"
+    "Connection: Keep-Alive\r\n"
+    "Host: 127.0.0.1:8081\r\n"
+    "User-Agent: ApacheBench/2.3\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+
+    "GET /style.css?v=42 HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Referer: http://example.com/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: ru-RU,ru;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+    "If-None-Match: \"5f3a-1b2c-65a1f0e2\"\r\n"
+    "If-Modified-Since: Tue, 02 Jan 2024 10:00:00 GMT\r\n"
+    "\r\n",
+};
+
+static volatile size_t g_sink;
+
+static bool legacy_parse(const std::string& in_buf) {
+    auto pos = in_buf.find("\r\n\r\n");
+    if (pos == std::string::npos) return false;
+
+    std::istringstream iss(in_buf.substr(0, pos));
+    std::string request_line;
+    if (!std::getline(iss, request_line)) return false;
+    if (!request_line.empty() && request_line.back() == '\r')
+        request_line.pop_back();
+
+    std::istringstream rl(request_line);
+    std::string method, path, http_version;
+    rl >> method >> path >> http_version;
+    g_sink += method.size() + path.size();
+    return !method.empty() && !path.empty();
+}
+
+template <typename F>
+static double measure(size_t iters, F&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i) fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+}
+
+int main(int argc, char* argv[]) {
+    size_t iters = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::printf("%-8s %-10s %-10s %-12s\n", "Sample", "Bytes", "Mode", "ns/request");
+
+    for (size_t s = 0; s < sizeof(SAMPLES) / sizeof(SAMPLES[0]); ++s) {
+        std::string req = SAMPLES[s];
+
+        double whole = measure(iters, [&] {
+            RequestParser p;
+            HttpRequest r;
+            if (p.parse(req.data(), req.size(), r) != ParseStatus::COMPLETE)
+                std::abort();
+            g_sink += r.target.size();
+        });
+
+        // три recv(): заголовок приходит по частям
+        size_t a = req.size() / 3, b = 2 * req.size() / 3;
+        double split = measure(iters, [&] {
+            RequestParser p;
+            HttpRequest r;
+            p.parse(req.data(), a, r);
+            p.parse(req.data(), b, r);
+            if (p.parse(req.data(), req.size(), r) != ParseStatus::COMPLETE)
+                std::abort();
+            g_sink += r.target.size();
+        });
+
+        double legacy = measure(iters, [&] {
+            if (!legacy_parse(req)) std::abort();
+        });
+
+        std::printf("%-8zu %-10zu %-10s %-12.1f\n", s, req.size(), "whole", whole);
+        std::printf("%-8zu %-10zu %-10s %-12.1f\n", s, req.size(), "split3", split);
+        std::printf("%-8zu %-10zu %-10s %-12.1f\n", s, req.size(), "legacy", legacy);
+    }
+    return 0;
+}
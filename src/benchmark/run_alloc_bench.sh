@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# Аллокации кучи на запрос: собирается вместе с исходниками сервера
+# (кроме main.cpp) и гоняет автомат соединения через socketpair.
+
+SERVER_SOURCE_DIR=".."
+BENCH_BIN="$SERVER_SOURCE_DIR/build/alloc_bench"
+ITERATIONS="${ITERATIONS:-100000}"
+
+SOURCES=$(ls "$SERVER_SOURCE_DIR"/*.cpp | grep -v '/main\.cpp$')
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread alloc_bench.cpp $SOURCES \
+    -o "$BENCH_BIN" || exit 1
+
+"$BENCH_BIN" "$ITERATIONS"
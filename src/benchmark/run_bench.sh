@@ -2,11 +2,33 @@
 
 SERVER_SOURCE_DIR=".."
 SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
 DOC_ROOT="../www"
 LOG_DIR="../log"
 LOG_FILE="$LOG_DIR/bench_server.log"
-RESULT_FILE="./results.csv"
+RESULT_FILE="${RESULT_FILE:-./results.csv}"
 TEST_FILE="file_10m.bin"
+# epoll | pselect | uring
+ENGINE="${ENGINE:-epoll}"
+# 1 = отдельный SO_REUSEPORT сокет на каждый воркер
+REUSEPORT="${REUSEPORT:-0}"
+BACKLOG="${BACKLOG:-511}"
+
+SERVER_ARGS="--engine $ENGINE --backlog $BACKLOG"
+if [ "$REUSEPORT" = "1" ]; then
+    SERVER_ARGS="$SERVER_ARGS --reuseport"
+fi
+
+# нагрузка: http_bench (см. http_bench.cpp)
+THREADS="${THREADS:-$(nproc)}"
+PIPELINE="${PIPELINE:-1}"
+# >0 = открытая петля с фиксированной частотой запросов
+RATE="${RATE:-0}"
+# >0 = каждый прогон длится DURATION секунд вместо REQUESTS запросов
+DURATION="${DURATION:-0}"
+JSON_DIR="${JSON_DIR:-}"
+# смесь файлов "путь:вес ...", по умолчанию только TEST_FILE
+MIX="${MIX:-/$TEST_FILE}"
 
 REQUESTS=3000 
 WORKER_COUNTS=(1 2 4 8)
@@ -23,6 +45,9 @@ if [ ! -f "$SERVER_BIN" ]; then
     exit 1
 fi
 
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
 if [ ! -f "$DOC_ROOT/$TEST_FILE" ]; then
     echo "Test file not found. Running generator..."
     ./gen_files.sh
@@ -33,14 +58,21 @@ if [ ! -f "$DOC_ROOT/$TEST_FILE" ]; then
     fi
 fi
 
-# CSV
-echo "Workers,Concurrency,RPS,TransferRate_KBps,TimePerRequest_ms" > $RESULT_FILE
+# CSV: заголовок пишет http_bench при первом прогоне
+rm -f "$RESULT_FILE"
+[ -n "$JSON_DIR" ] && mkdir -p "$JSON_DIR"
+
+PATH_ARGS=""
+for p in $MIX; do
+    PATH_ARGS="$PATH_ARGS --path $p"
+done
 
 for w in "${WORKER_COUNTS[@]}"; do
-    echo "Testing with WORKERS = $w"
+    echo "Testing with WORKERS = $w, ENGINE = $ENGINE"
 
     cleanup_server
-    $SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $w --log "$LOG_FILE" &
+    $SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $w --log "$LOG_FILE" \
+                $SERVER_ARGS &
     SERVER_PID=$!
     
     sleep 2
@@ -57,31 +89,37 @@ for w in "${WORKER_COUNTS[@]}"; do
             current_req=$c
         fi
 
-        echo -n "  Running ab with -c $c ... "
+        echo -n "  Running http_bench with -c $c ... "
 
-        OUTPUT=$(ab -n $current_req -c $c -r -k http://127.0.0.1:8081/$TEST_FILE 2>&1)
-
-        NON_200=$(echo "$OUTPUT" | grep "Non-2xx responses:")
-        if [ ! -z "$NON_200" ]; then
-            echo "WARNING: Server returned errors (404/403/500)"
+        LOAD_ARGS="--requests $current_req"
+        if [ "$DURATION" != "0" ]; then
+            LOAD_ARGS="--duration $DURATION"
+        fi
+        if [ "$RATE" != "0" ]; then
+            RATE_DURATION=$DURATION
+            [ "$DURATION" = "0" ] && RATE_DURATION=10
+            LOAD_ARGS="--duration $RATE_DURATION --rate $RATE"
+        fi
+        JSON_ARGS=""
+        if [ -n "$JSON_DIR" ]; then
+            JSON_ARGS="--json $JSON_DIR/w${w}_c${c}.json"
         fi
 
-        RPS=$(echo "$OUTPUT" | grep "Requests per second:" | awk '{print $4}')
-        TRATE=$(echo "$OUTPUT" | grep "Transfer rate:" | awk '{print $3}')
-        TPREQ=$(echo "$OUTPUT" | grep "Time per request:" | grep "(mean)" | head -n 1 | awk '{print $4}')
+        OUTPUT=$("$BENCH_BIN" --port 8081 --threads $THREADS --connections $c \
+                 --pipeline $PIPELINE $PATH_ARGS $LOAD_ARGS \
+                 --csv "$RESULT_FILE" --label Workers=$w $JSON_ARGS 2>&1)
 
-        if [ -z "$RPS" ]; then
-            RPS="0"
-            TRATE="0"
-            TPREQ="0"
-            echo "FAILED (ab error)"
+        if [ $? -ne 0 ]; then
+            echo "FAILED (http_bench error)"
+            echo "$OUTPUT"
             sleep 1
         else
-            echo "Done RPS: $RPS"
+            echo "$OUTPUT" | grep -E "^(RPS|Latency)" | tr -s ' ' | paste -sd ' '
+            if echo "$OUTPUT" | grep -q "non-2xx [1-9]"; then
+                echo "WARNING: Server returned errors (404/403/500)"
+            fi
         fi
 
-        echo "$w,$c,$RPS,$TRATE,$TPREQ" >> $RESULT_FILE
-        
         if [ $c -ge 500 ]; then
             sleep 1
         else
@@ -91,6 +129,10 @@ for w in "${WORKER_COUNTS[@]}"; do
 
     kill $SERVER_PID
     wait $SERVER_PID 2>/dev/null
+    pkill -x http_server >/dev/null 2>&1
+    sleep 0.5
+    # распределение соединений по воркерам
+    grep "accepted" "$LOG_FILE" | tail -n $w | awk '{print "    " $6, $7, $8, $9, $10}'
     echo
     sleep 1
 done
@@ -0,0 +1,122 @@
+#!/bin/bash
+
+# Холодный кэш: COLD_CONNS соединений читают набор из COLD_FILES файлов,
+# которых нет в page cache, а параллельно открытая петля с частотой
+# HOT_RATE запрашивает маленький файл из кэша в памяти. Каждые
+# DROP_INTERVAL секунд кэш сбрасывается заново, иначе набор прогревается
+# за первый проход. Сравниваются файловый ввод-вывод прямо в цикле
+# событий (--io-threads 0) и пул потоков ввода-вывода: интересна задержка
+# p99 горячих запросов, которые ждут за холодными.
+#
+# Сброс через /proc/sys/vm/drop_caches требует root; без него страницы
+# набора выбрасываются по одному файлу (dd iflag=nocache), а метаданные
+# остаются в кэше.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
+DOC_ROOT="../www"
+COLD_DIR="$DOC_ROOT/cold"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+RESULT_FILE="${RESULT_FILE:-./results_cold.csv}"
+HOT_FILE="index.html"
+ENGINE="${ENGINE:-epoll}"
+WORKERS="${WORKERS:-1}"
+DURATION="${DURATION:-10}"
+COLD_FILES="${COLD_FILES:-2000}"
+COLD_SIZE_KB="${COLD_SIZE_KB:-256}"
+COLD_CONNS="${COLD_CONNS:-16}"
+HOT_CONNS="${HOT_CONNS:-8}"
+HOT_RATE="${HOT_RATE:-1000}"
+DROP_INTERVAL="${DROP_INTERVAL:-0.5}"
+
+VARIANTS=(
+    "inline=--io-threads 0"
+    "pool=--io-threads 2"
+)
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+drop_cache() {
+    if [ -w /proc/sys/vm/drop_caches ]; then
+        echo 3 > /proc/sys/vm/drop_caches
+    else
+        for f in "$COLD_DIR"/*; do
+            dd if="$f" iflag=nocache count=0 status=none
+        done
+    fi
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
+if [ "$(ls "$COLD_DIR" 2>/dev/null | wc -l)" != "$COLD_FILES" ]; then
+    echo "Generating $COLD_FILES x ${COLD_SIZE_KB}KB in $COLD_DIR..."
+    rm -rf "$COLD_DIR"
+    mkdir -p "$COLD_DIR"
+    for i in $(seq 1 $COLD_FILES); do
+        head -c $((COLD_SIZE_KB * 1024)) /dev/urandom > "$COLD_DIR/f$i.bin"
+    done
+    sync
+fi
+
+PATH_ARGS=""
+for i in $(seq 1 $COLD_FILES); do
+    PATH_ARGS="$PATH_ARGS --path /cold/f$i.bin"
+done
+
+mkdir -p "$LOG_DIR"
+rm -f "$RESULT_FILE"
+
+for v in "${VARIANTS[@]}"; do
+    name="${v%%=*}"
+    opts="${v#*=}"
+    echo "$name ($opts)"
+
+    cleanup_server
+    drop_cache
+    $SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $WORKERS \
+                --log "$LOG_FILE" --engine "$ENGINE" $opts &
+    SERVER_PID=$!
+    sleep 2
+    if ! kill -0 $SERVER_PID 2>/dev/null; then
+        echo "Server failed to start! Check $LOG_FILE"
+        exit 1
+    fi
+
+    # кэш держится холодным всё время замера
+    (
+        end=$((SECONDS + DURATION))
+        while [ $SECONDS -lt $end ]; do
+            drop_cache
+            sleep $DROP_INTERVAL
+        done
+    ) &
+    DROP_PID=$!
+
+    "$BENCH_BIN" --port 8081 --threads 2 --connections $COLD_CONNS \
+        $PATH_ARGS --duration $DURATION --csv "$RESULT_FILE" \
+        --label Variant=$name --label Class=cold > "$LOG_DIR/cold_files.txt" 2>&1 &
+    COLD_PID=$!
+    sleep 1
+    HOT=$("$BENCH_BIN" --port 8081 --threads 1 --connections $HOT_CONNS \
+        --path /$HOT_FILE --rate $HOT_RATE --duration $((DURATION - 2)) \
+        --csv "$RESULT_FILE" --label Variant=$name --label Class=hot 2>&1)
+    wait $COLD_PID
+    wait $DROP_PID
+
+    echo "  hot:  $(echo "$HOT" | grep -E '^Latency' | tr -s ' ')"
+    echo "  cold: $(grep -E '^(RPS|Latency)' "$LOG_DIR/cold_files.txt" | tr -s ' ' | paste -sd ' ')"
+
+    kill $SERVER_PID
+    wait $SERVER_PID 2>/dev/null
+done
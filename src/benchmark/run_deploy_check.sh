@@ -0,0 +1,138 @@
+#!/bin/bash
+
+# Выкладка под нагрузкой: пока http_bench DURATION секунд гоняет запросы
+# по набору DEPLOY_FILES файлов, каждый раунд переписывает их новой
+# версией (часть через tmp + mv, часть на месте) и через GRACE_MS
+# миллисекунд запрашивает каждый файл. Ответ, в котором не текущая
+# версия, считается устаревшим.
+# Маленькие файлы живут в кэше в памяти, большие (BIG_KB) - в кэше
+# дескрипторов, так что проверяются оба. Размер тела меняется от раунда
+# к раунду, иначе устаревший fstat мог бы совпасть с новым.
+#
+# С --watch on устаревших ответов быть не должно; --watch off с TTL кэша
+# TTL_MS приведён для сравнения. Код возврата ненулевой, если при
+# включённом наблюдении был хоть один устаревший ответ. Ошибки в строке
+# нагрузки ожидаемы: файл, который переписывают на месте, может
+# укоротиться посреди отправки.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
+DOC_ROOT="../www"
+DEPLOY_DIR="$DOC_ROOT/deploy"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+ENGINE="${ENGINE:-epoll}"
+WORKERS="${WORKERS:-2}"
+DURATION="${DURATION:-10}"
+DEPLOY_FILES="${DEPLOY_FILES:-8}"
+BIG_KB="${BIG_KB:-200}"
+GRACE_MS="${GRACE_MS:-20}"
+TTL_MS="${TTL_MS:-2000}"
+LOAD_CONNS="${LOAD_CONNS:-32}"
+
+VARIANTS=(
+    "watch=--watch on --cache-ttl $TTL_MS"
+    "ttl=--watch off --cache-ttl $TTL_MS"
+)
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+file_name() {
+    if [ $(($1 % 2)) -eq 0 ]; then echo "small$1.txt"; else echo "big$1.txt"; fi
+}
+
+# версия в первой строке, дальше заполнитель меняющейся длины
+write_file() {
+    local i=$1 ver=$2 name pad
+    name=$(file_name $i)
+    if [ $((i % 2)) -eq 0 ]; then pad=$((100 + ver % 7 * 13))
+    else pad=$((BIG_KB * 1024 + ver % 7 * 4099)); fi
+    { echo "v=$ver $name"; head -c $pad /dev/zero | tr '\0' 'x'; } \
+        > "$DEPLOY_DIR/.$name.tmp"
+    if [ $((i % 4)) -lt 2 ]; then
+        mv "$DEPLOY_DIR/.$name.tmp" "$DEPLOY_DIR/$name"
+    else
+        cat "$DEPLOY_DIR/.$name.tmp" > "$DEPLOY_DIR/$name"
+        rm -f "$DEPLOY_DIR/.$name.tmp"
+    fi
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
+mkdir -p "$LOG_DIR"
+STATUS=0
+
+for v in "${VARIANTS[@]}"; do
+    name="${v%%=*}"
+    opts="${v#*=}"
+    echo "$name ($opts)"
+
+    cleanup_server
+    rm -rf "$DEPLOY_DIR"
+    mkdir -p "$DEPLOY_DIR"
+    for i in $(seq 1 $DEPLOY_FILES); do write_file $i 0; done
+
+    $SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $WORKERS \
+                --log "$LOG_FILE" --engine "$ENGINE" $opts &
+    SERVER_PID=$!
+    sleep 1
+    if ! kill -0 $SERVER_PID 2>/dev/null; then
+        echo "Server failed to start! Check $LOG_FILE"
+        exit 1
+    fi
+
+    PATH_ARGS=""
+    for i in $(seq 1 $DEPLOY_FILES); do
+        PATH_ARGS="$PATH_ARGS --path /deploy/$(file_name $i)"
+    done
+    "$BENCH_BIN" --port 8081 --threads 2 --connections $LOAD_CONNS \
+        $PATH_ARGS --duration $DURATION \
+        > "$LOG_DIR/deploy_load.txt" 2>&1 &
+    LOAD_PID=$!
+    sleep 1
+
+    stale=0
+    errors=0
+    checked=0
+    ver=0
+    while kill -0 $LOAD_PID 2>/dev/null; do
+        ver=$((ver + 1))
+        for i in $(seq 1 $DEPLOY_FILES); do write_file $i $ver; done
+        sleep "$(printf '0.%03d' $GRACE_MS)"
+        for i in $(seq 1 $DEPLOY_FILES); do
+            fname=$(file_name $i)
+            first=$(curl -s --max-time 2 "http://127.0.0.1:8081/deploy/$fname" |
+                    head -n 1)
+            checked=$((checked + 1))
+            if [ -z "$first" ]; then
+                errors=$((errors + 1))
+            elif [ "$first" != "v=$ver $fname" ]; then
+                stale=$((stale + 1))
+            fi
+        done
+    done
+
+    wait $LOAD_PID 2>/dev/null
+    echo "  rounds=$ver checked=$checked stale=$stale errors=$errors"
+    echo "  load: $(grep -E '^(RPS|Requests)' "$LOG_DIR/deploy_load.txt" |
+                    tr -s ' ' | paste -sd ' ')"
+    if [ "$name" = "watch" ] && [ $((stale + errors)) -ne 0 ]; then
+        STATUS=1
+    fi
+
+    kill $SERVER_PID
+    wait $SERVER_PID 2>/dev/null
+done
+
+rm -rf "$DEPLOY_DIR"
+exit $STATUS
@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Смешанная нагрузка: LARGE_CONNS соединений без остановки качают большой
+# файл, а параллельно открытая петля с частотой SMALL_RATE запрашивает
+# маленький. Сравниваются настройки планировщика отдачи (--tx-quantum,
+# --tx-budget): интересна задержка p99 маленьких ответов и то, сколько
+# при этом прокачивают большие.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+RESULT_FILE="${RESULT_FILE:-./results_fair.csv}"
+LARGE_FILE="file_10m.bin"
+SMALL_FILE="index.html"
+ENGINE="${ENGINE:-epoll}"
+SENDFILE="${SENDFILE:-on}"
+WORKERS="${WORKERS:-1}"
+DURATION="${DURATION:-10}"
+LARGE_CONNS="${LARGE_CONNS:-32}"
+SMALL_CONNS="${SMALL_CONNS:-16}"
+SMALL_RATE="${SMALL_RATE:-2000}"
+
+# имя=опции сервера; "unbounded" -- по 256 KB за ход без бюджета итерации,
+# как отдавались тела до планировщика
+VARIANTS=(
+    "fair=--tx-quantum 65536 --tx-budget 1048576"
+    "unbounded=--tx-quantum 262144 --tx-budget 0"
+)
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
+if [ ! -f "$DOC_ROOT/$LARGE_FILE" ]; then
+    ./gen_files.sh
+fi
+
+mkdir -p "$LOG_DIR"
+rm -f "$RESULT_FILE"
+
+for v in "${VARIANTS[@]}"; do
+    name="${v%%=*}"
+    opts="${v#*=}"
+    echo "$name ($opts)"
+
+    cleanup_server
+    $SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $WORKERS \
+                --log "$LOG_FILE" --engine "$ENGINE" --sendfile $SENDFILE \
+                $opts &
+    SERVER_PID=$!
+    sleep 2
+    if ! kill -0 $SERVER_PID 2>/dev/null; then
+        echo "Server failed to start! Check $LOG_FILE"
+        exit 1
+    fi
+
+    "$BENCH_BIN" --port 8081 --threads 2 --connections $LARGE_CONNS \
+        --path /$LARGE_FILE --duration $DURATION --csv "$RESULT_FILE" \
+        --label Variant=$name --label Class=large > "$LOG_DIR/fair_large.txt" 2>&1 &
+    LARGE_PID=$!
+    # большие успевают разогнаться до начала замера
+    sleep 1
+    SMALL=$("$BENCH_BIN" --port 8081 --threads 1 --connections $SMALL_CONNS \
+        --path /$SMALL_FILE --rate $SMALL_RATE --duration $((DURATION - 2)) \
+        --csv "$RESULT_FILE" --label Variant=$name --label Class=small 2>&1)
+    wait $LARGE_PID
+
+    echo "  small: $(echo "$SMALL" | grep -E '^Latency' | tr -s ' ')"
+    echo "  large: $(grep -E '^(RPS|Transfer)' "$LOG_DIR/fair_large.txt" | tr -s ' ' | paste -sd ' ')"
+
+    kill $SERVER_PID
+    wait $SERVER_PID 2>/dev/null
+done
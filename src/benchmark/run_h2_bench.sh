@@ -0,0 +1,100 @@
+#!/bin/bash
+
+# HTTP/2 против HTTP/1.1 на загрузке "страницы": CLIENTS клиентов тянут
+# набор из ASSETS мелких файлов по ASSET_KB килобайт, как браузер тянет
+# скрипты, стили и картинки. HTTP/1.1 - http_bench, H1_CONNS соединений
+# на клиента (столько браузер держит на один хост), запросы в каждом по
+# очереди. HTTP/2 - h2load, одно соединение на клиента и до ASSETS
+# потоков в нём одновременно.
+#
+# Если h2load не установлен, используется nghttp: CLIENTS процессов,
+# каждый по одному соединению скачивает набор ROUNDS раз. Это грубее
+# (время включает запуск процессов), но разница в числе соединений и
+# параллельности видна и так.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
+DOC_ROOT="../www"
+ASSET_DIR="$DOC_ROOT/h2assets"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+ENGINE="${ENGINE:-epoll}"
+WORKERS="${WORKERS:-1}"
+DURATION="${DURATION:-10}"
+CLIENTS="${CLIENTS:-32}"
+ASSETS="${ASSETS:-40}"
+ASSET_KB="${ASSET_KB:-8}"
+H1_CONNS="${H1_CONNS:-6}"
+ROUNDS="${ROUNDS:-50}"
+H2LOAD="${H2LOAD:-$(command -v h2load)}"
+NGHTTP="${NGHTTP:-$(command -v nghttp)}"
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+if [ -z "$H2LOAD" ] && [ -z "$NGHTTP" ]; then
+    echo "Error: neither h2load nor nghttp found (set H2LOAD or NGHTTP)"
+    exit 1
+fi
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
+rm -rf "$ASSET_DIR"
+mkdir -p "$ASSET_DIR"
+PATH_ARGS=""
+URIS=""
+for i in $(seq 1 $ASSETS); do
+    head -c $((ASSET_KB * 1024)) /dev/urandom > "$ASSET_DIR/a$i.bin"
+    PATH_ARGS="$PATH_ARGS --path /h2assets/a$i.bin"
+    URIS="$URIS http://127.0.0.1:8081/h2assets/a$i.bin"
+done
+
+mkdir -p "$LOG_DIR"
+cleanup_server
+$SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers $WORKERS \
+            --log "$LOG_FILE" --engine "$ENGINE" &
+SERVER_PID=$!
+sleep 1
+if ! kill -0 $SERVER_PID 2>/dev/null; then
+    echo "Server failed to start! Check $LOG_FILE"
+    exit 1
+fi
+
+echo "http/1.1: $CLIENTS clients x $H1_CONNS connections"
+"$BENCH_BIN" --port 8081 --threads 2 --connections $((CLIENTS * H1_CONNS)) \
+    $PATH_ARGS --duration $DURATION > "$LOG_DIR/h2_bench_h1.txt" 2>&1
+echo "  $(grep -E '^(RPS|Transfer)' "$LOG_DIR/h2_bench_h1.txt" |
+          tr -s ' ' | paste -sd ' ')"
+
+echo "http/2: $CLIENTS clients x 1 connection, up to $ASSETS streams"
+if [ -n "$H2LOAD" ]; then
+    "$H2LOAD" -c $CLIENTS -m $ASSETS -t 2 -D $DURATION $URIS \
+        > "$LOG_DIR/h2_bench_h2.txt" 2>&1
+    echo "  $(grep -E '^(finished in|requests:)' "$LOG_DIR/h2_bench_h2.txt" |
+              tr -s ' ' | paste -sd ' ')"
+else
+    echo "  (h2load not found, nghttp x $ROUNDS rounds)"
+    start=$(date +%s.%N)
+    PIDS=()
+    for c in $(seq 1 $CLIENTS); do
+        "$NGHTTP" -n -m $ROUNDS $URIS > /dev/null 2>&1 &
+        PIDS+=($!)
+    done
+    wait "${PIDS[@]}"
+    end=$(date +%s.%N)
+    total=$((CLIENTS * ROUNDS * ASSETS))
+    awk -v n=$total -v t0=$start -v t1=$end \
+        'BEGIN { printf "  requests=%d time=%.3fs RPS=%.0f\n", n, t1 - t0, n / (t1 - t0) }'
+fi
+
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+rm -rf "$ASSET_DIR"
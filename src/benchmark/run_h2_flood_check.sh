@@ -0,0 +1,90 @@
+#!/bin/bash
+
+# Поток PING без чтения ответов (CVE-2019-9512/9515): клиент по h2c
+# шлёт PINGS кадров PING, не читая ни одного PING ACK, с маленьким
+# приёмным буфером, чтобы ответы быстро упёрлись в сеть. Сервер должен
+# закрыть соединение (GOAWAY ENHANCE_YOUR_CALM) или перестать читать,
+# а не копить ответы в памяти: RSS процессов сервера не должен вырасти
+# больше чем на MAX_GROWTH_KB, и после этого сервер отвечает на обычный
+# запрос. Код возврата ненулевой, если все кадры приняты или память
+# выросла, пока соединение открыто.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+ENGINE="${ENGINE:-epoll}"
+PINGS="${PINGS:-500000}"
+MAX_GROWTH_KB="${MAX_GROWTH_KB:-16384}"
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+# суммарный RSS процессов сервера, КБ
+server_rss() {
+    ps -C http_server -o rss= | awk '{ n += $1 } END { print n + 0 }'
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$LOG_DIR"
+cleanup_server
+$SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers 1 --threads 1 \
+            --log "$LOG_FILE" --engine "$ENGINE" &
+SERVER_PID=$!
+sleep 1
+if ! kill -0 $SERVER_PID 2>/dev/null; then
+    echo "Server failed to start! Check $LOG_FILE"
+    exit 1
+fi
+
+before=$(server_rss)
+result=$(python3 - "$PINGS" <<'EOF'
+import socket, subprocess, sys
+
+def rss():
+    out = subprocess.run(["ps", "-C", "http_server", "-o", "rss="],
+                         capture_output=True, text=True).stdout
+    return sum(int(x) for x in out.split())
+
+pings = int(sys.argv[1])
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+s.connect(("127.0.0.1", 8081))
+s.settimeout(5)
+s.sendall(b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + b"\0\0\0\4\0\0\0\0\0")
+ping = b"\0\0\x08\x06\0\0\0\0\0" + b"12345678"
+batch = 1000
+sent = 0
+try:
+    while sent < pings:
+        s.sendall(ping * batch)
+        sent += batch
+    verdict = "accepted"
+except socket.timeout:
+    verdict = "throttled"
+except OSError:
+    verdict = "closed"
+# пока соединение открыто, всё, что сервер для него держит
+print(verdict, sent, rss())
+EOF
+)
+status=$(curl -s -o /dev/null -w '%{http_code}' --max-time 2 \
+              "http://127.0.0.1:8081/index.html")
+
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+
+set -- $result
+growth=$(($3 - before))
+echo "pings: $1 $2 rss_growth=${growth}KB after_status=$status"
+if [ "$1" = "accepted" ] || [ $growth -gt $MAX_GROWTH_KB ] ||
+   [ "$status" != "200" ]; then
+    exit 1
+fi
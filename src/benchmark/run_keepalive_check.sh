@@ -0,0 +1,100 @@
+#!/bin/bash
+
+# Занятое keep-alive соединение не должно закрываться по таймауту
+# простоя: клиент в одном соединении шлёт запрос каждые INTERVAL_MS
+# миллисекунд, всего ROUNDS запросов, так что соединение живёт в
+# несколько раз дольше --keep-alive-timeout, но ни одна пауза его не
+# превышает. PROTO=h1 - HTTP/1.1, PROTO=h2 - h2c, по потоку на запрос.
+# Ответов должно быть ROUNDS, соединение - открыто до конца. Код
+# возврата ненулевой, если сервер закрыл его раньше.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+ENGINE="${ENGINE:-epoll}"
+PROTO="${PROTO:-h1}"
+KEEP_ALIVE_MS="${KEEP_ALIVE_MS:-2000}"
+INTERVAL_MS="${INTERVAL_MS:-500}"
+ROUNDS="${ROUNDS:-12}"
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$LOG_DIR"
+cleanup_server
+$SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers 1 --threads 1 \
+            --log "$LOG_FILE" --engine "$ENGINE" \
+            --keep-alive-timeout "$KEEP_ALIVE_MS" &
+SERVER_PID=$!
+sleep 1
+if ! kill -0 $SERVER_PID 2>/dev/null; then
+    echo "Server failed to start! Check $LOG_FILE"
+    exit 1
+fi
+
+result=$(python3 - "$PROTO" "$ROUNDS" "$INTERVAL_MS" <<'EOF'
+import socket, sys, time
+
+proto, rounds, interval = sys.argv[1], int(sys.argv[2]), int(sys.argv[3])
+s = socket.create_connection(("127.0.0.1", 8081))
+s.settimeout(0.2)
+buf = b""
+closed = False
+
+def drain():
+    global buf, closed
+    while not closed:
+        try:
+            d = s.recv(65536)
+        except socket.timeout:
+            return
+        if not d:
+            closed = True
+        buf += d
+
+def h2_responses():
+    # кадры HEADERS от сервера, по одному на ответ
+    n, pos = 0, 0
+    while len(buf) - pos >= 9:
+        ln = int.from_bytes(buf[pos:pos + 3], "big")
+        if buf[pos + 3] == 1:
+            n += 1
+        pos += 9 + ln
+    return n
+
+if proto == "h2":
+    s.sendall(b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + b"\0\0\0\4\0\0\0\0\0")
+for i in range(rounds):
+    if proto == "h2":
+        # GET / из статической таблицы HPACK, :authority x
+        block = b"\x82\x86\x84\x41\x01x"
+        s.sendall(len(block).to_bytes(3, "big") + b"\x01\x05" +
+                  (2 * i + 1).to_bytes(4, "big") + block)
+    else:
+        s.sendall(b"GET /index.html HTTP/1.1\r\nHost: x\r\n\r\n")
+    time.sleep(interval / 1000)
+    drain()
+    if closed:
+        break
+n = h2_responses() if proto == "h2" else buf.count(b"HTTP/1.1 200")
+print(n, "closed" if closed else "open")
+EOF
+)
+
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+
+set -- $result
+echo "responses=$1 expected=$ROUNDS connection=$2"
+if [ "$1" != "$ROUNDS" ] || [ "$2" != "open" ]; then
+    exit 1
+fi
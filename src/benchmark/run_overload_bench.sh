@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# Перегрузка: один воркер с лимитом дескрипторов FD_LIMIT (как ulimit -n
+# по умолчанию), а клиентов больше, чем он может держать открытыми.
+# Сравниваются лимит соединений, выведенный из RLIMIT_NOFILE
+# (--max-connections 0), и явный меньший лимит: интересно, что сервер не
+# крутит цикл на EMFILE, отвечает 503 на то, что не может принять, и
+# задержка принятых запросов остаётся ограниченной. Счётчики допуска
+# (shed, reclaimed, accept_pauses) берутся из итоговой строки лога.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+BENCH_BIN="$SERVER_SOURCE_DIR/build/http_bench"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+RESULT_FILE="${RESULT_FILE:-./results_overload.csv}"
+TEST_FILE="index.html"
+ENGINE="${ENGINE:-epoll}"
+DURATION="${DURATION:-10}"
+FD_LIMIT="${FD_LIMIT:-1024}"
+CONCURRENCY_LEVELS=(500 900 1000 2000 4000)
+
+VARIANTS=(
+    "fdlimit=--max-connections 0"
+    "capped=--max-connections 256"
+)
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread http_bench.cpp -o "$BENCH_BIN" || exit 1
+
+# клиентам нужно больше дескрипторов, чем серверу
+ulimit -n $((${CONCURRENCY_LEVELS[-1]} + 1024)) 2>/dev/null
+
+mkdir -p "$LOG_DIR"
+rm -f "$RESULT_FILE"
+
+for v in "${VARIANTS[@]}"; do
+    name="${v%%=*}"
+    opts="${v#*=}"
+    echo "$name ($opts, ulimit -n $FD_LIMIT)"
+
+    for c in "${CONCURRENCY_LEVELS[@]}"; do
+        cleanup_server
+        rm -f "$LOG_FILE"
+        (ulimit -n $FD_LIMIT && exec $SERVER_BIN --port 8081 \
+            --root "$DOC_ROOT" --workers 1 --log "$LOG_FILE" \
+            --engine "$ENGINE" $opts) &
+        SERVER_PID=$!
+        sleep 1
+        if ! kill -0 $SERVER_PID 2>/dev/null; then
+            echo "Server failed to start! Check $LOG_FILE"
+            exit 1
+        fi
+
+        OUTPUT=$("$BENCH_BIN" --port 8081 --threads 2 --connections $c \
+                 --path /$TEST_FILE --duration $DURATION \
+                 --csv "$RESULT_FILE" --label Variant=$name 2>&1)
+        echo "  -c $c: $(echo "$OUTPUT" | grep -E '^(RPS|Latency|Requests)' |
+                          tr -s ' ' | paste -sd ' ')"
+
+        kill $SERVER_PID
+        wait $SERVER_PID 2>/dev/null
+        echo "    $(grep -o 'shed=.*' "$LOG_FILE" | tail -n 1)"
+    done
+done
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+SERVER_SOURCE_DIR=".."
+BENCH_BIN="$SERVER_SOURCE_DIR/build/parser_bench"
+ITERATIONS="${ITERATIONS:-1000000}"
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall parser_bench.cpp "$SERVER_SOURCE_DIR/request_parser.cpp" \
+    -o "$BENCH_BIN" || exit 1
+
+"$BENCH_BIN" "$ITERATIONS"
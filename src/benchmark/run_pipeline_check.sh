@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Конвейер с недописанным хвостом: в одном сегменте приходит запрос
+# целиком и начало следующего, остаток - через HOLD_MS миллисекунд.
+# Первый ответ пакуется в process_input, пока второй запрос ещё не
+# разобран, и должен попасть в журнал доступа и в /metrics ровно один
+# раз. Проверяется ROUNDS соединений: ответов и строк в журнале
+# должно быть 2 * ROUNDS, а http_requests_total - вырасти на
+# 2 * ROUNDS плюс первый запрос /metrics. Код возврата ненулевой
+# при расхождении.
+
+SERVER_SOURCE_DIR=".."
+SERVER_BIN="$SERVER_SOURCE_DIR/build/http_server"
+DOC_ROOT="../www"
+LOG_DIR="../log"
+LOG_FILE="$LOG_DIR/bench_server.log"
+ACCESS_LOG="$LOG_DIR/pipeline_access.log"
+ENGINE="${ENGINE:-epoll}"
+ROUNDS="${ROUNDS:-20}"
+HOLD_MS="${HOLD_MS:-100}"
+
+cleanup_server() {
+    pkill -9 -x http_server >/dev/null 2>&1
+    sleep 0.5
+}
+
+# сумма http_requests_total по всем циклам событий
+requests_total() {
+    curl -s --max-time 2 "http://127.0.0.1:8081/metrics" |
+        awk '/^http_requests_total\{/ { n += $2 } END { print n + 0 }'
+}
+
+if [ ! -f "$SERVER_BIN" ]; then
+    echo "Error: Server binary not found at $SERVER_BIN"
+    exit 1
+fi
+
+mkdir -p "$LOG_DIR"
+rm -f "$ACCESS_LOG"
+cleanup_server
+$SERVER_BIN --port 8081 --root "$DOC_ROOT" --workers 1 --threads 1 \
+            --log "$LOG_FILE" --access-log "$ACCESS_LOG" --engine "$ENGINE" &
+SERVER_PID=$!
+sleep 1
+if ! kill -0 $SERVER_PID 2>/dev/null; then
+    echo "Server failed to start! Check $LOG_FILE"
+    exit 1
+fi
+
+before=$(requests_total)
+responses=0
+for i in $(seq 1 $ROUNDS); do
+    exec 3<>/dev/tcp/127.0.0.1/8081
+    printf 'GET /index.html HTTP/1.1\r\nHost: x\r\n\r\nGET /style.css HTTP/1.1\r\nHo' >&3
+    sleep "$(printf '0.%03d' $HOLD_MS)"
+    printf 'st: x\r\nConnection: close\r\n\r\n' >&3
+    n=$(timeout 2 cat <&3 | grep -ao 'HTTP/1.1 [0-9]' | wc -l)
+    exec 3<&-
+    responses=$((responses + n))
+done
+after=$(requests_total)
+
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+
+lines=$(grep -vc 'path=/metrics ' "$ACCESS_LOG")
+counted=$((after - before - 1))
+echo "responses=$responses access_log=$lines metrics=$counted" \
+     "expected=$((2 * ROUNDS))"
+if [ $responses -ne $((2 * ROUNDS)) ] || [ $lines -ne $((2 * ROUNDS)) ] ||
+   [ $counted -ne $((2 * ROUNDS)) ]; then
+    exit 1
+fi
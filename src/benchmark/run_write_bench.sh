@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# Системные вызовы и TCP-сегменты на ответ: собирается вместе с исходниками
+# сервера (кроме main.cpp) и гоняет автомат соединения через loopback.
+
+SERVER_SOURCE_DIR=".."
+BENCH_BIN="$SERVER_SOURCE_DIR/build/write_bench"
+ITERATIONS="${ITERATIONS:-2000}"
+
+SOURCES=$(ls "$SERVER_SOURCE_DIR"/*.cpp | grep -v '/main\.cpp$')
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread write_bench.cpp $SOURCES \
+    -o "$BENCH_BIN" || exit 1
+
+"$BENCH_BIN" "$ITERATIONS"
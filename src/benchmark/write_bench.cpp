@@ -0,0 +1,344 @@
+// Сколько системных вызовов и TCP-сегментов уходит на один ответ.
+// Автомат соединения из worker_loop (handle_read/handle_write) работает
+// с настоящим TCP-сокетом через loopback; MSS урезан до ethernet-ного,
+// иначе loopback с его MTU 64K склеит всё в один сегмент. Вызовы
+// recv/send/sendmsg/writev/sendfile/pread/setsockopt перехватываются и
+// считаются для текущего потока, сегменты берутся из TCP_INFO
+// (tcpi_segs_out) серверного сокета. Конвейерные сценарии отправляют
+// пачку запросов одной записью, счёт делится на число ответов.
+//
+// Сборка и запуск: ./run_write_bench.sh
+
+#include "../config.hpp"
+#include "../connection.hpp"
+#include "../conn_table.hpp"
+#include "../buffer_pool.hpp"
+#include "../content_cache.hpp"
+#include "../file_cache.hpp"
+#include "../timer_wheel.hpp"
+#include "../logger.hpp"
+#include "../clock.hpp"
+
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static __thread uint64_t t_writes = 0;
+static __thread uint64_t t_calls = 0;
+
+// обёртки поверх syscall(): сервер собран в тот же бинарник и зовёт их
+extern "C" {
+ssize_t recv(int fd, void* buf, size_t n, int flags) {
+    ++t_calls;
+    return syscall(SYS_recvfrom, fd, buf, n, flags, nullptr, nullptr);
+}
+
+ssize_t send(int fd, const void* buf, size_t n, int flags) {
+    ++t_calls;
+    ++t_writes;
+    return syscall(SYS_sendto, fd, buf, n, flags, nullptr, 0);
+}
+
+ssize_t sendmsg(int fd, const msghdr* msg, int flags) {
+    ++t_calls;
+    ++t_writes;
+    return syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+ssize_t writev(int fd, const iovec* iov, int cnt) {
+    ++t_calls;
+    ++t_writes;
+    return syscall(SYS_writev, fd, iov, cnt);
+}
+
+ssize_t sendfile(int out, int in, off_t* off, size_t n) noexcept {
+    ++t_calls;
+    ++t_writes;
+    return syscall(SYS_sendfile, out, in, off, n);
+}
+
+ssize_t pread(int fd, void* buf, size_t n, off_t off) {
+    ++t_calls;
+    return syscall(SYS_pread64, fd, buf, n, off);
+}
+
+int setsockopt(int fd, int level, int name, const void* val,
+               socklen_t len) noexcept {
+    ++t_calls;
+    return syscall(SYS_setsockopt, fd, level, name, val, len);
+}
+}
+
+static const int    ETHERNET_MSS = 1448;
+static const size_t WARMUP = 100;
+
+static void die(const char* what) {
+    std::perror(what);
+    std::exit(1);
+}
+
+static void write_file(const std::string& path, size_t size, char fill) {
+    std::string data(size, fill);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ::write(fd, data.data(), data.size()) != (ssize_t)size)
+        die(path.c_str());
+    ::close(fd);
+}
+
+static void set_int(int fd, int level, int name, int v) {
+    if (::setsockopt(fd, level, name, &v, sizeof(v)) != 0) die("setsockopt");
+}
+
+static uint32_t segs_out(int fd) {
+    tcp_info ti;
+    socklen_t len = sizeof(ti);
+    std::memset(&ti, 0, sizeof(ti));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) != 0)
+        die("TCP_INFO");
+    return ti.tcpi_segs_out;
+}
+
+// одно TCP-соединение через loopback; сторона сервера живёт в ConnTable
+class Bench {
+public:
+    Bench() : timers_(monotonic_ms()) {
+        listen_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_ < 0) die("socket");
+        set_int(listen_, SOL_SOCKET, SO_REUSEADDR, 1);
+        set_int(listen_, IPPROTO_TCP, TCP_MAXSEG, ETHERNET_MSS);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(listen_, (sockaddr*)&addr, sizeof(addr)) != 0)
+            die("bind");
+        socklen_t len = sizeof(addr_);
+        if (::listen(listen_, 4) != 0 ||
+            getsockname(listen_, (sockaddr*)&addr_, &len) != 0)
+            die("listen");
+    }
+
+    ~Bench() {
+        close();
+        ::close(listen_);
+    }
+
+    void open() {
+        client_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (client_ < 0) die("socket");
+        set_int(client_, IPPROTO_TCP, TCP_MAXSEG, ETHERNET_MSS);
+        if (::connect(client_, (sockaddr*)&addr_, sizeof(addr_)) != 0)
+            die("connect");
+        server_ = ::accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK);
+        if (server_ < 0) die("accept");
+        set_int(server_, IPPROTO_TCP, TCP_NODELAY, 1);
+        fcntl(client_, F_SETFL, O_NONBLOCK);
+
+        Connection& c = conns_.open(server_);
+        c.fd = server_;
+        take_buffers(c);
+        update_timer(c, *cfg_, timers_, monotonic_ms());
+    }
+
+    void close() {
+        if (server_ < 0) return;
+        Connection* c = conns_.find(server_);
+        if (c) {
+            release_file(*c);
+            return_buffers(*c);
+            timers_.cancel(server_);
+            conns_.close(server_);
+        }
+        ::close(server_);
+        ::close(client_);
+        server_ = client_ = -1;
+    }
+
+    void use(const ServerConfig& cfg) {
+        close();
+        cfg_ = &cfg;
+        open();
+    }
+
+    int server_fd() const { return server_; }
+
+    // пачка запросов -> все ответы; expect == 0: читать, пока идут данные
+    size_t exchange(const std::string& req, size_t expect) {
+        if (::write(client_, req.data(), req.size()) != (ssize_t)req.size())
+            die("write");
+        Connection& c = *conns_.find(server_);
+        bool want_close = false;
+        size_t got = 0;
+        c.would_block = false;
+        handle_read(c, *cfg_, want_close);
+        while (!want_close && (c.state == ConnState::SENDING_HEADERS ||
+                               c.state == ConnState::SENDING_BODY)) {
+            c.would_block = false;
+            handle_write(c, *cfg_, want_close);
+            got += drain(c.would_block ? 1000 : 0);
+            // ответы, которые сервер собрал из уже прочитанных запросов
+            if (!want_close && c.state == ConnState::READING_REQUEST &&
+                !c.in_buf.empty()) {
+                c.would_block = false;
+                handle_read(c, *cfg_, want_close);
+            }
+        }
+        if (want_close) die("server closed the connection");
+        update_timer(c, *cfg_, timers_, monotonic_ms());
+
+        if (expect == 0) {
+            for (;;) {
+                size_t n = drain(100);
+                if (n == 0) break;
+                got += n;
+            }
+            return got;
+        }
+        while (got < expect) {
+            size_t n = drain(1000);
+            if (n == 0) die("response truncated");
+            got += n;
+        }
+        return got;
+    }
+
+private:
+    size_t drain(int wait_ms) {
+        size_t total = 0;
+        if (wait_ms > 0) {
+            pollfd p = {client_, POLLIN, 0};
+            if (poll(&p, 1, wait_ms) <= 0) return 0;
+        }
+        for (;;) {
+            ssize_t n = ::read(client_, sink_, sizeof(sink_));
+            if (n <= 0) return total;
+            total += n;
+        }
+    }
+
+    const ServerConfig* cfg_ = nullptr;
+    ConnTable<Connection> conns_;
+    TimerWheel timers_;
+    sockaddr_in addr_{};
+    int listen_ = -1;
+    int server_ = -1;
+    int client_ = -1;
+    char sink_[256 * 1024];
+};
+
+struct Scenario {
+    const char* name;
+    const ServerConfig* cfg;
+    std::string request;
+    size_t responses;
+};
+
+static std::string repeat(const std::string& s, size_t n) {
+    std::string out;
+    for (size_t i = 0; i < n; ++i) out += s;
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    size_t iters = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+
+    char dir[] = "/tmp/write_bench.XXXXXX";
+    if (!mkdtemp(dir)) die("mkdtemp");
+    std::string root = dir;
+    write_file(root + "/index.html", 2048, 'a');
+    write_file(root + "/app.js", 12 * 1024, 'b');
+    write_file(root + "/photo.jpg", 32 * 1024, 'c');
+    write_file(root + "/video.mp4", 1024 * 1024, 'd');
+
+    ServerConfig sendfile_cfg;
+    sendfile_cfg.doc_root = root;
+    sendfile_cfg.log_path = root + "/server.log";
+    sendfile_cfg.access_log_path = root + "/access.log";
+    sendfile_cfg.mem_cache_max_file = 16 * 1024;
+    // все обмены идут по одному соединению
+    sendfile_cfg.max_keep_alive_requests = 0;
+    ServerConfig copy_cfg = sendfile_cfg;
+    copy_cfg.zero_copy = false;
+
+    init_logger(sendfile_cfg.log_path, sendfile_cfg.access_log_path);
+    start_async_logger();
+    content_cache().build(sendfile_cfg);
+    content_cache().set_ttl(sendfile_cfg.file_cache_ttl_ms);
+    file_cache().configure(sendfile_cfg.file_cache_entries,
+                           sendfile_cfg.file_cache_ttl_ms);
+
+    const std::string host = "Host: bench.local\r\nUser-Agent: write_bench\r\n";
+    std::string html = "GET /index.html HTTP/1.1\r\n" + host + "\r\n";
+    std::string js = "GET /app.js HTTP/1.1\r\n" + host + "\r\n";
+    std::string photo = "GET /photo.jpg HTTP/1.1\r\n" + host + "\r\n";
+    std::string video = "GET /video.mp4 HTTP/1.1\r\n" + host + "\r\n";
+    std::string ranges = "GET /video.mp4 HTTP/1.1\r\n" + host +
+                         "Range: bytes=0-99999,400000-499999,900000-\r\n\r\n";
+
+    Scenario scenarios[] = {
+        {"memory 2K", &sendfile_cfg, html, 1},
+        {"memory 12K", &sendfile_cfg, js, 1},
+        {"pipelined 8 x 2K", &sendfile_cfg, repeat(html, 8), 8},
+        {"pipelined 4 x 12K", &sendfile_cfg, repeat(js, 4), 4},
+        {"file 32K sendfile", &sendfile_cfg, photo, 1},
+        {"file 32K copy", &copy_cfg, photo, 1},
+        {"file 1M sendfile", &sendfile_cfg, video, 1},
+        {"file 1M copy", &copy_cfg, video, 1},
+        {"3 ranges sendfile", &sendfile_cfg, ranges, 1},
+    };
+
+    Bench bench;
+    bench.use(sendfile_cfg);
+    {
+        tcp_info ti;
+        socklen_t len = sizeof(ti);
+        std::memset(&ti, 0, sizeof(ti));
+        getsockopt(bench.server_fd(), IPPROTO_TCP, TCP_INFO, &ti, &len);
+        std::printf("MSS %u, %zu exchanges per scenario\n", ti.tcpi_snd_mss,
+                    iters);
+    }
+
+    std::printf("%-20s %-10s %-10s %-12s %-14s %-14s %-10s\n", "Scenario",
+                "Responses", "bytes/resp", "writes/resp", "syscalls/resp",
+                "segments/resp", "us/resp");
+    for (const Scenario& s : scenarios) {
+        bench.use(*s.cfg);
+        size_t expect = bench.exchange(s.request, 0);
+        for (size_t i = 0; i < WARMUP; ++i) bench.exchange(s.request, expect);
+
+        uint64_t writes = t_writes;
+        uint64_t calls = t_calls;
+        uint32_t segs = segs_out(bench.server_fd());
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iters; ++i) bench.exchange(s.request, expect);
+        auto end = std::chrono::steady_clock::now();
+        segs = segs_out(bench.server_fd()) - segs;
+        writes = t_writes - writes;
+        calls = t_calls - calls;
+
+        double n = (double)iters * s.responses;
+        double us = std::chrono::duration<double, std::micro>(end - start)
+                        .count() / n;
+        std::printf("%-20s %-10.0f %-10zu %-12.2f %-14.2f %-14.2f %-10.2f\n",
+                    s.name, n, expect / s.responses, writes / n, calls / n,
+                    segs / n, us);
+    }
+
+    bench.close();
+    stop_async_logger();
+    std::string cleanup = "rm -rf " + root;
+    return std::system(cleanup.c_str()) == 0 ? 0 : 1;
+}
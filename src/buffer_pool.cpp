@@ -0,0 +1,32 @@
+#include "buffer_pool.hpp"
+
+void BufferPool::take(std::string& buf) {
+    if (free_.empty()) {
+        std::string().swap(buf);
+        buf.reserve(BUFFER_SIZE);
+        ++stats_.created;
+        return;
+    }
+    buf.swap(free_.back());
+    free_.pop_back();
+    buf.clear();
+    ++stats_.reused;
+}
+
+void BufferPool::give(std::string& buf) {
+    if (buf.capacity() < BUFFER_SIZE || buf.capacity() > MAX_KEPT ||
+        free_.size() >= MAX_POOLED) {
+        if (buf.capacity() >= BUFFER_SIZE) ++stats_.dropped;
+        std::string().swap(buf);
+        return;
+    }
+    if (free_.capacity() == 0) free_.reserve(MAX_POOLED);
+    free_.emplace_back();
+    free_.back().swap(buf);
+}
+
+// one per event-loop thread, like the file cache
+BufferPool& buffer_pool() {
+    static thread_local BufferPool pool;
+    return pool;
+}
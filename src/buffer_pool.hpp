@@ -0,0 +1,40 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct BufferPoolStats {
+    uint64_t created = 0;
+    uint64_t reused = 0;
+    uint64_t dropped = 0;   // too large to keep, or the pool was full
+};
+
+// Recycled I/O buffers of one event-loop thread. A buffer keeps its
+// capacity from one connection to the next, so once a worker is warm,
+// reading requests and queuing responses allocate nothing. A buffer that
+// grew past MAX_KEPT (a long pipelined batch) is freed rather than kept.
+class BufferPool {
+public:
+    static const size_t BUFFER_SIZE = 4096;
+    static const size_t MAX_KEPT = 128 * 1024;
+    static const size_t MAX_POOLED = 1024;
+
+    // buf becomes an empty buffer with at least BUFFER_SIZE capacity
+    void take(std::string& buf);
+    // buf is left empty, without storage
+    void give(std::string& buf);
+
+    size_t pooled() const { return free_.size(); }
+    const BufferPoolStats& stats() const { return stats_; }
+
+private:
+    std::vector<std::string> free_;
+    BufferPoolStats stats_;
+};
+
+BufferPool& buffer_pool();
+
+#endif
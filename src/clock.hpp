@@ -0,0 +1,22 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <time.h>
+#include <cstdint>
+
+// CLOCK_MONOTONIC_COARSE is served from the vDSO, so this is cheap enough
+// for the per-request hot path.
+inline int64_t monotonic_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// precise variant for request durations
+inline int64_t monotonic_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
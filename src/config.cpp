@@ -0,0 +1,167 @@
+#include "config.hpp"
+#include "event_engine.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+static bool parse_etag(const char* s, ETagMode& mode) {
+    if (!std::strcmp(s, "strong")) {
+        mode = ETagMode::STRONG;
+        return true;
+    }
+    if (!std::strcmp(s, "weak")) {
+        mode = ETagMode::WEAK;
+        return true;
+    }
+    if (!std::strcmp(s, "off")) {
+        mode = ETagMode::OFF;
+        return true;
+    }
+    return false;
+}
+
+// "/static/=public, max-age=31536000" or ".html=no-cache"
+static bool parse_cache_control(const char* s,
+                                std::vector<CacheControlRule>& rules) {
+    const char* eq = std::strchr(s, '=');
+    if (!eq || eq == s || (s[0] != '/' && s[0] != '.') || !eq[1])
+        return false;
+    rules.push_back(CacheControlRule{std::string(s, eq - s),
+                                     std::string(eq + 1)});
+    return true;
+}
+
+static bool in_config_file = false;
+
+// One option per line, written as on the command line ("--port 8080").
+// The value is the rest of the line, so it may contain spaces; lines
+// starting with '#' are comments. Files do not nest.
+static bool parse_config_file(const char* path, ServerConfig& cfg) {
+    if (in_config_file) return false;
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::vector<std::string> tokens{path};
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        line = line.substr(start, end - start + 1);
+        size_t space = line.find_first_of(" \t");
+        tokens.push_back(line.substr(0, space));
+        if (space == std::string::npos) continue;
+        size_t value = line.find_first_not_of(" \t", space);
+        tokens.push_back(line.substr(value));
+    }
+
+    std::vector<char*> args;
+    for (std::string& t : tokens) args.push_back(&t[0]);
+    args.push_back(nullptr);
+    in_config_file = true;
+    bool ok = parse_config((int)tokens.size(), args.data(), cfg);
+    in_config_file = false;
+    return ok;
+}
+
+bool parse_config(int argc, char* argv[], ServerConfig& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--config") && i + 1 < argc &&
+            parse_config_file(argv[i + 1], cfg)) {
+            ++i;
+        } else if (!std::strcmp(argv[i], "--port") && i + 1 < argc) {
+            cfg.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--root") && i + 1 < argc) {
+            cfg.doc_root = argv[++i];
+        } else if (!std::strcmp(argv[i], "--pack") && i + 1 < argc) {
+            cfg.pack_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--log") && i + 1 < argc) {
+            cfg.log_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--access-log") && i + 1 < argc) {
+            cfg.access_log_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--workers") && i + 1 < argc) {
+            // auto also pins: the point is one loop per core
+            if (!std::strcmp(argv[++i], "auto")) {
+                cfg.workers = 0;
+                cfg.cpu_affinity = true;
+            } else {
+                cfg.workers = std::atoi(argv[i]);
+                if (cfg.workers <= 0) return false;
+            }
+        } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+            if (!std::strcmp(argv[++i], "auto")) {
+                cfg.threads = 0;
+            } else {
+                cfg.threads = std::atoi(argv[i]);
+                if (cfg.threads <= 0) return false;
+            }
+        } else if (!std::strcmp(argv[i], "--io-threads") && i + 1 < argc) {
+            cfg.io_threads = std::atoi(argv[++i]);
+            if (cfg.io_threads < 0) return false;
+        } else if (!std::strcmp(argv[i], "--cpu-affinity") && i + 1 < argc) {
+            cfg.cpu_affinity = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(argv[i], "--engine") && i + 1 < argc &&
+                   parse_engine(argv[i + 1], cfg.engine)) {
+            ++i;
+        } else if (!std::strcmp(argv[i], "--sendfile") && i + 1 < argc) {
+            cfg.zero_copy = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(argv[i], "--tx-quantum") && i + 1 < argc) {
+            cfg.tx_quantum = std::strtoull(argv[++i], nullptr, 10);
+            if (cfg.tx_quantum == 0) return false;
+        } else if (!std::strcmp(argv[i], "--tx-budget") && i + 1 < argc) {
+            cfg.tx_budget = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--file-cache") && i + 1 < argc) {
+            cfg.file_cache_entries = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--cache-ttl") && i + 1 < argc) {
+            cfg.file_cache_ttl_ms = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--watch") && i + 1 < argc) {
+            cfg.watch_root = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(argv[i], "--mem-cache") && i + 1 < argc) {
+            cfg.mem_cache_budget = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--mem-cache-max-file") && i + 1 < argc) {
+            cfg.mem_cache_max_file = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--backlog") && i + 1 < argc) {
+            cfg.backlog = std::atoi(argv[++i]);
+            if (cfg.backlog <= 0) return false;
+        } else if (!std::strcmp(argv[i], "--max-connections") && i + 1 < argc) {
+            cfg.max_connections = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--reuseport")) {
+            cfg.reuse_port = true;
+        } else if (!std::strcmp(argv[i], "--keep-alive") && i + 1 < argc) {
+            cfg.keep_alive = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(argv[i], "--http2") && i + 1 < argc) {
+            cfg.http2 = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(argv[i], "--h2-streams") && i + 1 < argc) {
+            cfg.h2_max_streams = std::strtoul(argv[++i], nullptr, 10);
+            if (cfg.h2_max_streams == 0) return false;
+        } else if (!std::strcmp(argv[i], "--max-requests") && i + 1 < argc) {
+            cfg.max_keep_alive_requests = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--keep-alive-timeout") && i + 1 < argc) {
+            cfg.keep_alive_timeout_ms = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--header-timeout") && i + 1 < argc) {
+            cfg.header_timeout_ms = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--send-timeout") && i + 1 < argc) {
+            cfg.send_timeout_ms = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--min-send-rate") && i + 1 < argc) {
+            cfg.min_send_rate = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--drain-timeout") && i + 1 < argc) {
+            cfg.drain_timeout_ms = std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--metrics-path") && i + 1 < argc) {
+            cfg.metrics_path = argv[++i];
+            if (cfg.metrics_path == "off") cfg.metrics_path.clear();
+        } else if (!std::strcmp(argv[i], "--precompressed") && i + 1 < argc) {
+            cfg.precompressed = std::strcmp(argv[++i], "off") != 0;
+        } else if (!std::strcmp(argv[i], "--etag") && i + 1 < argc &&
+                   parse_etag(argv[i + 1], cfg.etag)) {
+            ++i;
+        } else if (!std::strcmp(argv[i], "--cache-control") && i + 1 < argc &&
+                   parse_cache_control(argv[i + 1], cfg.cache_control)) {
+            ++i;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
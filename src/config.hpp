@@ -3,15 +3,68 @@
 
 #include <string>
 #include <cstdint>
+#include <vector>
+
+enum class EventEngine {
+    PSELECT,
+    EPOLL,
+    URING
+};
+
+enum class ETagMode {
+    STRONG,
+    WEAK,
+    OFF
+};
+
+// match is a path prefix ("/static/") or an extension (".css")
+struct CacheControlRule {
+    std::string match;
+    std::string value;
+};
 
 struct ServerConfig {
     std::string host      = "0.0.0.0";
     uint16_t    port      = 8080;
     std::string doc_root  = "./www";
+    std::string pack_path;   // site pack served instead of doc_root
     std::string log_path  = "./server.log";
-    int         workers   = 4;
+    std::string access_log_path;   // empty = no access log
+    int         workers   = 4;      // 0 = sized from the CPU topology
+    int         threads   = 1;      // event loops per worker, 0 = per CPU
+    bool        cpu_affinity = false;   // pin loops to CPUs of one node
+    int         io_threads = 2;   // file I/O threads per loop, 0 = inline
+    int         backlog   = 511;
+    size_t      max_connections = 0;   // per worker, 0 = as the fd limit allows
+    bool        reuse_port = false;
     size_t      max_file_size = 128 * 1024 * 1024;
-    bool        keep_alive_default = false;
+    bool        keep_alive = true;
+    bool        http2 = true;   // h2c by prior knowledge or Upgrade
+    unsigned    h2_max_streams = 128;   // concurrent streams per connection
+    unsigned    max_keep_alive_requests = 1000;
+    int         keep_alive_timeout_ms   = 5000;
+    int         header_timeout_ms = 10000;
+    int         send_timeout_ms   = 10000;
+    size_t      min_send_rate     = 1024;   // bytes/s over each send window
+    int         drain_timeout_ms  = 30000;  // graceful stop (SIGQUIT) cap
+    EventEngine engine    = EventEngine::EPOLL;
+    bool        zero_copy = true;
+    size_t      tx_quantum = 64 * 1024;     // body bytes per turn of a stream
+    size_t      tx_budget  = 1024 * 1024;   // per loop iteration, 0 = no cap
+    size_t      file_cache_entries = 1024;
+    int         file_cache_ttl_ms  = 2000;
+    bool        watch_root = true;   // inotify on doc_root instead of TTLs
+    size_t      mem_cache_budget   = 32 * 1024 * 1024;
+    size_t      mem_cache_max_file = 64 * 1024;
+    std::string metrics_path = "/metrics";   // empty = not served
+    bool        precompressed = true;   // serve .br/.zst/.gz siblings
+    ETagMode    etag = ETagMode::STRONG;
+    std::vector<CacheControlRule> cache_control;   // first match wins
 };
 
+// Fills cfg from the command line, where --config FILE reads further
+// options from a file at that point; false on an unknown or malformed
+// option. The master calls it again on SIGHUP.
+bool parse_config(int argc, char* argv[], ServerConfig& cfg);
+
 #endif
@@ -0,0 +1,61 @@
+#ifndef CONN_TABLE_HPP
+#define CONN_TABLE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Connection slots indexed by fd. A slot is reset when its fd closes but
+// never freed, and the kernel hands out the lowest free fd, so a busy loop
+// settles on a table about as large as its peak connection count and
+// opening a connection allocates nothing. Slots live in a deque so that a
+// reference stays valid while the table grows for a higher fd. Live fds
+// are also kept densely for the rare walks over every connection.
+template <typename T>
+class ConnTable {
+public:
+    T* find(int fd) {
+        if (fd < 0 || (size_t)fd >= slots_.size() || !slots_[fd].live)
+            return nullptr;
+        return &slots_[fd].value;
+    }
+
+    // a freshly reset slot; fd must not be open in the table
+    T& open(int fd) {
+        if ((size_t)fd >= slots_.size()) slots_.resize((size_t)fd + 1);
+        Slot& s = slots_[fd];
+        s.value = T();
+        s.live = true;
+        s.pos = live_.size();
+        live_.push_back(fd);
+        return s.value;
+    }
+
+    void close(int fd) {
+        if (!find(fd)) return;
+        Slot& s = slots_[fd];
+        s.live = false;
+        int last = live_.back();
+        live_[s.pos] = last;
+        slots_[last].pos = s.pos;
+        live_.pop_back();
+    }
+
+    size_t size() const { return live_.size(); }
+    bool empty() const { return live_.empty(); }
+
+    // live fds in no particular order; open() and close() reorder them
+    const std::vector<int>& fds() const { return live_; }
+
+private:
+    struct Slot {
+        T      value;
+        bool   live = false;
+        size_t pos = 0;   // index in live_
+    };
+
+    std::deque<Slot> slots_;
+    std::vector<int> live_;
+};
+
+#endif
@@ -2,14 +2,177 @@
 #include "config.hpp"
 #include "http.hpp"
 #include "logger.hpp"
+#include "file_cache.hpp"
+#include "timer_wheel.hpp"
+#include "clock.hpp"
+#include "metrics.hpp"
+#include "buffer_pool.hpp"
+#include "io_pool.hpp"
+#include "h2.hpp"
 
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
 static const size_t READ_CHUNK = 4096;
+static const size_t MAX_REQUEST_HEAD = 16 * 1024;
 static const size_t FILE_CHUNK = 16 * 1024;
+static const size_t SENDFILE_CHUNK = 256 * 1024;
+static const size_t PIPELINE_BATCH = 64 * 1024;
+// DATA framed per write call when there is no allowance
+static const size_t H2_BATCH = 256 * 1024;
+// a batched body this small is copied after its headers; an iovec entry
+// of its own would cost more than the copy
+static const size_t COPY_BODY_MAX = 512;
+
+static void log_request(const Connection& conn) {
+    int64_t duration = monotonic_us() - conn.req_start_us;
+    metrics_request(conn.status_code, conn.resp_bytes, duration);
+    if (!access_log_enabled()) return;
+    log_access(conn.req.method, conn.req.target, conn.status_code,
+               conn.resp_bytes, duration);
+}
+
+// Drops the request head that has been answered; bytes of pipelined
+// requests that follow it stay in in_buf.
+static void consume_request(Connection& conn) {
+    conn.in_buf.erase(0, conn.req.head_len);
+    conn.parser.reset();
+    conn.req = HttpRequest();
+    conn.io_resolved = false;
+}
+
+// A response can be batched with the next pipelined one when it is kept
+// alive, fully in memory and another request is already buffered.
+static bool can_batch(const Connection& conn) {
+    if (!conn.keep_alive || conn.file_fd >= 0) return false;
+    size_t body = conn.body_mem ? (size_t)(conn.file_size - conn.file_offset)
+                                : 0;
+    for (const BatchedBody& b : conn.batched) body += b.len;
+    return conn.out_buf.size() + body < PIPELINE_BATCH &&
+           conn.in_buf.size() > conn.req.head_len;
+}
+
+void process_input(Connection& conn,
+                   const ServerConfig& cfg,
+                   bool& want_close)
+{
+    want_close = false;
+    if (conn.h2) return h2_input(conn, cfg, want_close);
+
+    // HTTP/2 by prior knowledge opens with the client preface
+    if (cfg.http2 && conn.requests == 0 &&
+        conn.state == ConnState::READING_REQUEST) {
+        size_t m = h2_preface_match(conn.in_buf);
+        if (m == H2_PREFACE_LEN) {
+            h2_start(conn, cfg);
+            return h2_input(conn, cfg, want_close);
+        }
+        if (m == conn.in_buf.size()) return;
+    }
+
+    for (;;) {
+        // a parked request was parsed before it was parked
+        if (conn.state != ConnState::PREPARING_RESPONSE) {
+            ParseStatus st = parse_request(conn);
+
+            if (st == ParseStatus::INCOMPLETE) {
+                if (conn.state == ConnState::READING_REQUEST &&
+                    conn.in_buf.size() > MAX_REQUEST_HEAD) {
+                    want_close = true;
+                    conn.state = ConnState::CLOSING;
+                }
+                return;
+            }
+
+            if (st == ParseStatus::INVALID) {
+                if (conn.state == ConnState::READING_REQUEST) {
+                    want_close = true;
+                    conn.state = ConnState::CLOSING;
+                } else {
+                    // flush what is already batched, then hang up
+                    conn.keep_alive = false;
+                }
+                return;
+            }
+
+            conn.req_start_us = monotonic_us();
+            if (cfg.http2 && !conn.req.upgrade.empty() &&
+                h2_upgrade(conn, cfg))
+                return h2_input(conn, cfg, want_close);
+        }
+
+        size_t queued = conn.out_buf.size();
+        if (!prepare_response(conn, cfg)) {
+            conn.state = ConnState::PREPARING_RESPONSE;
+            return;
+        }
+        ++conn.requests;
+        conn.resp_bytes = conn.out_buf.size() - queued;
+        if (conn.body_mem || conn.file_fd >= 0)
+            conn.resp_bytes += conn.file_size - conn.file_offset;
+        for (const RangePart& p : conn.parts)
+            conn.resp_bytes += p.head.size() + (p.end - p.start);
+
+        if (!can_batch(conn)) return;
+
+        // queue the in-memory body behind its headers so the next response
+        // can follow it in the same write
+        if (conn.body_mem) {
+            size_t len = conn.file_size - conn.file_offset;
+            const char* mem = conn.body_mem + conn.file_offset;
+            if (len <= COPY_BODY_MAX)
+                conn.out_buf.append(mem, len);
+            else if (len > 0)
+                conn.batched.push_back({conn.out_buf.size(), mem, len});
+            conn.body_mem = nullptr;
+            conn.file_offset = conn.file_size = 0;
+        }
+        log_request(conn);
+        consume_request(conn);
+    }
+}
+
+void resume_request(Connection& conn,
+                    const ServerConfig& cfg,
+                    bool& want_close)
+{
+    conn.io_ticket = 0;
+    conn.io_resolved = true;
+    process_input(conn, cfg, want_close);
+}
+
+// HTTP/2 reads whatever arrives, also while responses are going out:
+// new streams, WINDOW_UPDATE and the rest of the control traffic
+static void read_h2(Connection& conn, const ServerConfig& cfg,
+                    bool& want_close) {
+    char buf[READ_CHUNK];
+    for (;;) {
+        ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            conn.in_buf.append(buf, n);
+            process_input(conn, cfg, want_close);
+            if (conn.state == ConnState::CLOSING) want_close = true;
+            if (want_close) return;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            conn.would_block = true;
+            return;
+        }
+        if (n < 0)
+            log_error("recv error: " + std::string(std::strerror(errno)));
+        want_close = true;
+        conn.state = ConnState::CLOSING;
+        return;
+    }
+}
 
 void handle_read(Connection& conn,
                  const ServerConfig& cfg,
@@ -19,33 +182,34 @@ void handle_read(Connection& conn,
     char buf[READ_CHUNK];
     bool keep_reading = true;
 
+    if (conn.h2) return read_h2(conn, cfg, want_close);
     if (conn.state != ConnState::READING_REQUEST) 
         return;
 
+    // pipelined requests left over from the previous response
+    if (!conn.in_buf.empty()) {
+        process_input(conn, cfg, want_close);
+        if (!want_close && conn.h2) return read_h2(conn, cfg, want_close);
+        if (want_close || conn.state != ConnState::READING_REQUEST)
+            return;
+    }
+
     while (keep_reading) {
         ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
         if (n > 0) {
             conn.in_buf.append(buf, n);
-            if (conn.in_buf.find("\r\n\r\n") != std::string::npos) {
-                if (!parse_request(conn)) {
-                    want_close = true;
-                    conn.state = ConnState::CLOSING;
-                    keep_reading = false;
-                } else {
-                    prepare_response(conn, cfg);
-                    keep_reading = false;
-                }
-            } else if (conn.in_buf.size() > 16 * 1024) {
-                want_close = true;
-                conn.state = ConnState::CLOSING;
+            process_input(conn, cfg, want_close);
+            if (!want_close && conn.h2)
+                return read_h2(conn, cfg, want_close);
+            if (want_close || conn.state != ConnState::READING_REQUEST)
                 keep_reading = false;
-            }
         } else if (n == 0) {
             want_close = true;
             conn.state = ConnState::CLOSING;
             keep_reading = false;
         } else {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn.would_block = true;
                 keep_reading = false;
             } else {
                 log_error("recv error: " + std::string(std::strerror(errno)));
@@ -57,97 +221,395 @@ void handle_read(Connection& conn,
     }
 }
 
+void release_file(Connection& conn) {
+    conn.file.reset();
+    conn.file_fd = -1;
+    conn.prefetched = 0;
+}
+
+void take_buffers(Connection& conn) {
+    buffer_pool().take(conn.in_buf);
+    buffer_pool().take(conn.out_buf);
+}
+
+void return_buffers(Connection& conn) {
+    buffer_pool().give(conn.in_buf);
+    buffer_pool().give(conn.out_buf);
+}
+
+bool next_range_part(Connection& conn) {
+    if (conn.next_part >= conn.parts.size()) return false;
+    RangePart& p = conn.parts[conn.next_part++];
+    conn.out_buf.swap(p.head);
+    conn.out_sent = 0;
+    conn.file_offset = p.start;
+    conn.file_size = p.end;
+    conn.state = ConnState::SENDING_HEADERS;
+    return true;
+}
+
+void finish_response(Connection& conn, bool& want_close) {
+    release_file(conn);
+    conn.parts.clear();
+    conn.next_part = 0;
+    conn.batched.clear();
+    conn.batch_next = conn.batch_sent = 0;
+    conn.body_mem = nullptr;
+    want_close = !conn.keep_alive;
+    conn.state = want_close ? ConnState::CLOSING
+                            : ConnState::READING_REQUEST;
+    // the last of a pipelined batch was logged and consumed when batched
+    if (conn.req.head_len > 0) {
+        log_request(conn);
+        consume_request(conn);
+    }
+    conn.out_buf.clear();
+    conn.out_sent = 0;
+}
+
+int output_iov(const Connection& conn, iovec* iov, int max) {
+    int cnt = 0;
+    size_t pos = conn.out_sent;
+    size_t skip = conn.batch_sent;
+    char* buf = const_cast<char*>(conn.out_buf.data());
+
+    for (size_t i = conn.batch_next; i < conn.batched.size(); ++i) {
+        const BatchedBody& b = conn.batched[i];
+        if (pos < b.at) {
+            if (cnt == max) return cnt;
+            iov[cnt++] = {buf + pos, b.at - pos};
+            pos = b.at;
+        }
+        if (cnt == max) return cnt;
+        iov[cnt++] = {const_cast<char*>(b.mem) + skip, b.len - skip};
+        skip = 0;
+    }
+    if (pos < conn.out_buf.size() && cnt < max)
+        iov[cnt++] = {buf + pos, conn.out_buf.size() - pos};
+    if (conn.body_mem && conn.file_offset < conn.file_size && cnt < max)
+        iov[cnt++] = {const_cast<char*>(conn.body_mem) + conn.file_offset,
+                      (size_t)(conn.file_size - conn.file_offset)};
+    return cnt;
+}
+
+void output_advance(Connection& conn, size_t n) {
+    while (n > 0 && conn.batch_next < conn.batched.size()) {
+        const BatchedBody& b = conn.batched[conn.batch_next];
+        if (conn.out_sent < b.at) {
+            size_t k = std::min(n, b.at - conn.out_sent);
+            conn.out_sent += k;
+            n -= k;
+            continue;
+        }
+        size_t k = std::min(n, b.len - conn.batch_sent);
+        conn.batch_sent += k;
+        n -= k;
+        if (conn.batch_sent == b.len) {
+            ++conn.batch_next;
+            conn.batch_sent = 0;
+        }
+    }
+    if (conn.batch_next == conn.batched.size() && conn.batch_next > 0) {
+        conn.batched.clear();
+        conn.batch_next = 0;
+    }
+
+    size_t k = std::min(n, conn.out_buf.size() - conn.out_sent);
+    conn.out_sent += k;
+    conn.file_offset += n - k;
+}
+
+bool output_pending(const Connection& conn) {
+    return conn.out_sent < conn.out_buf.size() ||
+           conn.batch_next < conn.batched.size() ||
+           (conn.body_mem && conn.file_offset < conn.file_size);
+}
+
+// Everything queued ahead of a file body goes out in as few sendmsg()
+// calls as the iovec limit allows: batched pipelined responses, the
+// current header block and an in-memory body.
+static void send_output(Connection& conn, int flags, bool& want_close) {
+    while (output_pending(conn)) {
+        iovec iov[MAX_OUTPUT_IOV];
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = output_iov(conn, iov, MAX_OUTPUT_IOV);
+
+        ssize_t n = ::sendmsg(conn.fd, &msg, flags);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn.would_block = true;
+            } else {
+                want_close = true;
+                conn.state = ConnState::CLOSING;
+            }
+            return;
+        }
+        conn.bytes_sent += n;
+        output_advance(conn, n);
+    }
+}
+
+static bool body_follows(const Connection& conn) {
+    return conn.state == ConnState::SENDING_HEADERS &&
+           !conn.head_only && conn.file_fd >= 0 &&
+           conn.file_offset < conn.file_size;
+}
+
+// A large body is read ahead by the I/O pool about a window in front of
+// the send position, so sendfile() and pread() find its pages resident
+// instead of waiting on the disk in the event loop.
+static void prefetch_body(Connection& conn) {
+    if (!io_pool().running()) return;
+    if (conn.prefetched <= conn.file_offset) {
+        if (conn.file_size - conn.file_offset < READAHEAD_MIN) return;
+        conn.prefetched = conn.file_offset;
+    }
+    if (conn.prefetched >= conn.file_size ||
+        conn.prefetched - conn.file_offset >= READAHEAD_WINDOW / 2)
+        return;
+    off_t len = conn.file_size - conn.prefetched;
+    if (len > READAHEAD_WINDOW) len = READAHEAD_WINDOW;
+    io_pool().readahead(conn.file, conn.file_fd, conn.prefetched, len);
+    conn.prefetched += len;
+}
+
+// Zero-copy body transfer: the kernel moves page-cache pages straight to
+// the socket and advances file_offset for us.
+static void send_body_zero_copy(Connection& conn, size_t limit,
+                                bool& want_close) {
+    size_t to_send = limit;
+    if ((size_t)(conn.file_size - conn.file_offset) < to_send)
+        to_send = conn.file_size - conn.file_offset;
+
+    ssize_t n = ::sendfile(conn.fd, conn.file_fd, &conn.file_offset, to_send);
+    if (n > 0) {
+        conn.bytes_sent += n;
+        return;
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        conn.would_block = true;
+    } else if (n == 0) {
+        conn.file_offset = conn.file_size;
+    } else {
+        log_error("sendfile error: " + std::string(std::strerror(errno)));
+        want_close = true;
+        conn.state = ConnState::CLOSING;
+    }
+}
+
+// Copy path: the next slice of the file is read in behind whatever is
+// still queued in out_buf, so a header block and the start of its body
+// leave in the same write.
+static void read_file_chunk(Connection& conn, size_t limit) {
+    size_t len = limit;
+    if ((size_t)(conn.file_size - conn.file_offset) < len)
+        len = conn.file_size - conn.file_offset;
+
+    size_t at = conn.out_buf.size();
+    conn.out_buf.resize(at + len);
+    ssize_t r = ::pread(conn.file_fd, &conn.out_buf[at], len,
+                        conn.file_offset);
+    if (r <= 0) {
+        conn.out_buf.resize(at);
+        conn.file_offset = conn.file_size;
+        return;
+    }
+    conn.out_buf.resize(at + r);
+    conn.file_offset += r;
+}
+
+static void send_body_copy(Connection& conn, size_t limit,
+                           bool& want_close) {
+    conn.out_buf.clear();
+    conn.out_sent = 0;
+    read_file_chunk(conn, limit);
+    send_output(conn, 0, want_close);
+}
+
+static void set_cork(Connection& conn, bool on) {
+    int v = on ? 1 : 0;
+    ::setsockopt(conn.fd, IPPROTO_TCP, TCP_CORK, &v, sizeof(v));
+    conn.corked = on;
+}
+
+// The body is about to follow its header block. The copy path reads its
+// first slice in behind the headers. With sendfile, a body that takes more
+// than one call is corked, so no partial segment leaves at the end of each
+// call; the cork comes off when the response is complete.
+static void start_body(Connection& conn, const ServerConfig& cfg,
+                       size_t limit) {
+    conn.state = ConnState::SENDING_BODY;
+    prefetch_body(conn);
+    if (!cfg.zero_copy) {
+        read_file_chunk(conn, limit < FILE_CHUNK ? limit : FILE_CHUNK);
+        return;
+    }
+    if (!conn.corked &&
+        (size_t)(conn.file_size - conn.file_offset) > SENDFILE_CHUNK)
+        set_cork(conn, true);
+}
+
+static void end_response(Connection& conn, bool& want_close) {
+    if (conn.corked) set_cork(conn, false);
+    finish_response(conn, want_close);
+}
+
+bool streaming_body(const Connection& conn) {
+    if (conn.h2) return h2_streaming(conn);
+    return (conn.state == ConnState::SENDING_HEADERS ||
+            conn.state == ConnState::SENDING_BODY) &&
+           conn.file_fd >= 0 && !conn.head_only;
+}
+
+// HTTP/2: out_buf is refilled from the session each time it drains, with
+// DATA up to the allowance. Running out of it leaves the connection
+// streaming; otherwise it waits for input (a window, a new stream).
+static void write_h2(Connection& conn, size_t allowance, bool& want_close) {
+    uint64_t start = conn.bytes_sent;
+    size_t limit = allowance ? allowance : H2_BATCH;
+    conn.would_block = false;
+    for (;;) {
+        send_output(conn, 0, want_close);
+        if (want_close || conn.would_block) return;
+        conn.out_buf.clear();
+        conn.out_sent = 0;
+        size_t used = (size_t)(conn.bytes_sent - start);
+        if (!h2_fill(conn, used < limit ? limit - used : 0)) break;
+    }
+    if (conn.state == ConnState::CLOSING) {
+        want_close = true;
+        return;
+    }
+    conn.would_block = !h2_streaming(conn);
+}
+
 void handle_write(Connection& conn,
-                  bool& want_close)
+                  const ServerConfig& cfg,
+                  bool& want_close,
+                  size_t allowance)
 {
     want_close = false;
+    uint64_t start = conn.bytes_sent;
+    // what is left of the allowance for the next chunk; 0 ends the call
+    auto room = [&](size_t chunk) -> size_t {
+        if (allowance == 0) return chunk;
+        size_t used = (size_t)(conn.bytes_sent - start);
+        if (used >= allowance) return 0;
+        return allowance - used < chunk ? allowance - used : chunk;
+    };
 
     if (conn.state != ConnState::SENDING_HEADERS &&
         conn.state != ConnState::SENDING_BODY)
         return;
+    if (conn.h2) return write_h2(conn, allowance, want_close);
 
-    while (conn.out_sent < conn.out_buf.size()) {
-        ssize_t n = ::send(conn.fd,
-                           conn.out_buf.data() + conn.out_sent,
-                           conn.out_buf.size() - conn.out_sent,
-                           0);
-        if (n > 0) {
-            conn.out_sent += n;
-        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            return;
-        } else {
-            want_close = true;
-            conn.state = ConnState::CLOSING;
-            return;
-        }
+    if (conn.body_mem) {
+        send_output(conn, 0, want_close);
+        if (!want_close && !conn.would_block)
+            finish_response(conn, want_close);
+        return;
     }
 
-    if (conn.state == ConnState::SENDING_HEADERS) {
-        if (conn.head_only || conn.file_size == 0 || conn.file_fd < 0) {
-            want_close = !conn.keep_alive;
-            conn.state = want_close ? ConnState::CLOSING
-                                    : ConnState::READING_REQUEST;
-            conn.in_buf.clear();
-            conn.out_buf.clear();
-            conn.out_sent = 0;
-            if (conn.file_fd >= 0) {
-                ::close(conn.file_fd);
-                conn.file_fd = -1;
-            }
-            return;
-        } else {
-            conn.state = ConnState::SENDING_BODY;
-            conn.out_buf.clear();
-            conn.out_sent = 0;
+    for (;;) {
+        if (body_follows(conn)) {
+            size_t limit = room(SENDFILE_CHUNK);
+            if (limit == 0) return;
+            start_body(conn, cfg, limit);
         }
-    }
 
-    if (conn.state == ConnState::SENDING_BODY) {
-        char file_buf[FILE_CHUNK];
+        // the header block waits for the body segment that follows it
+        int flags = (cfg.zero_copy && conn.state == ConnState::SENDING_BODY &&
+                     conn.file_offset < conn.file_size) ? MSG_MORE : 0;
+        send_output(conn, flags, want_close);
+        if (want_close || conn.would_block) return;
+
+        if (conn.state == ConnState::SENDING_HEADERS) {
+            if (next_range_part(conn)) continue;
+            end_response(conn, want_close);
+            return;
+        }
 
         if (conn.file_offset < conn.file_size) {
-            ssize_t to_read = FILE_CHUNK;
-            if (conn.file_size - conn.file_offset < to_read)
-                to_read = conn.file_size - conn.file_offset;
-
-            ssize_t r = ::read(conn.file_fd, file_buf, to_read);
-            if (r > 0) {
-                conn.file_offset += r;
-                ssize_t sent_total = 0;
-                while (sent_total < r) {
-                    ssize_t n = ::send(conn.fd,
-                                       file_buf + sent_total,
-                                       r - sent_total,
-                                       0);
-                    if (n > 0) {
-                        sent_total += n;
-                    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                        conn.out_buf.assign(file_buf + sent_total,
-                                            r - sent_total);
-                        conn.out_sent = 0;
-                        return;
-                    } else {
-                        want_close = true;
-                        conn.state = ConnState::CLOSING;
-                        return;
-                    }
-                }
-            } else {
-                conn.file_offset = conn.file_size;
-            }
+            size_t limit = room(cfg.zero_copy ? SENDFILE_CHUNK : FILE_CHUNK);
+            if (limit == 0) return;
+            prefetch_body(conn);
+            if (cfg.zero_copy)
+                send_body_zero_copy(conn, limit, want_close);
+            else
+                send_body_copy(conn, limit, want_close);
+            if (want_close || conn.would_block) return;
         }
 
-        if (conn.file_offset >= conn.file_size) {
-            if (conn.file_fd >= 0) {
-                ::close(conn.file_fd);
-                conn.file_fd = -1;
-            }
-            want_close = !conn.keep_alive;
-            conn.state = want_close ? ConnState::CLOSING
-                                    : ConnState::READING_REQUEST;
-            conn.in_buf.clear();
-            conn.out_buf.clear();
-            conn.out_sent = 0;
+        if (conn.file_offset < conn.file_size) {
+            if (allowance == 0) return;
+            continue;
         }
+        if (output_pending(conn)) continue;
+        if (!next_range_part(conn)) {
+            end_response(conn, want_close);
+            return;
+        }
+    }
+}
+
+static int phase_timeout(ConnTimer t, const ServerConfig& cfg) {
+    switch (t) {
+        case ConnTimer::HEADER: return cfg.header_timeout_ms;
+        case ConnTimer::IDLE:   return cfg.keep_alive_timeout_ms;
+        case ConnTimer::SEND:   return cfg.send_timeout_ms;
+        default:                return 0;
     }
 }
+
+void update_timer(Connection& conn,
+                  const ServerConfig& cfg,
+                  TimerWheel& timers,
+                  int64_t now_ms)
+{
+    ConnTimer want = conn.timer;
+    if (conn.state == ConnState::READING_REQUEST) {
+        want = (conn.requests > 0 && conn.in_buf.empty()) ? ConnTimer::IDLE
+                                                           : ConnTimer::HEADER;
+    } else if (conn.h2 ? h2_parked(conn) : conn.io_ticket != 0) {
+        // Waiting on the I/O pool, not on the client: a slow RESOLVE must
+        // not count against the send rate. The resume re-arms SEND.
+        want = ConnTimer::NONE;
+    } else if (conn.state == ConnState::PREPARING_RESPONSE ||
+               conn.state == ConnState::SENDING_HEADERS ||
+               conn.state == ConnState::SENDING_BODY) {
+        want = ConnTimer::SEND;
+    }
+    // A request answered between two calls leaves IDLE or HEADER as it
+    // was, but the client has been active: the wait starts over.
+    bool renewed = conn.requests != conn.timer_requests &&
+                   (want == ConnTimer::IDLE || want == ConnTimer::HEADER);
+    if (want == conn.timer && !renewed) return;
+
+    conn.timer = want;
+    conn.timer_requests = conn.requests;
+    conn.rate_mark = conn.bytes_sent;
+    if (want == ConnTimer::IDLE) conn.idle_since = now_ms;
+    int timeout = phase_timeout(want, cfg);
+    if (timeout > 0)
+        timers.schedule(conn.fd, now_ms + timeout);
+    else
+        timers.cancel(conn.fd);
+}
+
+bool timer_expired(Connection& conn,
+                   const ServerConfig& cfg,
+                   TimerWheel& timers,
+                   int64_t now_ms)
+{
+    if (conn.timer != ConnTimer::SEND) return true;
+
+    uint64_t need = (uint64_t)cfg.min_send_rate * cfg.send_timeout_ms / 1000;
+    if (need == 0) need = 1;
+    if (conn.bytes_sent - conn.rate_mark < need) return true;
+
+    conn.rate_mark = conn.bytes_sent;
+    timers.schedule(conn.fd, now_ms + cfg.send_timeout_ms);
+    return false;
+}
@@ -1,8 +1,17 @@
 #ifndef CONNECTION_HPP
 #define CONNECTION_HPP
 
+#include "request_parser.hpp"
+
 #include <string>
+#include <memory>
+#include <vector>
 #include <cstdint>
+#include <sys/uio.h>
+
+struct CachedFile;
+struct H2Session;
+class TimerWheel;
 
 enum class ConnState {
     READING_REQUEST,
@@ -12,6 +21,34 @@ enum class ConnState {
     CLOSING
 };
 
+// which deadline the connection's timer currently enforces
+enum class ConnTimer {
+    NONE,
+    HEADER,   // request head must be complete by the deadline
+    IDLE,     // keep-alive wait for the next request
+    SEND      // minimum send rate over each send window
+};
+
+// One part of a multipart/byteranges body sent from a file: the delimiter
+// block, then bytes [start, end) of the file. The closing delimiter is a
+// part with an empty range.
+struct RangePart {
+    std::string head;
+    off_t start = 0;
+    off_t end   = 0;
+};
+
+// In-memory body of a pipelined response batched ahead of the current
+// one. It goes out right after out_buf[0, at), where its header block ends.
+struct BatchedBody {
+    size_t      at = 0;
+    const char* mem = nullptr;
+    size_t      len = 0;
+};
+
+// iovec entries handed to one sendmsg()
+const int MAX_OUTPUT_IOV = 64;
+
 struct Connection {
     int fd = -1;
     ConnState state = ConnState::READING_REQUEST;
@@ -20,25 +57,108 @@ struct Connection {
     std::string out_buf;
     size_t      out_sent = 0;
 
+    const char* body_mem = nullptr;
+    std::shared_ptr<CachedFile> file;
     int file_fd = -1;
     off_t file_offset = 0;
     off_t file_size   = 0;
+    std::vector<RangePart> parts;   // remaining multipart ranges
+    size_t next_part = 0;
+    off_t prefetched = 0;            // read-ahead requested up to here
+    std::vector<BatchedBody> batched;
+    size_t batch_next = 0;   // first batched body not fully sent
+    size_t batch_sent = 0;   // bytes of it already sent
+    bool   corked = false;
 
     bool keep_alive = false;
     bool head_only  = false;
+    unsigned requests = 0;
+
+    ConnTimer timer = ConnTimer::NONE;
+    uint64_t  bytes_sent = 0;
+    uint64_t  rate_mark  = 0;   // bytes_sent when the send window opened
+    int64_t   idle_since = 0;   // ms, when it last went idle between requests
+    unsigned  timer_requests = 0;   // requests when the timer was armed
 
     int status_code = 0;
-    std::string method;
-    std::string path;
+    int64_t  req_start_us = 0;
+    uint64_t resp_bytes = 0;
+    RequestParser parser;
+    HttpRequest   req;
+
+    uint32_t interest    = 0;
+    bool     would_block = false;
+    bool     queued      = false;
+
+    uint64_t io_ticket   = 0;       // RESOLVE job the request is parked on
+    bool     io_resolved = false;   // it came back; answer inline now
+
+    std::shared_ptr<H2Session> h2;   // set once it speaks HTTP/2 (h2.hpp)
 };
 
 struct ServerConfig;
 
+// parses in_buf once a full header block is present and prepares the response
+void process_input(Connection& conn,
+                   const ServerConfig& cfg,
+                   bool& want_close);
+
+// Continues a request parked in PREPARING_RESPONSE once the I/O pool has
+// resolved its files.
+void resume_request(Connection& conn,
+                    const ServerConfig& cfg,
+                    bool& want_close);
+
 void handle_read(Connection& conn,
                  const ServerConfig& cfg,
                  bool& want_close);
 
+void release_file(Connection& conn);
+
+// I/O buffers of a new connection come from the thread's BufferPool and go
+// back there when it closes
+void take_buffers(Connection& conn);
+void return_buffers(Connection& conn);
+
+// The queued output from out_sent on as an iovec chain: header blocks in
+// out_buf interleaved with batched bodies, then the current in-memory body.
+// Fills at most max entries and returns how many were filled.
+int output_iov(const Connection& conn, iovec* iov, int max);
+// records n bytes of that chain as written
+void output_advance(Connection& conn, size_t n);
+bool output_pending(const Connection& conn);
+
+// loads the next multipart range into out_buf/file_offset/file_size;
+// false when the body is complete
+bool next_range_part(Connection& conn);
+
+// drops per-response state and returns to READING_REQUEST or CLOSING
+void finish_response(Connection& conn, bool& want_close);
+
+// Sends until the socket blocks or the response is complete, except that a
+// file body moves one chunk per call, or with a nonzero allowance as many
+// chunks as fit in that many bytes (header blocks included).
 void handle_write(Connection& conn,
-                  bool& want_close);
+                  const ServerConfig& cfg,
+                  bool& want_close,
+                  size_t allowance = 0);
+
+// the connection is sending a response with a file body, or HTTP/2 DATA
+bool streaming_body(const Connection& conn);
+
+// Arms the deadline of the connection's current phase when the phase
+// changes. Progress within a phase does not push the deadline back, so a
+// client trickling its headers still runs out of time.
+void update_timer(Connection& conn,
+                  const ServerConfig& cfg,
+                  TimerWheel& timers,
+                  int64_t now_ms);
+
+// Called when the connection's timer fired; returns true if it has to be
+// closed. A send window that moved enough bytes opens the next one.
+bool timer_expired(Connection& conn,
+                   const ServerConfig& cfg,
+                   TimerWheel& timers,
+                   int64_t now_ms);
 
 #endif
@@ -0,0 +1,273 @@
+#include "content_cache.hpp"
+#include "http.hpp"
+#include "clock.hpp"
+#include "logger.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+struct Candidate {
+    std::string url_path;
+    std::string fs_path;
+    struct stat st;
+};
+
+void collect_files(const std::string& doc_root, const std::string& rel,
+                   size_t max_file, std::vector<Candidate>& out) {
+    std::string dir_path = doc_root + rel;
+    DIR* dir = opendir(dir_path.c_str());
+    if (!dir) return;
+
+    while (dirent* de = readdir(dir)) {
+        if (!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+            continue;
+
+        std::string child_rel = rel + "/" + de->d_name;
+        std::string child_fs = doc_root + child_rel;
+        struct stat st{};
+        if (stat(child_fs.c_str(), &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            collect_files(doc_root, child_rel, max_file, out);
+        } else if (S_ISREG(st.st_mode) && (size_t)st.st_size <= max_file) {
+            out.push_back(Candidate{child_rel, child_fs, st});
+        }
+    }
+    closedir(dir);
+}
+
+bool read_full(const std::string& path, char* dst, size_t len) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = ::read(fd, dst + done, len - done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += r;
+    }
+    ::close(fd);
+    return done == len;
+}
+
+char* arena_put(char*& cursor, const std::string& s) {
+    char* p = cursor;
+    std::memcpy(cursor, s.data(), s.size());
+    cursor += s.size();
+    *cursor++ = '\0';
+    return p;
+}
+
+}
+
+ContentCache::~ContentCache() {
+    if (arena_ && owns_arena_) munmap(arena_, arena_len_);
+}
+
+void ContentCache::share_from(const ContentCache& primary) {
+    if (arena_ && owns_arena_) munmap(arena_, arena_len_);
+    arena_ = primary.arena_;
+    arena_len_ = primary.arena_len_;
+    owns_arena_ = false;
+    ttl_ms_ = primary.ttl_ms_;
+    slots_ = primary.slots_;
+    index_ = primary.index_;
+    stats_ = ContentCacheStats();
+}
+
+void ContentCache::build(const ServerConfig& cfg) {
+    // a rebuild leaves running workers on their own mapping of the old arena
+    if (arena_ && owns_arena_) munmap(arena_, arena_len_);
+    arena_ = nullptr;
+    owns_arena_ = true;
+    arena_len_ = 0;
+    slots_.clear();
+    index_.clear();
+    stats_ = ContentCacheStats();
+    if (cfg.mem_cache_budget == 0) return;
+
+    std::vector<Candidate> files;
+    collect_files(cfg.doc_root, "", cfg.mem_cache_max_file, files);
+
+    // smallest first: the budget goes to the files that benefit most
+    std::sort(files.begin(), files.end(),
+              [](const Candidate& a, const Candidate& b) {
+                  return a.st.st_size < b.st.st_size;
+              });
+
+    struct Rendered {
+        const Candidate* file;
+        std::string mime;
+        std::string headers[2];
+        std::string encoded_headers[2];
+    };
+    std::vector<Rendered> chosen;
+    size_t total = 0;
+
+    for (const Candidate& f : files) {
+        Rendered r;
+        r.file = &f;
+        r.mime = get_mime_type(f.fs_path);
+        FileMeta meta;
+        meta.ino = f.st.st_ino;
+        meta.size = f.st.st_size;
+        meta.mtime = f.st.st_mtim;
+        std::string entity = entity_headers(f.url_path, meta, cfg);
+        for (int ka = 0; ka < 2; ++ka)
+            r.headers[ka] = build_headers(200, (size_t)f.st.st_size, r.mime,
+                                          ka != 0, entity);
+
+        size_t suffix_len = 0;
+        if (const char* coding = precompressed_coding(f.url_path, suffix_len)) {
+            std::string base = f.url_path.substr(0, f.url_path.size() -
+                                                    suffix_len);
+            if (compressible(base)) {
+                std::string encoded = entity_headers(base, meta, cfg, coding);
+                for (int ka = 0; ka < 2; ++ka)
+                    r.encoded_headers[ka] =
+                        build_headers(200, (size_t)f.st.st_size,
+                                      get_mime_type(base), ka != 0, encoded);
+            }
+        }
+
+        size_t need = (size_t)f.st.st_size + r.mime.size() + 1;
+        for (int ka = 0; ka < 2; ++ka) {
+            need += r.headers[ka].size() + 1;
+            if (!r.encoded_headers[ka].empty())
+                need += r.encoded_headers[ka].size() + 1;
+        }
+        if (total + need > cfg.mem_cache_budget) break;
+        total += need;
+        chosen.push_back(std::move(r));
+    }
+
+    if (chosen.empty()) return;
+
+    void* mem = mmap(nullptr, total, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        log_error("content cache mmap error: " +
+                  std::string(std::strerror(errno)));
+        return;
+    }
+    arena_ = static_cast<char*>(mem);
+    arena_len_ = total;
+
+    int64_t now = monotonic_ms();
+    char* cursor = arena_;
+    slots_.reserve(chosen.size());
+    index_.reserve(chosen.size());
+
+    for (const Rendered& r : chosen) {
+        const Candidate& f = *r.file;
+        Slot slot;
+        slot.entry.body = cursor;
+        slot.entry.size = (size_t)f.st.st_size;
+        if (!read_full(f.fs_path, cursor, slot.entry.size)) continue;
+        cursor += slot.entry.size;
+
+        slot.entry.mime = arena_put(cursor, r.mime);
+        for (int ka = 0; ka < 2; ++ka) {
+            slot.entry.headers[ka] = arena_put(cursor, r.headers[ka]);
+            slot.entry.headers_len[ka] = r.headers[ka].size();
+            if (r.encoded_headers[ka].empty()) continue;
+            slot.entry.encoded_headers[ka] = arena_put(cursor,
+                                                       r.encoded_headers[ka]);
+            slot.entry.encoded_headers_len[ka] = r.encoded_headers[ka].size();
+        }
+        slot.entry.ino = f.st.st_ino;
+        slot.entry.mtime = f.st.st_mtim;
+        slot.validated_ms = now;
+
+        index_.emplace(f.url_path, slots_.size());
+        slots_.push_back(slot);
+    }
+
+    mprotect(arena_, arena_len_, PROT_READ);
+
+    log_info("Content cache: " + std::to_string(slots_.size()) + " files, " +
+             std::to_string(arena_len_) + " bytes shared");
+}
+
+void ContentCache::invalidate(const std::string& url_path, bool subtree) {
+    auto it = index_.find(url_path);
+    if (it != index_.end() && !slots_[it->second].stale) {
+        slots_[it->second].stale = true;
+        ++stats_.stale;
+    }
+    if (!subtree) return;
+    for (const auto& e : index_) {
+        const std::string& key = e.first;
+        if (key.size() > url_path.size() && key[url_path.size()] == '/' &&
+            key.compare(0, url_path.size(), url_path) == 0 &&
+            !slots_[e.second].stale) {
+            slots_[e.second].stale = true;
+            ++stats_.stale;
+        }
+    }
+}
+
+void ContentCache::invalidate_all() {
+    for (Slot& slot : slots_) {
+        if (slot.stale) continue;
+        slot.stale = true;
+        ++stats_.stale;
+    }
+}
+
+bool ContentCache::holds(const std::string& url_path) const {
+    auto it = index_.find(url_path);
+    return it != index_.end() && !slots_[it->second].stale;
+}
+
+const MemEntry* ContentCache::get(const std::string& url_path,
+                                  const std::string& doc_root) {
+    if (index_.empty()) return nullptr;
+
+    auto it = index_.find(url_path);
+    if (it == index_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+
+    Slot& slot = slots_[it->second];
+    if (slot.stale) {
+        ++stats_.misses;
+        return nullptr;
+    }
+
+    // a watched doc_root reports changes instead
+    int64_t now = watched_ ? 0 : monotonic_ms();
+    if (!watched_ && now - slot.validated_ms >= ttl_ms_) {
+        fs_path_.assign(doc_root).append(url_path);
+        struct stat st{};
+        if (stat(fs_path_.c_str(), &st) != 0 ||
+            st.st_ino != slot.entry.ino ||
+            (size_t)st.st_size != slot.entry.size ||
+            st.st_mtim.tv_sec != slot.entry.mtime.tv_sec ||
+            st.st_mtim.tv_nsec != slot.entry.mtime.tv_nsec) {
+            // the shared copy is immutable; this worker falls back to disk
+            slot.stale = true;
+            ++stats_.stale;
+            ++stats_.misses;
+            return nullptr;
+        }
+        slot.validated_ms = now;
+    }
+
+    ++stats_.hits;
+    return &slot.entry;
+}
+
+ContentCache& content_cache() {
+    static thread_local ContentCache cache;
+    return cache;
+}
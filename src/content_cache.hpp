@@ -0,0 +1,96 @@
+#ifndef CONTENT_CACHE_HPP
+#define CONTENT_CACHE_HPP
+
+#include "config.hpp"
+
+#include <sys/types.h>
+#include <ctime>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// A small file held in memory together with its pre-rendered headers.
+// All pointers refer to the read-only shared arena.
+struct MemEntry {
+    const char* body = nullptr;
+    size_t      size = 0;
+    const char* headers[2] = {nullptr, nullptr};   // indexed by keep_alive
+    size_t      headers_len[2] = {0, 0};
+    // for "x.css.br" and the like: headers when served for "x.css" with
+    // Content-Encoding, nullptr for other files
+    const char* encoded_headers[2] = {nullptr, nullptr};
+    size_t      encoded_headers_len[2] = {0, 0};
+    const char* mime = nullptr;
+    ino_t       ino = 0;
+    timespec    mtime{};
+    // site pack entries only: the body also lies at offset in fd
+    int         fd = -1;
+    off_t       offset = 0;
+};
+
+struct ContentCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stale = 0;
+};
+
+// Small-file tier in front of FileCache. It is built once by the master
+// before fork into a MAP_SHARED arena that is then made read-only, so all
+// prefork workers serve from the same physical pages. Per-worker state is
+// limited to revalidation timestamps and counters. While doc_root is
+// watched (doc_watch.hpp) entries are not revalidated; a change to one
+// turns it stale, and this worker serves that path from disk from then on.
+class ContentCache {
+public:
+    ~ContentCache();
+
+    // walks doc_root and loads files up to max_file bytes within budget;
+    // replaces whatever an earlier build() loaded
+    void build(const ServerConfig& cfg);
+
+    // nullptr if the path is not cached or the cached copy went stale
+    const MemEntry* get(const std::string& url_path,
+                        const std::string& doc_root);
+
+    // the path is cached and not known to be stale
+    bool holds(const std::string& url_path) const;
+
+    // for another event-loop thread of the same worker: the index and the
+    // revalidation state are copied, the arena is borrowed from `primary`,
+    // which has to outlive this cache
+    void share_from(const ContentCache& primary);
+
+    void set_ttl(int ttl_ms) { ttl_ms_ = ttl_ms; }
+    void set_watched(bool watched) { watched_ = watched; }
+
+    // marks url_path stale, and with subtree everything below it
+    void invalidate(const std::string& url_path, bool subtree);
+    void invalidate_all();
+
+    const ContentCacheStats& stats() const { return stats_; }
+    size_t entries() const { return index_.size(); }
+    size_t bytes() const { return arena_len_; }
+
+private:
+    struct Slot {
+        MemEntry entry;
+        int64_t  validated_ms = 0;
+        bool     stale = false;
+    };
+
+    char*  arena_ = nullptr;
+    size_t arena_len_ = 0;
+    bool   owns_arena_ = true;
+    int    ttl_ms_ = 0;
+    bool   watched_ = false;
+    std::vector<Slot> slots_;
+    std::unordered_map<std::string, size_t> index_;
+    std::string fs_path_;   // revalidation scratch
+    ContentCacheStats stats_;
+};
+
+// per thread; the master's instance is the one built before fork
+ContentCache& content_cache();
+
+#endif
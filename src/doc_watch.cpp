@@ -0,0 +1,275 @@
+#include "doc_watch.hpp"
+#include "file_cache.hpp"
+#include "content_cache.hpp"
+#include "logger.hpp"
+
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+namespace {
+
+const size_t RING_SLOTS = 2048;
+const size_t SLOT_PATH = 240;
+
+const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+                            IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                            IN_ONLYDIR;
+
+// One published change, guarded like a seqlock: seq is zeroed before the
+// master rewrites the slot and set to generation + 1 after, so a reader
+// that finds anything else was lapped and flushes instead.
+struct alignas(64) ChangeSlot {
+    std::atomic<uint64_t> seq{0};
+    uint32_t len = 0;           // 0: anything may have changed
+    bool     subtree = false;   // everything below path as well
+    char     path[SLOT_PATH];
+};
+
+struct ChangeRing {
+    std::atomic<uint64_t> head{0};   // changes published so far
+    std::atomic<int>      live{0};   // 1 while every change gets published
+    ChangeSlot slots[RING_SLOTS];
+};
+
+ChangeRing* g_ring = nullptr;
+uint64_t    g_snapshot = 0;   // set by the master, inherited at fork
+
+thread_local bool        t_started = false;
+thread_local uint64_t    t_applied = 0;
+thread_local std::string t_path;
+
+bool map_ring() {
+    if (g_ring) return true;
+    void* mem = mmap(nullptr, sizeof(ChangeRing), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return false;
+    g_ring = new (mem) ChangeRing();
+    return true;
+}
+
+// master only
+void publish(const std::string& path, bool subtree) {
+    size_t len = path.size() < SLOT_PATH ? path.size() : 0;
+    uint64_t g = g_ring->head.load(std::memory_order_relaxed);
+    ChangeSlot& s = g_ring->slots[g % RING_SLOTS];
+    s.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.len = (uint32_t)len;
+    s.subtree = subtree;
+    std::memcpy(s.path, path.data(), len);
+    s.seq.store(g + 1, std::memory_order_release);
+    g_ring->head.store(g + 1, std::memory_order_release);
+}
+
+void publish_all() {
+    publish(std::string(), true);
+}
+
+void flush_caches() {
+    file_cache().clear();
+    content_cache().invalidate_all();
+}
+
+}
+
+DocWatcher::~DocWatcher() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool DocWatcher::start(const std::string& doc_root) {
+    stop();
+    if (!map_ring()) {
+        log_error("Change ring unavailable: " +
+                  std::string(std::strerror(errno)));
+        return false;
+    }
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+        log_error("inotify unavailable, caches revalidate by TTL: " +
+                  std::string(std::strerror(errno)));
+        return false;
+    }
+    doc_root_ = doc_root;
+    failed_ = false;
+    std::vector<DirId> ancestors;
+    watch_tree("", ancestors);
+    if (failed_ || dirs_.empty()) {
+        stop();
+        return false;
+    }
+    // whatever changed while nothing was watching
+    publish_all();
+    g_ring->live.store(1, std::memory_order_release);
+    log_info("Watching " + doc_root + ": " + std::to_string(dirs_.size()) +
+             " directories");
+    return true;
+}
+
+void DocWatcher::stop() {
+    if (g_ring) g_ring->live.store(0, std::memory_order_release);
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    dirs_.clear();
+}
+
+void DocWatcher::close_in_child() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    dirs_.clear();
+}
+
+void DocWatcher::snapshot() {
+    g_snapshot = g_ring ? g_ring->head.load(std::memory_order_acquire) : 0;
+}
+
+void DocWatcher::watch_tree(const std::string& rel,
+                            std::vector<DirId>& ancestors) {
+    std::string fs_path = doc_root_ + rel;
+    struct stat st{};
+    if (stat(fs_path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return;
+    // a symlink back up the tree
+    for (const DirId& a : ancestors)
+        if (a.dev == st.st_dev && a.ino == st.st_ino) return;
+
+    int wd = inotify_add_watch(fd_, fs_path.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        log_error("inotify watch on " + fs_path + ": " +
+                  std::strerror(errno) + ", caches revalidate by TTL");
+        failed_ = true;
+        return;
+    }
+    dirs_[wd] = rel;
+
+    DIR* dir = opendir(fs_path.c_str());
+    if (!dir) return;
+    ancestors.push_back(DirId{st.st_dev, st.st_ino});
+    while (dirent* de = readdir(dir)) {
+        if (failed_) break;
+        if (!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+            continue;
+        if (de->d_type == DT_DIR || de->d_type == DT_LNK ||
+            de->d_type == DT_UNKNOWN)
+            watch_tree(rel + "/" + de->d_name, ancestors);
+    }
+    ancestors.pop_back();
+    closedir(dir);
+}
+
+void DocWatcher::drain() {
+    alignas(struct inotify_event) char buf[64 * 1024];
+    while (fd_ >= 0) {
+        ssize_t n = ::read(fd_, buf, sizeof(buf));
+        if (n <= 0) break;
+        // every event of one read happened before any worker acts on it
+        last_.clear();
+        for (char* p = buf; p < buf + n;) {
+            const inotify_event& ev = *reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + ev.len;
+            handle(ev);
+        }
+    }
+    if (failed_) stop();
+}
+
+void DocWatcher::handle(const inotify_event& ev) {
+    if (ev.mask & IN_Q_OVERFLOW) {
+        publish_all();
+        last_.clear();
+        return;
+    }
+    auto it = dirs_.find(ev.wd);
+    if (it == dirs_.end()) return;
+    if (ev.mask & IN_IGNORED) {
+        dirs_.erase(it);
+        return;
+    }
+    if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        // a subdirectory is reported by its parent too
+        if (!it->second.empty()) return;
+        log_error("Watched " + doc_root_ + " went away, caches revalidate "
+                  "by TTL");
+        publish_all();
+        failed_ = true;
+        return;
+    }
+
+    std::string path = it->second;
+    if (ev.len > 0) {
+        path += '/';
+        path += ev.name;
+    }
+    bool dir = (ev.mask & IN_ISDIR) != 0;
+    if (dir && (ev.mask & (IN_CREATE | IN_MOVED_TO))) {
+        std::vector<DirId> ancestors;
+        watch_tree(path, ancestors);
+    }
+    // a file that is gone, or a symlink, may have stood for a directory
+    bool subtree = dir;
+    if (!subtree) {
+        struct stat st{};
+        std::string fs_path = doc_root_ + path;
+        subtree = lstat(fs_path.c_str(), &st) != 0 || S_ISLNK(st.st_mode);
+    }
+    // a write arrives as a run of IN_MODIFY for the same path
+    if (!subtree && path == last_) return;
+    last_ = subtree ? std::string() : path;
+    publish(path, subtree);
+}
+
+DocWatcher& doc_watcher() {
+    static DocWatcher watcher;
+    return watcher;
+}
+
+void apply_doc_changes() {
+    ChangeRing* ring = g_ring;
+    if (!ring) return;
+    if (!t_started) {
+        t_started = true;
+        t_applied = g_snapshot;
+    }
+    // read first: live is only raised after the flush that goes with it
+    bool live = ring->live.load(std::memory_order_acquire) != 0;
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+
+    if (head - t_applied > RING_SLOTS) {
+        flush_caches();
+    } else {
+        for (uint64_t g = t_applied; g < head; ++g) {
+            const ChangeSlot& s = ring->slots[g % RING_SLOTS];
+            if (s.seq.load(std::memory_order_acquire) != g + 1) {
+                flush_caches();
+                break;
+            }
+            uint32_t len = s.len < SLOT_PATH ? s.len : 0;
+            bool subtree = s.subtree;
+            t_path.assign(s.path, len);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bool torn = s.seq.load(std::memory_order_relaxed) != g + 1;
+            if (torn || len == 0) flush_caches();
+            if (torn) break;
+            if (len == 0) continue;
+            file_cache().invalidate(t_path, subtree);
+            content_cache().invalidate(t_path, subtree);
+        }
+    }
+    t_applied = head;
+    file_cache().set_watched(live);
+    content_cache().set_watched(live);
+}
+
+uint64_t doc_generation() {
+    return g_ring ? g_ring->head.load(std::memory_order_acquire) : 0;
+}
+
+uint64_t applied_doc_generation() {
+    return t_started ? t_applied : g_snapshot;
+}
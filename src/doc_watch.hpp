@@ -0,0 +1,75 @@
+#ifndef DOC_WATCH_HPP
+#define DOC_WATCH_HPP
+
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct inotify_event;
+
+// Change notification for doc_root. The master watches the tree with
+// inotify and publishes the URL path of every file or directory that
+// changed into a ring in a MAP_SHARED segment mapped before fork; it is
+// the only writer. Each event-loop thread applies what is new to its own
+// caches once per iteration, which costs one load when nothing changed.
+// While the watch is live the caches trust their entries without the
+// per-TTL stat(); when it is not (no inotify, watch limit reached, doc_root
+// gone) they revalidate by TTL as before.
+//
+// Directories are followed through symlinks; one reachable by several
+// paths is watched under the last of them. A symlinked file is only seen to
+// change when its target lies in a watched directory.
+class DocWatcher {
+public:
+    ~DocWatcher();
+
+    // master: (re)starts watching doc_root; false leaves the caches on TTLs
+    bool start(const std::string& doc_root);
+    void stop();
+    bool running() const { return fd_ >= 0; }
+    int  fd() const { return fd_; }
+    const std::string& root() const { return doc_root_; }
+
+    // master: reads what inotify has queued and publishes it
+    void drain();
+
+    // master, right before the caches workers start from are built: the
+    // generation they are consistent with
+    void snapshot();
+
+    // worker, after fork: drops the master's inotify descriptor
+    void close_in_child();
+
+private:
+    struct DirId {
+        dev_t dev;
+        ino_t ino;
+    };
+
+    void watch_tree(const std::string& rel, std::vector<DirId>& ancestors);
+    void handle(const struct inotify_event& ev);
+
+    int         fd_ = -1;
+    std::string doc_root_;
+    std::unordered_map<int, std::string> dirs_;   // wd -> URL path
+    std::string last_;   // last file published from one read()
+    bool        failed_ = false;
+};
+
+// one per process, used by the master
+DocWatcher& doc_watcher();
+
+// Event-loop thread: applies the changes published since its last call to
+// file_cache() and content_cache().
+void apply_doc_changes();
+
+// Generation of the ring: how many changes the master has published, and
+// how many this thread has applied. A file opened on another thread while
+// the ring was at g may be cached here only if applied <= g; otherwise a
+// change it predates could already have been applied and would be lost.
+uint64_t doc_generation();
+uint64_t applied_doc_generation();
+
+#endif
@@ -0,0 +1,206 @@
+#include "event_engine.hpp"
+#include "logger.hpp"
+
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+struct WaitMask {
+    sigset_t set;
+    WaitMask() { sigemptyset(&set); }
+};
+
+thread_local WaitMask tl_wait_mask;
+
+}
+
+void set_wait_sigmask(const sigset_t& mask) {
+    tl_wait_mask.set = mask;
+}
+
+const sigset_t& wait_sigmask() {
+    return tl_wait_mask.set;
+}
+
+// Level-triggered fallback: every wait() rebuilds the fd_sets from the
+// interest table, so the cost is O(max fd) per iteration.
+class PselectBackend : public EventBackend {
+public:
+    PselectBackend() : interest_(FD_SETSIZE, EV_NONE) {}
+
+    const char* name() const override { return "pselect"; }
+
+    bool add(int fd, uint32_t interest) override {
+        if (fd < 0 || fd >= FD_SETSIZE) {
+            log_error("Socket fd (" + std::to_string(fd) +
+                      ") >= FD_SETSIZE, closing connection");
+            return false;
+        }
+        interest_[fd] = interest;
+        if (fd > maxfd_) maxfd_ = fd;
+        return true;
+    }
+
+    bool modify(int fd, uint32_t interest) override {
+        if (fd < 0 || fd >= FD_SETSIZE) return false;
+        interest_[fd] = interest;
+        return true;
+    }
+
+    void remove(int fd) override {
+        if (fd < 0 || fd >= FD_SETSIZE) return;
+        interest_[fd] = EV_NONE;
+        while (maxfd_ >= 0 && interest_[maxfd_] == EV_NONE)
+            --maxfd_;
+    }
+
+    int wait(std::vector<IoEvent>& out, int timeout_ms) override {
+        out.clear();
+
+        fd_set readfds, writefds;
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+
+        for (int fd = 0; fd <= maxfd_; ++fd) {
+            if (interest_[fd] & EV_READ)  FD_SET(fd, &readfds);
+            if (interest_[fd] & EV_WRITE) FD_SET(fd, &writefds);
+        }
+
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+        int ready = pselect(maxfd_ + 1,
+                            &readfds, &writefds, nullptr,
+                            timeout_ms < 0 ? nullptr : &timeout,
+                            &wait_sigmask());
+        if (ready <= 0) return ready;
+
+        for (int fd = 0; fd <= maxfd_ && (int)out.size() < ready; ++fd) {
+            uint32_t ev = EV_NONE;
+            if (FD_ISSET(fd, &readfds))  ev |= EV_READ;
+            if (FD_ISSET(fd, &writefds)) ev |= EV_WRITE;
+            if (ev != EV_NONE) out.push_back(IoEvent{fd, ev});
+        }
+        return (int)out.size();
+    }
+
+private:
+    std::vector<uint32_t> interest_;
+    int maxfd_ = -1;
+};
+
+// Edge-triggered epoll: interest is only touched on state transitions and
+// wait() costs O(ready fds). Callers must drain fds until EAGAIN.
+class EpollBackend : public EventBackend {
+public:
+    static const int MAX_EVENTS = 1024;
+
+    EpollBackend() : events_(MAX_EVENTS) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0)
+            log_error("epoll_create1 error: " + std::string(std::strerror(errno)));
+    }
+
+    ~EpollBackend() override {
+        if (epfd_ >= 0) ::close(epfd_);
+    }
+
+    bool ok() const { return epfd_ >= 0; }
+
+    const char* name() const override { return "epoll"; }
+
+    bool add(int fd, uint32_t interest) override {
+        return ctl(EPOLL_CTL_ADD, fd, interest);
+    }
+
+    bool modify(int fd, uint32_t interest) override {
+        return ctl(EPOLL_CTL_MOD, fd, interest);
+    }
+
+    void remove(int fd) override {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    int wait(std::vector<IoEvent>& out, int timeout_ms) override {
+        out.clear();
+
+        int n = epoll_pwait(epfd_, events_.data(), MAX_EVENTS,
+                            timeout_ms, &wait_sigmask());
+        if (n <= 0) return n;
+
+        for (int i = 0; i < n; ++i) {
+            uint32_t e = events_[i].events;
+            uint32_t ev = EV_NONE;
+            if (e & EPOLLIN)  ev |= EV_READ;
+            if (e & EPOLLOUT) ev |= EV_WRITE;
+            if (e & (EPOLLERR | EPOLLHUP)) ev |= EV_ERROR;
+            out.push_back(IoEvent{events_[i].data.fd, ev});
+        }
+        return n;
+    }
+
+private:
+    bool ctl(int op, int fd, uint32_t interest) {
+        epoll_event ev{};
+        ev.events = EPOLLET;
+        if (interest & EV_READ)  ev.events |= EPOLLIN;
+        if (interest & EV_WRITE) ev.events |= EPOLLOUT;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd_, op, fd, &ev) < 0) {
+            log_error("epoll_ctl error: " + std::string(std::strerror(errno)));
+            return false;
+        }
+        return true;
+    }
+
+    int epfd_ = -1;
+    std::vector<epoll_event> events_;
+};
+
+std::unique_ptr<EventBackend> make_event_backend(EventEngine engine) {
+    switch (engine) {
+        // io_uring has its own completion loop; as a readiness backend it
+        // degrades to epoll
+        case EventEngine::URING:
+        case EventEngine::EPOLL: {
+            std::unique_ptr<EpollBackend> ep(new EpollBackend());
+            if (ep->ok()) return ep;
+            log_error("epoll unavailable, falling back to pselect");
+            return std::unique_ptr<EventBackend>(new PselectBackend());
+        }
+        case EventEngine::PSELECT:
+        default:
+            return std::unique_ptr<EventBackend>(new PselectBackend());
+    }
+}
+
+const char* engine_name(EventEngine engine) {
+    switch (engine) {
+        case EventEngine::EPOLL:   return "epoll";
+        case EventEngine::URING:   return "uring";
+        case EventEngine::PSELECT: return "pselect";
+        default:                   return "unknown";
+    }
+}
+
+bool parse_engine(const char* s, EventEngine& engine) {
+    if (!std::strcmp(s, "epoll")) {
+        engine = EventEngine::EPOLL;
+        return true;
+    }
+    if (!std::strcmp(s, "uring")) {
+        engine = EventEngine::URING;
+        return true;
+    }
+    if (!std::strcmp(s, "pselect")) {
+        engine = EventEngine::PSELECT;
+        return true;
+    }
+    return false;
+}
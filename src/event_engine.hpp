@@ -0,0 +1,51 @@
+#ifndef EVENT_ENGINE_HPP
+#define EVENT_ENGINE_HPP
+
+#include "config.hpp"
+
+#include <signal.h>
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+enum EventMask : uint32_t {
+    EV_NONE  = 0,
+    EV_READ  = 1u << 0,
+    EV_WRITE = 1u << 1,
+    EV_ERROR = 1u << 2
+};
+
+struct IoEvent {
+    int      fd;
+    uint32_t events;
+};
+
+class EventBackend {
+public:
+    virtual ~EventBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    // false if the fd cannot be watched (e.g. fd >= FD_SETSIZE for pselect)
+    virtual bool add(int fd, uint32_t interest) = 0;
+    virtual bool modify(int fd, uint32_t interest) = 0;
+    virtual void remove(int fd) = 0;
+
+    // -1 on error (errno set), otherwise number of events written to out
+    virtual int wait(std::vector<IoEvent>& out, int timeout_ms) = 0;
+};
+
+std::unique_ptr<EventBackend> make_event_backend(EventEngine engine);
+
+// Signals let through while the calling thread waits for events (pselect,
+// epoll_pwait, io_uring); none are blocked by default. A loop thread of a
+// multi-threaded worker keeps everything but its wake-up signal blocked so
+// that control signals go to the worker's main thread.
+void set_wait_sigmask(const sigset_t& mask);
+const sigset_t& wait_sigmask();
+
+const char* engine_name(EventEngine engine);
+bool parse_engine(const char* s, EventEngine& engine);
+
+#endif
@@ -0,0 +1,194 @@
+#include "file_cache.hpp"
+#include "http.hpp"
+#include "clock.hpp"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool same_file(const CachedFile& f, const struct stat& st) {
+    return f.ino == st.st_ino &&
+           f.size == st.st_size &&
+           f.mtime.tv_sec == st.st_mtim.tv_sec &&
+           f.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+CachedFile::~CachedFile() {
+    if (fd >= 0) ::close(fd);
+}
+
+void FileCache::configure(size_t capacity, int ttl_ms) {
+    capacity_ = capacity;
+    ttl_ms_ = ttl_ms;
+    lru_.clear();
+    map_.clear();
+    map_.reserve(capacity);
+}
+
+std::shared_ptr<CachedFile> open_file(const std::string& fs_path,
+                                      int& status) {
+    struct stat st{};
+    if (stat(fs_path.c_str(), &st) != 0) {
+        status = 404;
+        return nullptr;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        status = 403;
+        return nullptr;
+    }
+
+    int fd = ::open(fs_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        status = 404;
+        return nullptr;
+    }
+
+    auto f = std::make_shared<CachedFile>();
+    f->fd = fd;
+    f->size = st.st_size;
+    f->ino = st.st_ino;
+    f->mtime = st.st_mtim;
+    f->mime = get_mime_type(fs_path);
+    status = 200;
+    return f;
+}
+
+void FileCache::insert(const std::string& key,
+                       const std::shared_ptr<CachedFile>& f,
+                       int64_t now) {
+    if (capacity_ == 0) return;
+
+    while (map_.size() >= capacity_ && !lru_.empty()) {
+        map_.erase(lru_.back().key);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+
+    lru_.push_front(Entry{key, f, now});
+    map_[key] = lru_.begin();
+}
+
+std::shared_ptr<CachedFile> FileCache::get(const std::string& url_path,
+                                           const std::string& doc_root,
+                                           int& status) {
+    int64_t now = monotonic_ms();
+
+    auto it = map_.find(url_path);
+    if (it != map_.end()) {
+        auto e = it->second;
+        if (fresh(*e, now)) {
+            ++stats_.hits;
+            lru_.splice(lru_.begin(), lru_, e);
+            status = e->file ? 200 : 404;
+            return e->file;
+        }
+
+        ++stats_.revalidations;
+        fs_path_.assign(doc_root).append(url_path);
+        struct stat st{};
+        if (e->file && stat(fs_path_.c_str(), &st) == 0 &&
+            S_ISREG(st.st_mode) && same_file(*e->file, st)) {
+            ++stats_.hits;
+            e->validated_ms = now;
+            lru_.splice(lru_.begin(), lru_, e);
+            status = 200;
+            return e->file;
+        }
+
+        lru_.erase(e);
+        map_.erase(it);
+    }
+
+    ++stats_.misses;
+    fs_path_.assign(doc_root).append(url_path);
+    auto f = open_file(fs_path_, status);
+    if (f || status == 404) insert(url_path, f, now);
+    return f;
+}
+
+bool FileCache::cold(const std::string& url_path) const {
+    if (capacity_ == 0) return false;
+    auto it = map_.find(url_path);
+    return it == map_.end() || !fresh(*it->second, monotonic_ms());
+}
+
+void FileCache::put(const std::string& url_path,
+                    std::shared_ptr<CachedFile> f, int status) {
+    if (!f && status != 404) return;
+    int64_t now = monotonic_ms();
+
+    auto it = map_.find(url_path);
+    if (it != map_.end()) {
+        auto e = it->second;
+        if (f && e->file && e->file->ino == f->ino &&
+            e->file->size == f->size &&
+            e->file->mtime.tv_sec == f->mtime.tv_sec &&
+            e->file->mtime.tv_nsec == f->mtime.tv_nsec) {
+            ++stats_.revalidations;
+            e->validated_ms = now;
+            lru_.splice(lru_.begin(), lru_, e);
+            return;
+        }
+        lru_.erase(e);
+        map_.erase(it);
+    }
+    ++stats_.misses;
+    insert(url_path, f, now);
+}
+
+bool FileCache::lookup_meta(const std::string& url_path,
+                            const std::string& doc_root, FileMeta& meta) {
+    auto it = map_.find(url_path);
+    if (it != map_.end() && fresh(*it->second, monotonic_ms())) {
+        if (!it->second->file) return false;
+        const CachedFile& f = *it->second->file;
+        meta.ino = f.ino;
+        meta.size = f.size;
+        meta.mtime = f.mtime;
+        return true;
+    }
+
+    fs_path_.assign(doc_root).append(url_path);
+    struct stat st{};
+    if (stat(fs_path_.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    meta.ino = st.st_ino;
+    meta.size = st.st_size;
+    meta.mtime = st.st_mtim;
+    return true;
+}
+
+static bool below(const std::string& key, const std::string& dir) {
+    return key.size() > dir.size() && key[dir.size()] == '/' &&
+           key.compare(0, dir.size(), dir) == 0;
+}
+
+void FileCache::invalidate(const std::string& url_path, bool subtree) {
+    auto it = map_.find(url_path);
+    if (it != map_.end()) {
+        lru_.erase(it->second);
+        map_.erase(it);
+        ++stats_.invalidations;
+    }
+    if (!subtree) return;
+    for (auto e = lru_.begin(); e != lru_.end();) {
+        if (!below(e->key, url_path)) {
+            ++e;
+            continue;
+        }
+        map_.erase(e->key);
+        e = lru_.erase(e);
+        ++stats_.invalidations;
+    }
+}
+
+void FileCache::clear() {
+    stats_.invalidations += map_.size();
+    lru_.clear();
+    map_.clear();
+}
+
+// one per event-loop thread: entries own fds and LRU links
+FileCache& file_cache() {
+    static thread_local FileCache cache;
+    return cache;
+}
@@ -0,0 +1,112 @@
+#ifndef FILE_CACHE_HPP
+#define FILE_CACHE_HPP
+
+#include <sys/types.h>
+#include <ctime>
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <list>
+#include <unordered_map>
+
+// What conditional requests are evaluated against.
+struct FileMeta {
+    ino_t    ino = 0;
+    off_t    size = 0;
+    timespec mtime{};
+};
+
+// An open file shared by every connection that is streaming it. The fd is
+// only closed when the last user (cache entry or connection) lets go, so
+// bodies must be sent with explicit offsets (sendfile/pread).
+struct CachedFile {
+    int         fd = -1;
+    off_t       size = 0;
+    ino_t       ino = 0;
+    timespec    mtime{};
+    std::string mime;
+    // pre-rendered "200 OK" header block, indexed by keep_alive
+    std::string headers[2];
+    // the same when served as the precompressed variant of its base path
+    std::string encoded_headers[2];
+
+    CachedFile() = default;
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+    ~CachedFile();
+};
+
+// stat() and open() of fs_path; status is 200, or 403/404 with nullptr.
+// Safe to call from any thread.
+std::shared_ptr<CachedFile> open_file(const std::string& fs_path, int& status);
+
+struct FileCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t revalidations = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;
+};
+
+// Per-worker LRU of resolved files keyed by URL path. A hit younger than
+// the TTL costs no filesystem syscalls; older hits are revalidated with a
+// single stat() against inode, size and mtime. Paths that do not exist are
+// remembered for one TTL as well (precompressed siblings are probed on
+// every negotiated request). While doc_root is watched (doc_watch.hpp)
+// entries stay valid until a change to their path invalidates them.
+class FileCache {
+public:
+    void configure(size_t capacity, int ttl_ms);
+
+    // status is 200 on success, otherwise 403 or 404 and nullptr is returned
+    std::shared_ptr<CachedFile> get(const std::string& url_path,
+                                    const std::string& doc_root,
+                                    int& status);
+
+    // Validators of url_path without opening it: from an entry younger than
+    // the TTL, otherwise from one stat(). false unless it is a regular file.
+    bool lookup_meta(const std::string& url_path, const std::string& doc_root,
+                     FileMeta& meta);
+
+    // true when get() or lookup_meta() would have to ask the filesystem
+    // about url_path and could remember the answer
+    bool cold(const std::string& url_path) const;
+    // Stores what open_file() returned for url_path elsewhere. An entry for
+    // the same file keeps its pre-rendered headers and is just revalidated.
+    void put(const std::string& url_path, std::shared_ptr<CachedFile> f,
+             int status);
+
+    // no TTL revalidation while set
+    void set_watched(bool watched) { watched_ = watched; }
+    // drops url_path, and with subtree everything below it
+    void invalidate(const std::string& url_path, bool subtree);
+    void clear();
+
+    const FileCacheStats& stats() const { return stats_; }
+    size_t size() const { return map_.size(); }
+
+private:
+    struct Entry {
+        std::string                 key;
+        std::shared_ptr<CachedFile> file;   // nullptr: known to be missing
+        int64_t                     validated_ms;
+    };
+
+    void insert(const std::string& key, const std::shared_ptr<CachedFile>& f,
+                int64_t now_ms);
+    bool fresh(const Entry& e, int64_t now_ms) const {
+        return watched_ || now_ms - e.validated_ms < ttl_ms_;
+    }
+
+    size_t capacity_ = 0;
+    int    ttl_ms_ = 0;
+    bool   watched_ = false;
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> map_;
+    std::string fs_path_;   // doc_root + url_path, reused between calls
+    FileCacheStats stats_;
+};
+
+FileCache& file_cache();
+
+#endif
@@ -0,0 +1,881 @@
+#include "h2.hpp"
+#include "hpack.hpp"
+#include "connection.hpp"
+#include "config.hpp"
+#include "http.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "clock.hpp"
+
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+enum FrameType : uint8_t {
+    F_DATA          = 0x0,
+    F_HEADERS       = 0x1,
+    F_PRIORITY      = 0x2,
+    F_RST_STREAM    = 0x3,
+    F_SETTINGS      = 0x4,
+    F_PUSH_PROMISE  = 0x5,
+    F_PING          = 0x6,
+    F_GOAWAY        = 0x7,
+    F_WINDOW_UPDATE = 0x8,
+    F_CONTINUATION  = 0x9
+};
+
+const uint8_t END_STREAM    = 0x1;
+const uint8_t ACK           = 0x1;
+const uint8_t END_HEADERS   = 0x4;
+const uint8_t PADDED        = 0x8;
+const uint8_t PRIORITY_FLAG = 0x20;
+
+enum ErrorCode : uint32_t {
+    E_NONE        = 0x0,
+    E_PROTOCOL    = 0x1,
+    E_INTERNAL    = 0x2,
+    E_FLOW        = 0x3,
+    E_CLOSED      = 0x5,
+    E_FRAME_SIZE  = 0x6,
+    E_REFUSED     = 0x7,
+    E_COMPRESSION = 0x9,
+    E_CALM        = 0xb
+};
+
+enum SettingId : uint16_t {
+    S_HEADER_TABLE_SIZE      = 0x1,
+    S_ENABLE_PUSH            = 0x2,
+    S_MAX_CONCURRENT_STREAMS = 0x3,
+    S_INITIAL_WINDOW_SIZE    = 0x4,
+    S_MAX_FRAME_SIZE         = 0x5,
+    S_MAX_HEADER_LIST_SIZE   = 0x6
+};
+
+const size_t   FRAME_HEAD = 9;
+const int64_t  DEFAULT_WINDOW = 65535;
+const int64_t  MAX_WINDOW = 0x7fffffff;
+// the smallest SETTINGS_MAX_FRAME_SIZE, which is also what we accept
+const uint32_t MIN_FRAME = 16384;
+const uint32_t MAX_FRAME = 16777215;
+const size_t   HEADER_TABLE = 4096;
+const size_t   MAX_HEADER_LIST = 16 * 1024;
+// compressed, HEADERS and its CONTINUATION frames together
+const size_t   MAX_HEADER_BLOCK = 64 * 1024;
+const size_t   SPARE_STREAMS = 16;
+// Replies queued behind an undrained out_buf. A client that keeps sending
+// PING, SETTINGS or resets without reading what they bring back is cut
+// off with ENHANCE_YOUR_CALM once this much waits, rather than grow ctrl
+// at will.
+const size_t   MAX_CTRL = 64 * 1024;
+// a body slice this small is copied into the frame rather than given an
+// iovec entry of its own
+const size_t   COPY_BODY_MAX = 512;
+
+}
+
+struct H2Stream {
+    uint32_t id = 0;
+    int64_t  window = 0;       // what we may still send on it
+    uint64_t remaining = 0;    // body bytes not framed yet
+    bool     end_remote = false;   // the client has ended its side
+    bool     responded = false;    // HEADERS queued, DATA may follow
+    Connection ex;   // the exchange, as on an HTTP/1.1 connection
+};
+
+struct H2Session {
+    H2Session() : decoder(HEADER_TABLE, MAX_HEADER_LIST) {}
+
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+    std::vector<HpackHeader> headers;
+
+    std::string ctrl;    // frames waiting for out_buf to drain
+    std::string block;   // header block waiting for CONTINUATION
+    uint32_t    block_stream = 0;
+    bool        block_end_stream = false;
+
+    std::vector<std::unique_ptr<H2Stream>> streams;   // open, oldest first
+    std::vector<std::unique_ptr<H2Stream>> spare;
+    size_t      next_turn = 0;
+
+    int64_t     window = DEFAULT_WINDOW;       // connection send window
+    int64_t     initial_window = DEFAULT_WINDOW;   // the peer's, per stream
+    uint32_t    max_frame = MIN_FRAME;         // the peer's
+    uint32_t    last_stream = 0;   // highest stream the client opened
+    size_t      unacked = 0;       // DATA received, window not given back
+    bool        preface = true;    // the client preface is still to come
+    bool        closing = false;   // no new streams; close once all is sent
+    bool        failed = false;    // GOAWAY with an error sent
+};
+
+namespace {
+
+void frame_head(char* h, size_t len, uint8_t type, uint8_t flags,
+                uint32_t stream) {
+    h[0] = (char)(len >> 16);
+    h[1] = (char)(len >> 8);
+    h[2] = (char)len;
+    h[3] = (char)type;
+    h[4] = (char)flags;
+    h[5] = (char)((stream >> 24) & 0x7f);
+    h[6] = (char)(stream >> 16);
+    h[7] = (char)(stream >> 8);
+    h[8] = (char)stream;
+}
+
+void put_frame(std::string& out, size_t len, uint8_t type, uint8_t flags,
+               uint32_t stream) {
+    char h[FRAME_HEAD];
+    frame_head(h, len, type, flags, stream);
+    out.append(h, FRAME_HEAD);
+}
+
+void put_u32(std::string& out, uint32_t v) {
+    char b[4] = {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+    out.append(b, 4);
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+           (uint32_t)p[2] << 8 | p[3];
+}
+
+void put_setting(std::string& out, uint16_t id, uint32_t v) {
+    out.push_back((char)(id >> 8));
+    out.push_back((char)id);
+    put_u32(out, v);
+}
+
+void put_settings(std::string& out, const ServerConfig& cfg) {
+    put_frame(out, 12, F_SETTINGS, 0, 0);
+    put_setting(out, S_MAX_CONCURRENT_STREAMS, cfg.h2_max_streams);
+    put_setting(out, S_MAX_HEADER_LIST_SIZE, MAX_HEADER_LIST);
+}
+
+void put_window_update(std::string& out, uint32_t stream, size_t inc) {
+    put_frame(out, 4, F_WINDOW_UPDATE, 0, stream);
+    put_u32(out, (uint32_t)inc);
+}
+
+size_t find_stream(const H2Session& s, uint32_t id) {
+    for (size_t i = 0; i < s.streams.size(); ++i)
+        if (s.streams[i]->id == id) return i;
+    return SIZE_MAX;
+}
+
+H2Stream& open_stream(H2Session& s, uint32_t id) {
+    std::unique_ptr<H2Stream> st;
+    if (!s.spare.empty()) {
+        st = std::move(s.spare.back());
+        s.spare.pop_back();
+    } else {
+        st.reset(new H2Stream);
+    }
+    st->id = id;
+    st->window = s.initial_window;
+    st->remaining = 0;
+    st->end_remote = false;
+    st->responded = false;
+    s.streams.push_back(std::move(st));
+    return *s.streams.back();
+}
+
+// the buffers keep their capacity for the next stream
+void recycle(Connection& ex) {
+    std::string in = std::move(ex.in_buf);
+    std::string out = std::move(ex.out_buf);
+    ex = Connection();
+    in.clear();
+    out.clear();
+    ex.in_buf = std::move(in);
+    ex.out_buf = std::move(out);
+}
+
+void close_stream(H2Session& s, size_t i) {
+    std::unique_ptr<H2Stream> st = std::move(s.streams[i]);
+    s.streams.erase(s.streams.begin() + i);
+    if (s.next_turn > i) --s.next_turn;
+    recycle(st->ex);
+    if (s.spare.size() < SPARE_STREAMS) s.spare.push_back(std::move(st));
+}
+
+void reset_stream(H2Session& s, uint32_t id, uint32_t code) {
+    put_frame(s.ctrl, 4, F_RST_STREAM, 0, id);
+    put_u32(s.ctrl, code);
+    size_t i = find_stream(s, id);
+    if (i != SIZE_MAX) close_stream(s, i);
+}
+
+// the response is complete
+void finish_stream(Connection& conn, H2Session& s, size_t i) {
+    const Connection& ex = s.streams[i]->ex;
+    int64_t duration = monotonic_us() - ex.req_start_us;
+    metrics_request(ex.status_code, ex.resp_bytes, duration);
+    if (access_log_enabled())
+        log_access(ex.req.method, ex.req.target, ex.status_code,
+                   ex.resp_bytes, duration);
+    ++conn.requests;
+
+    // a request body still on its way is not wanted
+    if (!s.streams[i]->end_remote) {
+        put_frame(s.ctrl, 4, F_RST_STREAM, 0, s.streams[i]->id);
+        put_u32(s.ctrl, E_NONE);
+    }
+    close_stream(s, i);
+}
+
+// GOAWAY; what is queued still goes out, then the connection is closed
+bool connection_error(H2Session& s, uint32_t code) {
+    put_frame(s.ctrl, 8, F_GOAWAY, 0, 0);
+    put_u32(s.ctrl, s.last_stream);
+    put_u32(s.ctrl, code);
+    s.failed = s.closing = true;
+    while (!s.streams.empty()) close_stream(s, s.streams.size() - 1);
+    return false;
+}
+
+void settle(Connection& conn) {
+    const H2Session& s = *conn.h2;
+    bool busy = !s.streams.empty() || !s.ctrl.empty() || output_pending(conn);
+    if (s.closing && !busy)
+        conn.state = ConnState::CLOSING;
+    else
+        conn.state = busy ? ConnState::SENDING_BODY
+                          : ConnState::READING_REQUEST;
+}
+
+bool apply_settings(H2Session& s, const uint8_t* p, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        uint16_t id = (uint16_t)(p[i] << 8 | p[i + 1]);
+        uint32_t v = get_u32(p + i + 2);
+        switch (id) {
+            case S_HEADER_TABLE_SIZE:
+                s.encoder.set_peer_max(v);
+                break;
+            case S_ENABLE_PUSH:
+                if (v > 1) return connection_error(s, E_PROTOCOL);
+                break;
+            case S_INITIAL_WINDOW_SIZE: {
+                if (v > MAX_WINDOW) return connection_error(s, E_FLOW);
+                int64_t delta = (int64_t)v - s.initial_window;
+                for (auto& st : s.streams) {
+                    st->window += delta;
+                    if (st->window > MAX_WINDOW)
+                        return connection_error(s, E_FLOW);
+                }
+                s.initial_window = v;
+                break;
+            }
+            case S_MAX_FRAME_SIZE:
+                if (v < MIN_FRAME || v > MAX_FRAME)
+                    return connection_error(s, E_PROTOCOL);
+                s.max_frame = v;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+bool decode_base64url(std::string_view in, std::string& out) {
+    out.clear();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char ch : in) {
+        int v;
+        if (ch >= 'A' && ch <= 'Z')      v = ch - 'A';
+        else if (ch >= 'a' && ch <= 'z') v = ch - 'a' + 26;
+        else if (ch >= '0' && ch <= '9') v = ch - '0' + 52;
+        else if (ch == '-' || ch == '+') v = 62;
+        else if (ch == '_' || ch == '/') v = 63;
+        else if (ch == '=')              break;
+        else                             return false;
+        acc = ((acc << 6) | v) & 0xffffff;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return true;
+}
+
+// h2c among the comma-separated protocols of an Upgrade header
+bool offers_h2c(std::string_view v) {
+    while (!v.empty()) {
+        size_t comma = v.find(',');
+        std::string_view t = v.substr(0, comma);
+        while (!t.empty() && (t.front() == ' ' || t.front() == '\t'))
+            t.remove_prefix(1);
+        while (!t.empty() && (t.back() == ' ' || t.back() == '\t'))
+            t.remove_suffix(1);
+        if (t.size() == 3 && (t[0] | 0x20) == 'h' && t[1] == '2' &&
+            (t[2] | 0x20) == 'c')
+            return true;
+        if (comma == std::string_view::npos) break;
+        v.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool connection_specific(std::string_view name) {
+    return name == "connection" || name == "keep-alive" ||
+           name == "proxy-connection" || name == "transfer-encoding" ||
+           name == "upgrade";
+}
+
+bool visible(std::string_view s) {
+    for (char ch : s)
+        if ((unsigned char)ch <= ' ' || (unsigned char)ch >= 0x7f)
+            return false;
+    return true;
+}
+
+// Renders a decoded request header list as an HTTP/1.1 head; false if
+// it is malformed (RFC 9113 section 8.1.1).
+bool render_request(const std::vector<HpackHeader>& headers, size_t count,
+                    std::string& out) {
+    const std::string* method = nullptr;
+    const std::string* scheme = nullptr;
+    const std::string* path = nullptr;
+    const std::string* authority = nullptr;
+    bool regular = false;
+    bool host = false;
+
+    for (size_t i = 0; i < count; ++i) {
+        const HpackHeader& h = headers[i];
+        if (h.name.empty()) return false;
+        for (char ch : h.value)
+            if (ch == '\r' || ch == '\n' || ch == '\0') return false;
+
+        if (h.name[0] == ':') {
+            // pseudo-headers come first, once each
+            if (regular) return false;
+            const std::string** slot =
+                h.name == ":method"    ? &method :
+                h.name == ":scheme"    ? &scheme :
+                h.name == ":path"      ? &path :
+                h.name == ":authority" ? &authority : nullptr;
+            if (!slot || *slot) return false;
+            *slot = &h.value;
+            continue;
+        }
+
+        regular = true;
+        if (!visible(h.name) || h.name.find(':') != std::string::npos)
+            return false;
+        for (char ch : h.name)
+            if (ch >= 'A' && ch <= 'Z') return false;
+        if (connection_specific(h.name)) return false;
+        if (h.name == "te" && h.value != "trailers") return false;
+        if (h.name == "host") host = true;
+    }
+
+    if (!method || !scheme || !path || method->empty() || path->empty() ||
+        !visible(*method) || !visible(*path))
+        return false;
+
+    out.clear();
+    out.append(*method).append(" ").append(*path).append(" HTTP/1.1\r\n");
+    if (authority && !host)
+        out.append("host: ").append(*authority).append("\r\n");
+    for (size_t i = 0; i < count; ++i) {
+        const HpackHeader& h = headers[i];
+        if (h.name[0] == ':') continue;
+        out.append(h.name).append(": ").append(h.value).append("\r\n");
+    }
+    out.append("\r\n");
+    return true;
+}
+
+uint64_t body_left(const Connection& ex) {
+    uint64_t n = ex.out_buf.size() - ex.out_sent;
+    if (ex.body_mem || ex.file_fd >= 0) n += ex.file_size - ex.file_offset;
+    for (size_t i = ex.next_part; i < ex.parts.size(); ++i)
+        n += ex.parts[i].head.size() + (ex.parts[i].end - ex.parts[i].start);
+    return n;
+}
+
+// Queues HEADERS for the HTTP/1.1 head prepare_response() left in
+// ex.out_buf; the body behind it becomes the stream's DATA.
+void respond(Connection& conn, H2Session& s, H2Stream& st) {
+    Connection& ex = st.ex;
+    size_t end = ex.out_buf.find("\r\n\r\n");
+    if (end == std::string::npos) return reset_stream(s, st.id, E_INTERNAL);
+
+    static thread_local std::string block;
+    static thread_local std::string name;
+    block.clear();
+    s.encoder.begin(block);
+    s.encoder.status(block, ex.status_code);
+
+    std::string_view head(ex.out_buf);
+    size_t pos = head.find("\r\n") + 2;
+    while (pos < end + 2) {
+        size_t eol = head.find("\r\n", pos);
+        size_t colon = head.find(':', pos);
+        if (colon < eol) {
+            name.assign(head.data() + pos, colon - pos);
+            for (char& ch : name)
+                if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+            size_t v = colon + 1;
+            while (v < eol && head[v] == ' ') ++v;
+            if (!connection_specific(name))
+                s.encoder.add(block, name, head.substr(v, eol - v));
+        }
+        pos = eol + 2;
+    }
+
+    ex.out_sent = end + 4;
+    st.remaining = ex.head_only ? 0 : body_left(ex);
+    ex.resp_bytes = block.size() + st.remaining;
+
+    // HEADERS, then CONTINUATION for what does not fit in one frame
+    size_t off = 0;
+    do {
+        size_t len = std::min<size_t>(block.size() - off, s.max_frame);
+        uint8_t flags = off + len == block.size() ? END_HEADERS : 0;
+        if (off == 0 && st.remaining == 0) flags |= END_STREAM;
+        put_frame(s.ctrl, len, off == 0 ? F_HEADERS : F_CONTINUATION, flags,
+                  st.id);
+        s.ctrl.append(block, off, len);
+        off += len;
+    } while (off < block.size());
+
+    if (st.remaining == 0)
+        return finish_stream(conn, s, find_stream(s, st.id));
+    st.responded = true;
+}
+
+void start_request(Connection& conn, const ServerConfig& cfg, H2Session& s,
+                   H2Stream& st) {
+    Connection& ex = st.ex;
+    ex.fd = conn.fd;
+    ex.req_start_us = monotonic_us();
+    if (parse_request(ex) != ParseStatus::COMPLETE)
+        return reset_stream(s, st.id, E_PROTOCOL);
+    if (!prepare_response(ex, cfg)) {
+        // parked on the I/O pool until h2_resume()
+        ex.state = ConnState::PREPARING_RESPONSE;
+        return;
+    }
+    respond(conn, s, st);
+}
+
+bool end_headers(Connection& conn, const ServerConfig& cfg, H2Session& s,
+                 uint32_t id) {
+    size_t count = 0;
+    // decoded even when the stream is ignored, to keep the table in step
+    if (!s.decoder.decode((const uint8_t*)s.block.data(), s.block.size(),
+                          s.headers, count))
+        return connection_error(s, E_COMPRESSION);
+
+    size_t i = find_stream(s, id);
+    if (i != SIZE_MAX) {
+        // trailers; they have to end the stream and are not used
+        if (!s.block_end_stream) reset_stream(s, id, E_PROTOCOL);
+        else s.streams[i]->end_remote = true;
+        return true;
+    }
+    // a stream we reset or finished while the client was still sending
+    if (id <= s.last_stream) return true;
+
+    s.last_stream = id;
+    if (s.closing) return true;
+    if (s.streams.size() >= cfg.h2_max_streams) {
+        reset_stream(s, id, E_REFUSED);
+        return true;
+    }
+
+    H2Stream& st = open_stream(s, id);
+    st.end_remote = s.block_end_stream;
+    if (s.decoder.oversized() ||
+        !render_request(s.headers, count, st.ex.in_buf)) {
+        reset_stream(s, id, E_PROTOCOL);
+        return true;
+    }
+    start_request(conn, cfg, s, st);
+    return true;
+}
+
+bool on_data(H2Session& s, uint8_t flags, uint32_t id, size_t len) {
+    if (id == 0) return connection_error(s, E_PROTOCOL);
+
+    // the whole frame counts against the windows, padding included
+    s.unacked += len;
+    if (s.unacked >= DEFAULT_WINDOW / 2) {
+        put_window_update(s.ctrl, 0, s.unacked);
+        s.unacked = 0;
+    }
+
+    size_t i = find_stream(s, id);
+    if (i == SIZE_MAX) {
+        if (id > s.last_stream) return connection_error(s, E_PROTOCOL);
+        return true;
+    }
+    H2Stream& st = *s.streams[i];
+    if (st.end_remote) {
+        reset_stream(s, id, E_CLOSED);
+        return true;
+    }
+    // request bodies are not read; the stream gets its window back
+    if (flags & END_STREAM)
+        st.end_remote = true;
+    else if (len > 0)
+        put_window_update(s.ctrl, id, len);
+    return true;
+}
+
+bool on_window_update(H2Session& s, uint32_t id, const uint8_t* p,
+                      size_t len) {
+    if (len != 4) return connection_error(s, E_FRAME_SIZE);
+    uint32_t inc = get_u32(p) & 0x7fffffff;
+
+    if (id == 0) {
+        if (inc == 0) return connection_error(s, E_PROTOCOL);
+        s.window += inc;
+        if (s.window > MAX_WINDOW) return connection_error(s, E_FLOW);
+        return true;
+    }
+
+    size_t i = find_stream(s, id);
+    if (i == SIZE_MAX) return true;
+    if (inc == 0) {
+        reset_stream(s, id, E_PROTOCOL);
+        return true;
+    }
+    H2Stream& st = *s.streams[i];
+    st.window += inc;
+    if (st.window > MAX_WINDOW) reset_stream(s, id, E_FLOW);
+    return true;
+}
+
+bool handle_frame(Connection& conn, const ServerConfig& cfg, H2Session& s,
+                  uint8_t type, uint8_t flags, uint32_t id,
+                  const uint8_t* p, size_t len) {
+    // nothing may come between a header block and its CONTINUATION frames
+    if (s.block_stream && (type != F_CONTINUATION || id != s.block_stream))
+        return connection_error(s, E_PROTOCOL);
+
+    switch (type) {
+        case F_DATA:
+            return on_data(s, flags, id, len);
+
+        case F_HEADERS: {
+            if (id == 0 || !(id & 1)) return connection_error(s, E_PROTOCOL);
+            size_t off = 0, pad = 0;
+            if (flags & PADDED) {
+                if (len < 1) return connection_error(s, E_PROTOCOL);
+                pad = p[0];
+                off = 1;
+            }
+            if (flags & PRIORITY_FLAG) off += 5;
+            if (off + pad > len) return connection_error(s, E_PROTOCOL);
+            s.block.assign((const char*)p + off, len - off - pad);
+            s.block_end_stream = flags & END_STREAM;
+            if (!(flags & END_HEADERS)) {
+                s.block_stream = id;
+                return true;
+            }
+            return end_headers(conn, cfg, s, id);
+        }
+
+        case F_CONTINUATION:
+            if (!s.block_stream) return connection_error(s, E_PROTOCOL);
+            if (s.block.size() + len > MAX_HEADER_BLOCK)
+                return connection_error(s, E_CALM);
+            s.block.append((const char*)p, len);
+            if (!(flags & END_HEADERS)) return true;
+            s.block_stream = 0;
+            return end_headers(conn, cfg, s, id);
+
+        case F_PRIORITY:
+            if (id == 0) return connection_error(s, E_PROTOCOL);
+            if (len != 5) reset_stream(s, id, E_FRAME_SIZE);
+            return true;
+
+        case F_RST_STREAM: {
+            if (id == 0 || id > s.last_stream)
+                return connection_error(s, E_PROTOCOL);
+            if (len != 4) return connection_error(s, E_FRAME_SIZE);
+            size_t i = find_stream(s, id);
+            if (i != SIZE_MAX) close_stream(s, i);
+            return true;
+        }
+
+        case F_SETTINGS:
+            if (id != 0) return connection_error(s, E_PROTOCOL);
+            if (flags & ACK)
+                return len == 0 || connection_error(s, E_FRAME_SIZE);
+            if (len % 6) return connection_error(s, E_FRAME_SIZE);
+            if (!apply_settings(s, p, len)) return false;
+            put_frame(s.ctrl, 0, F_SETTINGS, ACK, 0);
+            return true;
+
+        case F_PUSH_PROMISE:
+            return connection_error(s, E_PROTOCOL);
+
+        case F_PING:
+            if (id != 0) return connection_error(s, E_PROTOCOL);
+            if (len != 8) return connection_error(s, E_FRAME_SIZE);
+            if (!(flags & ACK)) {
+                put_frame(s.ctrl, 8, F_PING, ACK, 0);
+                s.ctrl.append((const char*)p, 8);
+            }
+            return true;
+
+        case F_GOAWAY:
+            if (id != 0) return connection_error(s, E_PROTOCOL);
+            // streams in progress are finished, new ones not started
+            s.closing = true;
+            return true;
+
+        case F_WINDOW_UPDATE:
+            return on_window_update(s, id, p, len);
+
+        default:
+            // unknown frame types are ignored
+            return true;
+    }
+}
+
+// Frames the next slice of a stream's body, up to room bytes, as one DATA
+// frame in out_buf: the rest of its header buffer, then the in-memory body
+// or the file, then the following multipart ranges. In-memory slices are
+// batched rather than copied. false if it had nothing it could send.
+bool send_data(Connection& conn, H2Session& s, size_t i, size_t room,
+               size_t& sent) {
+    H2Stream& st = *s.streams[i];
+    if (!st.responded) return false;
+    int64_t max = std::min<int64_t>({(int64_t)room, (int64_t)s.max_frame,
+                                     s.window, st.window,
+                                     (int64_t)st.remaining});
+    if (max <= 0) return false;
+
+    Connection& ex = st.ex;
+    size_t at = conn.out_buf.size();
+    size_t batched = conn.batched.size();
+    conn.out_buf.append(FRAME_HEAD, '\0');
+
+    size_t want = (size_t)max;
+    size_t len = 0;
+    while (len < want) {
+        size_t k = want - len;
+        if (ex.out_sent < ex.out_buf.size()) {
+            k = std::min(k, ex.out_buf.size() - ex.out_sent);
+            conn.out_buf.append(ex.out_buf, ex.out_sent, k);
+            ex.out_sent += k;
+        } else if ((ex.body_mem || ex.file_fd >= 0) &&
+                   ex.file_offset < ex.file_size) {
+            k = std::min<size_t>(k, ex.file_size - ex.file_offset);
+            if (ex.body_mem && k > COPY_BODY_MAX) {
+                conn.batched.push_back({conn.out_buf.size(),
+                                        ex.body_mem + ex.file_offset, k});
+            } else if (ex.body_mem) {
+                conn.out_buf.append(ex.body_mem + ex.file_offset, k);
+            } else {
+                size_t old = conn.out_buf.size();
+                conn.out_buf.resize(old + k);
+                ssize_t r = ::pread(ex.file_fd, &conn.out_buf[old], k,
+                                    ex.file_offset);
+                if (r <= 0) {
+                    // the file shrank since it was opened
+                    conn.out_buf.resize(at);
+                    conn.batched.resize(batched);
+                    reset_stream(s, st.id, E_INTERNAL);
+                    return true;
+                }
+                conn.out_buf.resize(old + r);
+                k = r;
+            }
+            ex.file_offset += k;
+        } else if (next_range_part(ex)) {
+            continue;
+        } else {
+            break;
+        }
+        len += k;
+    }
+
+    bool end = len >= st.remaining || len < want;
+    frame_head(&conn.out_buf[at], len, F_DATA, end ? END_STREAM : 0, st.id);
+    s.window -= len;
+    st.window -= len;
+    st.remaining -= std::min<uint64_t>(len, st.remaining);
+    sent += len;
+    if (end) finish_stream(conn, s, i);
+    return true;
+}
+
+}
+
+size_t h2_preface_match(const std::string& in) {
+    size_t n = std::min(in.size(), H2_PREFACE_LEN);
+    size_t i = 0;
+    while (i < n && in[i] == PREFACE[i]) ++i;
+    return i;
+}
+
+void h2_start(Connection& conn, const ServerConfig& cfg) {
+    conn.h2 = std::make_shared<H2Session>();
+    put_settings(conn.h2->ctrl, cfg);
+}
+
+bool h2_upgrade(Connection& conn, const ServerConfig& cfg) {
+    const HttpRequest& req = conn.req;
+    if (!offers_h2c(req.upgrade) || req.http2_settings.empty() ||
+        (!req.content_length.empty() && req.content_length != "0") ||
+        !req.transfer_encoding.empty() ||
+        !conn.out_buf.empty() || !conn.batched.empty())
+        return false;
+
+    static thread_local std::string settings;
+    if (!decode_base64url(req.http2_settings, settings) ||
+        settings.size() % 6)
+        return false;
+    auto s = std::make_shared<H2Session>();
+    if (!apply_settings(*s, (const uint8_t*)settings.data(), settings.size()))
+        return false;
+
+    s->ctrl = "HTTP/1.1 101 Switching Protocols\r\n"
+              "Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    put_settings(s->ctrl, cfg);
+
+    // the request that asked becomes stream 1, already half closed
+    H2Stream& st = open_stream(*s, 1);
+    st.end_remote = true;
+    st.ex.in_buf.assign(conn.in_buf, 0, req.head_len);
+    s->last_stream = 1;
+    conn.in_buf.erase(0, req.head_len);
+    conn.parser.reset();
+    conn.req = HttpRequest();
+    conn.h2 = s;
+
+    start_request(conn, cfg, *s, st);
+    settle(conn);
+    return true;
+}
+
+void h2_input(Connection& conn, const ServerConfig& cfg, bool& want_close) {
+    want_close = false;
+    H2Session& s = *conn.h2;
+    if (s.failed) {
+        conn.in_buf.clear();
+        return settle(conn);
+    }
+
+    size_t pos = 0;
+    if (s.preface) {
+        size_t m = h2_preface_match(conn.in_buf);
+        if (m < std::min(conn.in_buf.size(), H2_PREFACE_LEN)) {
+            want_close = true;
+            conn.state = ConnState::CLOSING;
+            return;
+        }
+        if (m < H2_PREFACE_LEN) return settle(conn);
+        pos = H2_PREFACE_LEN;
+        s.preface = false;
+    }
+
+    const uint8_t* in = (const uint8_t*)conn.in_buf.data();
+    while (!s.failed && conn.in_buf.size() - pos >= FRAME_HEAD) {
+        const uint8_t* h = in + pos;
+        size_t len = (size_t)h[0] << 16 | (size_t)h[1] << 8 | h[2];
+        if (len > MIN_FRAME) {
+            connection_error(s, E_FRAME_SIZE);
+            break;
+        }
+        if (conn.in_buf.size() - pos - FRAME_HEAD < len) break;
+        if (s.ctrl.size() > MAX_CTRL) {
+            // it is not reading, so the GOAWAY would only wait as well
+            connection_error(s, E_CALM);
+            conn.in_buf.clear();
+            want_close = true;
+            conn.state = ConnState::CLOSING;
+            return;
+        }
+        uint32_t id = get_u32(h + 5) & 0x7fffffff;
+        handle_frame(conn, cfg, s, h[3], h[4], id, h + FRAME_HEAD, len);
+        pos += FRAME_HEAD + len;
+    }
+
+    if (s.failed)
+        conn.in_buf.clear();
+    else
+        conn.in_buf.erase(0, pos);
+    settle(conn);
+}
+
+bool h2_fill(Connection& conn, size_t room) {
+    H2Session& s = *conn.h2;
+    bool queued = !s.ctrl.empty();
+    conn.out_buf.append(s.ctrl);
+    s.ctrl.clear();
+
+    // After an upgrade, DATA waits for the client preface: a client reading
+    // the 101 response need not have room for much more behind it.
+    if (s.preface) {
+        settle(conn);
+        return queued;
+    }
+
+    // one frame per stream and pass, so parallel responses progress together
+    size_t sent = 0;
+    for (bool progress = true; progress && sent < room && s.window > 0;) {
+        progress = false;
+        for (size_t k = s.streams.size(); k > 0 && sent < room &&
+                                          s.window > 0; --k) {
+            if (s.next_turn >= s.streams.size()) s.next_turn = 0;
+            size_t open = s.streams.size();
+            if (send_data(conn, s, s.next_turn, room - sent, sent))
+                progress = queued = true;
+            // a finished stream leaves its slot to the next one
+            if (s.streams.size() == open) ++s.next_turn;
+        }
+    }
+    settle(conn);
+    return queued;
+}
+
+bool h2_resume(Connection& conn, const ServerConfig& cfg, uint64_t ticket) {
+    H2Session& s = *conn.h2;
+    for (auto& p : s.streams) {
+        H2Stream& st = *p;
+        Connection& ex = st.ex;
+        if (ex.state != ConnState::PREPARING_RESPONSE ||
+            ex.io_ticket != ticket)
+            continue;
+        ex.io_ticket = 0;
+        ex.io_resolved = true;
+        if (prepare_response(ex, cfg)) respond(conn, s, st);
+        settle(conn);
+        return true;
+    }
+    return false;
+}
+
+bool h2_streaming(const Connection& conn) {
+    if (!conn.h2) return false;
+    const H2Session& s = *conn.h2;
+    if (s.preface || s.window <= 0) return false;
+    for (const auto& st : s.streams)
+        if (st->responded && st->window > 0) return true;
+    return false;
+}
+
+bool h2_parked(const Connection& conn) {
+    if (!conn.h2) return false;
+    const H2Session& s = *conn.h2;
+    if (s.streams.empty() || !s.ctrl.empty() || output_pending(conn))
+        return false;
+    for (const auto& st : s.streams)
+        if (st->ex.io_ticket == 0) return false;
+    return true;
+}
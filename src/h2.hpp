@@ -0,0 +1,58 @@
+#ifndef H2_HPP
+#define H2_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct Connection;
+struct ServerConfig;
+
+// HTTP/2 over cleartext TCP (h2c), entered with the client connection
+// preface (prior knowledge) or by Upgrade: h2c on a first HTTP/1.1 request.
+// The session hangs off its Connection and is driven by the same loops:
+// frames arrive in in_buf, and leave through out_buf and the batched
+// bodies like any other output.
+//
+// Each stream's request is rendered as an HTTP/1.1 head and answered by
+// prepare_response() on a Connection of its own, so caches, ranges,
+// validators, precompressed variants and the I/O pool work as they do for
+// HTTP/1.1. Its header block is re-encoded with HPACK and its body is cut
+// into DATA frames, one per stream in turn, within the flow-control windows.
+//
+// The connection reads READING_REQUEST while nothing is queued or in
+// progress, and SENDING_BODY otherwise, so timers and idle reclaim treat
+// it like a keep-alive connection.
+
+struct H2Session;
+
+const size_t H2_PREFACE_LEN = 24;
+
+// how many leading bytes of in match the client connection preface
+size_t h2_preface_match(const std::string& in);
+
+// the preface is next in in_buf
+void h2_start(Connection& conn, const ServerConfig& cfg);
+
+// The request just parsed asks for Upgrade: h2c. On true it has become
+// stream 1 and the 101 response is queued; false leaves it to HTTP/1.1.
+bool h2_upgrade(Connection& conn, const ServerConfig& cfg);
+
+// handles the complete frames in in_buf
+void h2_input(Connection& conn, const ServerConfig& cfg, bool& want_close);
+
+// Appends what is queued to the drained out_buf: control and HEADERS
+// frames, then DATA up to room payload bytes. false if nothing was added.
+bool h2_fill(Connection& conn, size_t room);
+
+// a stream parked on the I/O pool under ticket was resolved; false if no
+// stream of this connection is waiting for it
+bool h2_resume(Connection& conn, const ServerConfig& cfg, uint64_t ticket);
+
+// some stream has body left and window to send it in
+bool h2_streaming(const Connection& conn);
+
+// every open stream waits on the I/O pool and nothing else is queued
+bool h2_parked(const Connection& conn);
+
+#endif
@@ -0,0 +1,449 @@
+#include "hpack.hpp"
+
+#include <cstring>
+
+namespace {
+
+struct StaticEntry {
+    const char* name;
+    const char* value;
+};
+
+// RFC 7541 Appendix A; index 1 is the first entry
+const StaticEntry STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+const size_t STATIC_COUNT = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+struct HuffCode {
+    uint32_t code;
+    uint8_t  bits;
+};
+
+// RFC 7541 Appendix B, symbols 0-255; EOS (256) is 30 one bits
+const HuffCode HUFFMAN[256] = {
+    {0x00001ff8, 13}, {0x007fffd8, 23}, {0x0fffffe2, 28}, {0x0fffffe3, 28},
+    {0x0fffffe4, 28}, {0x0fffffe5, 28}, {0x0fffffe6, 28}, {0x0fffffe7, 28},
+    {0x0fffffe8, 28}, {0x00ffffea, 24}, {0x3ffffffc, 30}, {0x0fffffe9, 28},
+    {0x0fffffea, 28}, {0x3ffffffd, 30}, {0x0fffffeb, 28}, {0x0fffffec, 28},
+    {0x0fffffed, 28}, {0x0fffffee, 28}, {0x0fffffef, 28}, {0x0ffffff0, 28},
+    {0x0ffffff1, 28}, {0x0ffffff2, 28}, {0x3ffffffe, 30}, {0x0ffffff3, 28},
+    {0x0ffffff4, 28}, {0x0ffffff5, 28}, {0x0ffffff6, 28}, {0x0ffffff7, 28},
+    {0x0ffffff8, 28}, {0x0ffffff9, 28}, {0x0ffffffa, 28}, {0x0ffffffb, 28},
+    {0x00000014,  6}, {0x000003f8, 10}, {0x000003f9, 10}, {0x00000ffa, 12},
+    {0x00001ff9, 13}, {0x00000015,  6}, {0x000000f8,  8}, {0x000007fa, 11},
+    {0x000003fa, 10}, {0x000003fb, 10}, {0x000000f9,  8}, {0x000007fb, 11},
+    {0x000000fa,  8}, {0x00000016,  6}, {0x00000017,  6}, {0x00000018,  6},
+    {0x00000000,  5}, {0x00000001,  5}, {0x00000002,  5}, {0x00000019,  6},
+    {0x0000001a,  6}, {0x0000001b,  6}, {0x0000001c,  6}, {0x0000001d,  6},
+    {0x0000001e,  6}, {0x0000001f,  6}, {0x0000005c,  7}, {0x000000fb,  8},
+    {0x00007ffc, 15}, {0x00000020,  6}, {0x00000ffb, 12}, {0x000003fc, 10},
+    {0x00001ffa, 13}, {0x00000021,  6}, {0x0000005d,  7}, {0x0000005e,  7},
+    {0x0000005f,  7}, {0x00000060,  7}, {0x00000061,  7}, {0x00000062,  7},
+    {0x00000063,  7}, {0x00000064,  7}, {0x00000065,  7}, {0x00000066,  7},
+    {0x00000067,  7}, {0x00000068,  7}, {0x00000069,  7}, {0x0000006a,  7},
+    {0x0000006b,  7}, {0x0000006c,  7}, {0x0000006d,  7}, {0x0000006e,  7},
+    {0x0000006f,  7}, {0x00000070,  7}, {0x00000071,  7}, {0x00000072,  7},
+    {0x000000fc,  8}, {0x00000073,  7}, {0x000000fd,  8}, {0x00001ffb, 13},
+    {0x0007fff0, 19}, {0x00001ffc, 13}, {0x00003ffc, 14}, {0x00000022,  6},
+    {0x00007ffd, 15}, {0x00000003,  5}, {0x00000023,  6}, {0x00000004,  5},
+    {0x00000024,  6}, {0x00000005,  5}, {0x00000025,  6}, {0x00000026,  6},
+    {0x00000027,  6}, {0x00000006,  5}, {0x00000074,  7}, {0x00000075,  7},
+    {0x00000028,  6}, {0x00000029,  6}, {0x0000002a,  6}, {0x00000007,  5},
+    {0x0000002b,  6}, {0x00000076,  7}, {0x0000002c,  6}, {0x00000008,  5},
+    {0x00000009,  5}, {0x0000002d,  6}, {0x00000077,  7}, {0x00000078,  7},
+    {0x00000079,  7}, {0x0000007a,  7}, {0x0000007b,  7}, {0x00007ffe, 15},
+    {0x000007fc, 11}, {0x00003ffd, 14}, {0x00001ffd, 13}, {0x0ffffffc, 28},
+    {0x000fffe6, 20}, {0x003fffd2, 22}, {0x000fffe7, 20}, {0x000fffe8, 20},
+    {0x003fffd3, 22}, {0x003fffd4, 22}, {0x003fffd5, 22}, {0x007fffd9, 23},
+    {0x003fffd6, 22}, {0x007fffda, 23}, {0x007fffdb, 23}, {0x007fffdc, 23},
+    {0x007fffdd, 23}, {0x007fffde, 23}, {0x00ffffeb, 24}, {0x007fffdf, 23},
+    {0x00ffffec, 24}, {0x00ffffed, 24}, {0x003fffd7, 22}, {0x007fffe0, 23},
+    {0x00ffffee, 24}, {0x007fffe1, 23}, {0x007fffe2, 23}, {0x007fffe3, 23},
+    {0x007fffe4, 23}, {0x001fffdc, 21}, {0x003fffd8, 22}, {0x007fffe5, 23},
+    {0x003fffd9, 22}, {0x007fffe6, 23}, {0x007fffe7, 23}, {0x00ffffef, 24},
+    {0x003fffda, 22}, {0x001fffdd, 21}, {0x000fffe9, 20}, {0x003fffdb, 22},
+    {0x003fffdc, 22}, {0x007fffe8, 23}, {0x007fffe9, 23}, {0x001fffde, 21},
+    {0x007fffea, 23}, {0x003fffdd, 22}, {0x003fffde, 22}, {0x00fffff0, 24},
+    {0x001fffdf, 21}, {0x003fffdf, 22}, {0x007fffeb, 23}, {0x007fffec, 23},
+    {0x001fffe0, 21}, {0x001fffe1, 21}, {0x003fffe0, 22}, {0x001fffe2, 21},
+    {0x007fffed, 23}, {0x003fffe1, 22}, {0x007fffee, 23}, {0x007fffef, 23},
+    {0x000fffea, 20}, {0x003fffe2, 22}, {0x003fffe3, 22}, {0x003fffe4, 22},
+    {0x007ffff0, 23}, {0x003fffe5, 22}, {0x003fffe6, 22}, {0x007ffff1, 23},
+    {0x03ffffe0, 26}, {0x03ffffe1, 26}, {0x000fffeb, 20}, {0x0007fff1, 19},
+    {0x003fffe7, 22}, {0x007ffff2, 23}, {0x003fffe8, 22}, {0x01ffffec, 25},
+    {0x03ffffe2, 26}, {0x03ffffe3, 26}, {0x03ffffe4, 26}, {0x07ffffde, 27},
+    {0x07ffffdf, 27}, {0x03ffffe5, 26}, {0x00fffff1, 24}, {0x01ffffed, 25},
+    {0x0007fff2, 19}, {0x001fffe3, 21}, {0x03ffffe6, 26}, {0x07ffffe0, 27},
+    {0x07ffffe1, 27}, {0x03ffffe7, 26}, {0x07ffffe2, 27}, {0x00fffff2, 24},
+    {0x001fffe4, 21}, {0x001fffe5, 21}, {0x03ffffe8, 26}, {0x03ffffe9, 26},
+    {0x0ffffffd, 28}, {0x07ffffe3, 27}, {0x07ffffe4, 27}, {0x07ffffe5, 27},
+    {0x000fffec, 20}, {0x00fffff3, 24}, {0x000fffed, 20}, {0x001fffe6, 21},
+    {0x003fffe9, 22}, {0x001fffe7, 21}, {0x001fffe8, 21}, {0x007ffff3, 23},
+    {0x003fffea, 22}, {0x003fffeb, 22}, {0x01ffffee, 25}, {0x01ffffef, 25},
+    {0x00fffff4, 24}, {0x00fffff5, 24}, {0x03ffffea, 26}, {0x007ffff4, 23},
+    {0x03ffffeb, 26}, {0x07ffffe6, 27}, {0x03ffffec, 26}, {0x03ffffed, 26},
+    {0x07ffffe7, 27}, {0x07ffffe8, 27}, {0x07ffffe9, 27}, {0x07ffffea, 27},
+    {0x07ffffeb, 27}, {0x0ffffffe, 28}, {0x07ffffec, 27}, {0x07ffffed, 27},
+    {0x07ffffee, 27}, {0x07ffffef, 27}, {0x07fffff0, 27}, {0x03ffffee, 26},
+};
+const HuffCode HUFFMAN_EOS = {0x3fffffff, 30};
+
+// size of an entry as the dynamic table counts it
+const size_t ENTRY_OVERHEAD = 32;
+
+// Binary tree of the code, walked one bit at a time. Header strings are
+// short, and a request's are mostly indexed, so this is not worth a wider
+// lookup table.
+struct HuffTree {
+    struct Node {
+        int16_t next[2] = {-1, -1};
+        int16_t sym = -1;
+    };
+    std::vector<Node> nodes;
+
+    HuffTree() {
+        nodes.reserve(512);
+        nodes.emplace_back();
+        for (int s = 0; s <= 256; ++s) {
+            const HuffCode& hc = s < 256 ? HUFFMAN[s] : HUFFMAN_EOS;
+            int n = 0;
+            for (int i = hc.bits - 1; i >= 0; --i) {
+                int bit = (hc.code >> i) & 1;
+                if (nodes[n].next[bit] < 0) {
+                    nodes[n].next[bit] = (int16_t)nodes.size();
+                    nodes.emplace_back();
+                }
+                n = nodes[n].next[bit];
+            }
+            nodes[n].sym = (int16_t)s;
+        }
+    }
+};
+
+const HuffTree& huff_tree() {
+    static const HuffTree tree;
+    return tree;
+}
+
+// padding is at most 7 bits and has to be a prefix of EOS (all ones)
+bool huffman_decode(const uint8_t* p, size_t len, std::string& out) {
+    const std::vector<HuffTree::Node>& nodes = huff_tree().nodes;
+    int n = 0;
+    int depth = 0;
+    bool ones = true;
+    for (size_t i = 0; i < len; ++i) {
+        for (int b = 7; b >= 0; --b) {
+            int bit = (p[i] >> b) & 1;
+            n = nodes[n].next[bit];
+            if (n < 0) return false;
+            ++depth;
+            ones = ones && bit;
+            int sym = nodes[n].sym;
+            if (sym < 0) continue;
+            if (sym == 256) return false;
+            out.push_back((char)sym);
+            n = 0;
+            depth = 0;
+            ones = true;
+        }
+    }
+    return depth < 8 && ones;
+}
+
+size_t huffman_length(std::string_view s) {
+    size_t bits = 0;
+    for (unsigned char c : s) bits += HUFFMAN[c].bits;
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(std::string_view s, std::string& out) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (unsigned char c : s) {
+        acc = (acc << HUFFMAN[c].bits) | HUFFMAN[c].code;
+        bits += HUFFMAN[c].bits;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    if (bits > 0)
+        out.push_back((char)((acc << (8 - bits)) | (0xff >> bits)));
+}
+
+void put_int(std::string& out, uint8_t first, int prefix, uint64_t v) {
+    uint64_t max = (1u << prefix) - 1;
+    if (v < max) {
+        out.push_back((char)(first | v));
+        return;
+    }
+    out.push_back((char)(first | max));
+    v -= max;
+    while (v >= 128) {
+        out.push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+// values past 2^28 are refused; nothing legitimate comes near
+bool get_int(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& v) {
+    uint64_t max = (1u << prefix) - 1;
+    v = *p++ & max;
+    if (v < max) return true;
+    for (int shift = 0; p < end && shift <= 21; shift += 7) {
+        uint8_t b = *p++;
+        v += (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+void put_string(std::string& out, std::string_view s) {
+    size_t h = huffman_length(s);
+    if (h < s.size()) {
+        put_int(out, 0x80, 7, h);
+        huffman_encode(s, out);
+    } else {
+        put_int(out, 0x00, 7, s.size());
+        out.append(s.data(), s.size());
+    }
+}
+
+bool get_string(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if (p >= end) return false;
+    bool huffman = (*p & 0x80) != 0;
+    uint64_t len;
+    if (!get_int(p, end, 7, len) || len > (uint64_t)(end - p)) return false;
+    out.clear();
+    if (huffman) {
+        if (!huffman_decode(p, len, out)) return false;
+    } else {
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+// per-response values: indexing them would only evict what repeats
+bool worth_indexing(std::string_view name) {
+    return name != "content-length" && name != "etag" &&
+           name != "last-modified" && name != "content-range" &&
+           name != "date";
+}
+
+}
+
+void HpackTable::evict(size_t room) {
+    while (!entries_.empty() && size_ + room > max_size_) {
+        const HpackHeader& h = entries_.back();
+        size_ -= h.name.size() + h.value.size() + ENTRY_OVERHEAD;
+        entries_.pop_back();
+    }
+}
+
+// an entry larger than the whole table empties it and is not added
+void HpackTable::add(std::string_view name, std::string_view value) {
+    size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    evict(size);
+    if (size > max_size_) return;
+    entries_.emplace_front();
+    entries_.front().name.assign(name.data(), name.size());
+    entries_.front().value.assign(value.data(), value.size());
+    size_ += size;
+}
+
+void HpackTable::set_max_size(size_t max_size) {
+    max_size_ = max_size;
+    evict(0);
+}
+
+bool HpackDecoder::lookup(uint64_t index, const HpackHeader*& h) const {
+    static thread_local HpackHeader entry;
+    if (index == 0) return false;
+    if (index <= STATIC_COUNT) {
+        entry.name = STATIC_TABLE[index - 1].name;
+        entry.value = STATIC_TABLE[index - 1].value;
+        h = &entry;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= table_.count()) return false;
+    h = &table_.at(index);
+    return true;
+}
+
+bool HpackDecoder::decode(const uint8_t* p, size_t len,
+                          std::vector<HpackHeader>& out, size_t& count) {
+    const uint8_t* end = p + len;
+    bool started = false;
+    size_t list = 0;
+    count = 0;
+    oversized_ = false;
+    while (p < end) {
+        uint8_t b = *p;
+        uint64_t index;
+        // a size update may only open the block
+        if ((b & 0xe0) == 0x20) {
+            if (started || !get_int(p, end, 5, index) || index > limit_)
+                return false;
+            table_.set_max_size(index);
+            continue;
+        }
+        started = true;
+        if (count == out.size()) out.emplace_back();
+        HpackHeader& h = out[count];
+
+        if (b & 0x80) {
+            const HpackHeader* e;
+            if (!get_int(p, end, 7, index) || !lookup(index, e)) return false;
+            h.name = e->name;
+            h.value = e->value;
+        } else {
+            // literal: with incremental indexing (01), without (0000) or
+            // never indexed (0001); the name is indexed or a string
+            bool indexed = (b & 0x40) != 0;
+            if (!get_int(p, end, indexed ? 6 : 4, index)) return false;
+            if (index > 0) {
+                const HpackHeader* e;
+                if (!lookup(index, e)) return false;
+                h.name = e->name;
+            } else if (!get_string(p, end, h.name)) {
+                return false;
+            }
+            if (!get_string(p, end, h.value)) return false;
+            if (indexed) table_.add(h.name, h.value);
+        }
+
+        // the slot is reused for whatever follows an oversized list
+        list += h.name.size() + h.value.size() + ENTRY_OVERHEAD;
+        if (list > max_list_) oversized_ = true;
+        else ++count;
+    }
+    return true;
+}
+
+void HpackEncoder::set_peer_max(size_t max_size) {
+    size_t size = max_size < DEFAULT_TABLE ? max_size : DEFAULT_TABLE;
+    if (size == table_.max_size() && !pending_) return;
+    if (size < pending_min_) pending_min_ = size;
+    table_.set_max_size(size);
+    pending_ = true;
+}
+
+// after a shrink and a regrowth the peer has to evict at the smaller size
+// too, so both are announced
+void HpackEncoder::begin(std::string& out) {
+    if (!pending_) return;
+    if (pending_min_ < table_.max_size()) put_int(out, 0x20, 5, pending_min_);
+    put_int(out, 0x20, 5, table_.max_size());
+    pending_ = false;
+    pending_min_ = SIZE_MAX;
+}
+
+void HpackEncoder::status(std::string& out, int code) {
+    switch (code) {
+        case 200: return put_int(out, 0x80, 7, 8);
+        case 204: return put_int(out, 0x80, 7, 9);
+        case 206: return put_int(out, 0x80, 7, 10);
+        case 304: return put_int(out, 0x80, 7, 11);
+        case 400: return put_int(out, 0x80, 7, 12);
+        case 404: return put_int(out, 0x80, 7, 13);
+        case 500: return put_int(out, 0x80, 7, 14);
+    }
+    char digits[4];
+    int n = code >= 100 && code <= 999 ? 3 : 0;
+    for (int i = n - 1, c = code; i >= 0; --i, c /= 10) digits[i] = '0' + c % 10;
+    put_int(out, 0x00, 4, 8);
+    put_string(out, std::string_view(digits, n));
+}
+
+void HpackEncoder::add(std::string& out, std::string_view name,
+                       std::string_view value) {
+    size_t name_index = 0;
+    for (size_t i = 0; i < table_.count(); ++i) {
+        const HpackHeader& e = table_.at(i);
+        if (e.name != name) continue;
+        if (e.value == value) {
+            put_int(out, 0x80, 7, STATIC_COUNT + 1 + i);
+            return;
+        }
+        if (!name_index) name_index = STATIC_COUNT + 1 + i;
+    }
+    for (size_t i = 0; i < STATIC_COUNT; ++i) {
+        if (name != STATIC_TABLE[i].name) continue;
+        if (value == STATIC_TABLE[i].value) {
+            put_int(out, 0x80, 7, i + 1);
+            return;
+        }
+        name_index = i + 1;
+        break;
+    }
+
+    bool indexed = worth_indexing(name);
+    put_int(out, indexed ? 0x40 : 0x00, indexed ? 6 : 4, name_index);
+    if (!name_index) put_string(out, name);
+    put_string(out, value);
+    if (indexed) table_.add(name, value);
+}
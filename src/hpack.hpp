@@ -0,0 +1,94 @@
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// HPACK header compression (RFC 7541) for HTTP/2: the static table, one
+// dynamic table per direction and Huffman-coded string literals.
+
+struct HpackHeader {
+    std::string name;
+    std::string value;
+};
+
+// The dynamic table of one direction. Entries are evicted oldest first
+// once their size (name + value + 32 each) exceeds the limit.
+class HpackTable {
+public:
+    explicit HpackTable(size_t max_size) : max_size_(max_size) {}
+
+    void add(std::string_view name, std::string_view value);
+    void set_max_size(size_t max_size);
+    size_t max_size() const { return max_size_; }
+
+    size_t count() const { return entries_.size(); }
+    // 0 is the newest entry
+    const HpackHeader& at(size_t i) const { return entries_[i]; }
+
+private:
+    void evict(size_t room);
+
+    std::deque<HpackHeader> entries_;
+    size_t size_ = 0;
+    size_t max_size_;
+};
+
+// Decodes the header blocks of one connection's requests, in the order the
+// peer sent them.
+class HpackDecoder {
+public:
+    // max_table: the SETTINGS_HEADER_TABLE_SIZE we advertise; max_list:
+    // decoded bytes (as the table counts them) kept of one block
+    HpackDecoder(size_t max_table, size_t max_list)
+        : table_(max_table), limit_(max_table), max_list_(max_list) {}
+
+    // Fills out[0, count) with the headers of one complete block; entries
+    // past count keep their storage for the next block. false on a
+    // compression error, after which the connection cannot continue. A
+    // block that decodes past max_list still updates the table but comes
+    // back with oversized() set and fewer headers.
+    bool decode(const uint8_t* p, size_t len, std::vector<HpackHeader>& out,
+                size_t& count);
+    bool oversized() const { return oversized_; }
+
+private:
+    bool lookup(uint64_t index, const HpackHeader*& h) const;
+
+    HpackTable  table_;
+    size_t      limit_;
+    size_t      max_list_;
+    bool        oversized_ = false;
+};
+
+// Encodes response header blocks. Values that change with every response
+// (lengths, validators, dates) are sent as literals without indexing so
+// they do not churn the dynamic table; the rest is indexed and goes out as
+// a single byte the next time.
+class HpackEncoder {
+public:
+    HpackEncoder() : table_(DEFAULT_TABLE) {}
+
+    // the peer's SETTINGS_HEADER_TABLE_SIZE; the table never grows past
+    // DEFAULT_TABLE
+    void set_peer_max(size_t max_size);
+
+    // starts a block, with a table size update if one is owed
+    void begin(std::string& out);
+    void status(std::string& out, int code);
+    // name must be lowercase
+    void add(std::string& out, std::string_view name, std::string_view value);
+
+private:
+    static const size_t DEFAULT_TABLE = 4096;
+
+    HpackTable table_;
+    size_t     pending_min_ = SIZE_MAX;   // smallest size since the last block
+    bool       pending_ = false;
+};
+
+#endif
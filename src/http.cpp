@@ -1,51 +1,50 @@
 #include "http.hpp"
 #include "logger.hpp"
+#include "file_cache.hpp"
+#include "content_cache.hpp"
+#include "site_pack.hpp"
+#include "io_pool.hpp"
+#include "clock.hpp"
+#include "metrics.hpp"
 
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sstream>
-#include <algorithm>
+#include <strings.h>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+// more ranges than this are answered with the whole body
+static const int MAX_RANGES = 16;
 
 static bool contains_dotdot(const std::string& p) {
     return p.find("..") != std::string::npos;
 }
 
-bool parse_request(Connection& c) {
-    auto pos = c.in_buf.find("\r\n\r\n");
-    if (pos == std::string::npos) return false;
-
-    std::istringstream iss(c.in_buf.substr(0, pos));
-    std::string request_line;
-    if (!std::getline(iss, request_line)) return false;
-    if (!request_line.empty() && request_line.back() == '\r')
-        request_line.pop_back();
-
-    std::istringstream rl(request_line);
-    std::string http_version;
-    rl >> c.method >> c.path >> http_version;
-    if (c.method.empty() || c.path.empty()) return false;
-
-    std::string lower_method = c.method;
-    std::transform(lower_method.begin(), lower_method.end(),
-                   lower_method.begin(), ::toupper);
-
-    c.head_only = (lower_method == "HEAD");
+static bool method_is(std::string_view method, const char* name) {
+    size_t n = std::strlen(name);
+    return method.size() == n && !strncasecmp(method.data(), name, n);
+}
 
-    return true;
+ParseStatus parse_request(Connection& c) {
+    ParseStatus st = c.parser.parse(c.in_buf.data(), c.in_buf.size(), c.req);
+    if (st == ParseStatus::COMPLETE)
+        c.head_only = method_is(c.req.method, "HEAD");
+    return st;
 }
 
-std::string build_status_text(int code) {
+const char* build_status_text(int code) {
     switch (code) {
         case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
         case 403: return "Forbidden";
         case 404: return "Not Found";
         case 405: return "Method Not Allowed";
+        case 416: return "Range Not Satisfiable";
         default:  return "Unknown";
     }
 }
 
-std::string get_mime_type(const std::string& path) {
+const char* get_mime_type(const std::string& path) {
     auto dot = path.rfind('.');
     if (dot == std::string::npos) return "application/octet-stream";
     std::string ext = path.substr(dot + 1);
@@ -59,45 +58,712 @@ std::string get_mime_type(const std::string& path) {
     return "application/octet-stream";
 }
 
-static std::string build_headers(int status,
-                                 size_t content_length,
-                                 const std::string& content_type,
-                                 bool keep_alive) {
-    std::ostringstream oss;
-    oss << "HTTP/1.1 " << status << " " << build_status_text(status) << "\r\n";
-    oss << "Content-Length: " << content_length << "\r\n";
-    oss << "Content-Type: " << content_type << "\r\n";
-    oss << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n";
+// Status line and the headers build_headers() always adds, written
+// straight into out; the caller appends its own lines and the blank line.
+// Nothing is allocated once out has room.
+static void append_status_head(std::string& out, int status,
+                               size_t content_length,
+                               std::string_view content_type,
+                               bool keep_alive) {
+    char num[24];
+    out += "HTTP/1.1 ";
+    out.append(num, std::snprintf(num, sizeof(num), "%d ", status));
+    out += build_status_text(status);
+    out += "\r\n";
+    // a 304 describes the cached representation, so it carries no length
+    if (status != 304) {
+        out += "Content-Length: ";
+        out.append(num, std::snprintf(num, sizeof(num), "%zu",
+                                      content_length));
+        out += "\r\nContent-Type: ";
+        out.append(content_type.data(), content_type.size());
+        out += "\r\n";
+    }
+    out += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    if (status == 200 || status == 206) {
+        out += "Accept-Ranges: bytes\r\n";
+    }
     if (status == 405) {
-        oss << "Allow: GET, HEAD\r\n";
+        out += "Allow: GET, HEAD\r\n";
+    }
+}
+
+std::string build_headers(int status,
+                          size_t content_length,
+                          std::string_view content_type,
+                          bool keep_alive,
+                          const std::string& extra) {
+    std::string h;
+    append_status_head(h, status, content_length, content_type, keep_alive);
+    h += extra;
+    h += "\r\n";
+    return h;
+}
+
+// error pages are formatted on the stack: a flood of 404s costs no heap
+static void set_simple_response(Connection& c, int status, const char* msg) {
+    c.status_code = status;
+    char body[256];
+    int len = std::snprintf(body, sizeof(body),
+                            "<html><body><h1>%d %s</h1><p>%s</p></body></html>",
+                            status, build_status_text(status), msg);
+    if (len >= (int)sizeof(body)) len = sizeof(body) - 1;
+    append_status_head(c.out_buf, status, len, "text/html; charset=utf-8",
+                       c.keep_alive);
+    c.out_buf += "\r\n";
+    if (!c.head_only) c.out_buf.append(body, len);
+    c.state = ConnState::SENDING_HEADERS;
+}
+
+// live counters of all workers, read from the shared segment
+static void set_metrics_response(Connection& c) {
+    c.status_code = 200;
+    std::string body = render_metrics();
+    c.out_buf += build_headers(200, body.size(),
+                               "text/plain; version=0.0.4; charset=utf-8",
+                               c.keep_alive, "Cache-Control: no-store\r\n");
+    if (!c.head_only) c.out_buf += body;
+    c.state = ConnState::SENDING_HEADERS;
+}
+
+// true if the comma-separated header value contains token (any case)
+static bool has_token(std::string_view value, const char* token) {
+    size_t n = std::strlen(token);
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+        if (item.size() == n && !strncasecmp(item.data(), token, n))
+            return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+static bool wants_keep_alive(const Connection& c, const ServerConfig& cfg) {
+    if (!cfg.keep_alive) return false;
+    if (cfg.max_keep_alive_requests > 0 &&
+        c.requests + 1 >= cfg.max_keep_alive_requests)
+        return false;
+    // request bodies are not read, so the stream cannot be resynchronised
+    if ((!c.req.content_length.empty() && c.req.content_length != "0") ||
+        !c.req.transfer_encoding.empty())
+        return false;
+    if (has_token(c.req.connection, "close")) return false;
+    if (c.req.version_minor == 0)
+        return has_token(c.req.connection, "keep-alive");
+    return true;
+}
+
+struct ContentCoding {
+    const char* token;
+    const char* suffix;
+};
+
+// served from precompressed siblings; the order breaks q-value ties
+static const ContentCoding CODINGS[] = {
+    {"br",   ".br"},
+    {"zstd", ".zst"},
+    {"gzip", ".gz"},
+};
+static const int CODING_COUNT = sizeof(CODINGS) / sizeof(CODINGS[0]);
+
+bool compressible(const std::string& path) {
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos) return false;
+    const char* ext = path.c_str() + dot + 1;
+    return !strcasecmp(ext, "html") || !strcasecmp(ext, "htm") ||
+           !strcasecmp(ext, "css") || !strcasecmp(ext, "js") ||
+           !strcasecmp(ext, "txt") || !strcasecmp(ext, "svg") ||
+           !strcasecmp(ext, "json") || !strcasecmp(ext, "xml");
+}
+
+const char* precompressed_coding(const std::string& path, size_t& suffix_len) {
+    for (const ContentCoding& cc : CODINGS) {
+        size_t n = std::strlen(cc.suffix);
+        if (path.size() > n &&
+            path.compare(path.size() - n, n, cc.suffix) == 0) {
+            suffix_len = n;
+            return cc.token;
+        }
+    }
+    return nullptr;
+}
+
+// "q=0.5" -> 500; a missing or malformed weight counts as 1
+static int parse_qvalue(std::string_view params) {
+    while (!params.empty()) {
+        size_t semi = params.find(';');
+        std::string_view p = params.substr(0, semi);
+        params = semi == std::string_view::npos ? std::string_view()
+                                                : params.substr(semi + 1);
+        while (!p.empty() && (p.front() == ' ' || p.front() == '\t'))
+            p.remove_prefix(1);
+        if (p.size() < 2 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=')
+            continue;
+        p.remove_prefix(2);
+        if (p.empty() || (p[0] != '0' && p[0] != '1')) return 1000;
+        int q = p[0] == '1' ? 1000 : 0;
+        if (q == 0 && p.size() > 2 && p[1] == '.') {
+            int scale = 100;
+            for (size_t i = 2; i < p.size() && i < 5; ++i) {
+                if (p[i] < '0' || p[i] > '9') break;
+                q += (p[i] - '0') * scale;
+                scale /= 10;
+            }
+        }
+        return q;
+    }
+    return 1000;
+}
+
+// Fills order with the indexes of acceptable CODINGS, best first, and
+// returns how many there are
+static int preferred_codings(std::string_view accept, int* order) {
+    int quality[CODING_COUNT];
+    int star = -1;
+    for (int i = 0; i < CODING_COUNT; ++i) quality[i] = -1;
+
+    while (!accept.empty()) {
+        size_t comma = accept.find(',');
+        std::string_view item = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view()
+                                                 : accept.substr(comma + 1);
+        size_t semi = item.find(';');
+        std::string_view name = item.substr(0, semi);
+        while (!name.empty() && (name.front() == ' ' || name.front() == '\t'))
+            name.remove_prefix(1);
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\t'))
+            name.remove_suffix(1);
+        int q = semi == std::string_view::npos
+                    ? 1000 : parse_qvalue(item.substr(semi + 1));
+        if (name == "*") {
+            star = q;
+            continue;
+        }
+        for (int i = 0; i < CODING_COUNT; ++i) {
+            size_t n = std::strlen(CODINGS[i].token);
+            if (name.size() == n && !strncasecmp(name.data(), CODINGS[i].token, n))
+                quality[i] = q;
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < CODING_COUNT; ++i) {
+        if (quality[i] < 0) quality[i] = star < 0 ? 0 : star;
+        if (quality[i] == 0) continue;
+        int j = count++;
+        while (j > 0 && quality[order[j - 1]] < quality[i]) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+    return count;
+}
+
+// validators are rendered into the caller's buffer, not a new string
+static std::string_view make_etag(const FileMeta& m, bool weak,
+                                  char (&buf)[80]) {
+    unsigned long long mtime_ns =
+        (unsigned long long)m.mtime.tv_sec * 1000000000ULL + m.mtime.tv_nsec;
+    int n = std::snprintf(buf, sizeof(buf), "%s\"%llx-%llx-%llx\"",
+                          weak ? "W/" : "", (unsigned long long)m.ino,
+                          (unsigned long long)m.size, mtime_ns);
+    return std::string_view(buf, n);
+}
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+static std::string_view http_date(time_t t, char (&buf)[40]) {
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    size_t n = std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT",
+                             &tm);
+    return std::string_view(buf, n);
+}
+
+static bool parse_http_date(std::string_view s, time_t& t) {
+    char buf[40];
+    if (s.empty() || s.size() >= sizeof(buf)) return false;
+    std::memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    std::tm tm{};
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end) return false;
+    t = timegm(&tm);
+    return true;
+}
+
+static const std::string* cache_control_for(const std::string& url_path,
+                                            const ServerConfig& cfg) {
+    for (const CacheControlRule& r : cfg.cache_control) {
+        const std::string& m = r.match;
+        if (m[0] == '/') {
+            if (url_path.compare(0, m.size(), m) == 0) return &r.value;
+        } else if (url_path.size() >= m.size() &&
+                   !strcasecmp(url_path.c_str() + url_path.size() - m.size(),
+                               m.c_str())) {
+            return &r.value;
+        }
+    }
+    return nullptr;
+}
+
+static void append_entity_headers(std::string& h, const std::string& url_path,
+                                  const FileMeta& meta, const ServerConfig& cfg,
+                                  const char* coding) {
+    if (coding) {
+        h += "Content-Encoding: ";
+        h += coding;
+        h += "\r\n";
+    }
+    if (cfg.precompressed && compressible(url_path))
+        h += "Vary: Accept-Encoding\r\n";
+    if (cfg.etag != ETagMode::OFF) {
+        char etag[80];
+        h += "ETag: ";
+        h += make_etag(meta, cfg.etag == ETagMode::WEAK, etag);
+        h += "\r\n";
+    }
+    char date[40];
+    h += "Last-Modified: ";
+    h += http_date(meta.mtime.tv_sec, date);
+    h += "\r\n";
+    if (const std::string* cc = cache_control_for(url_path, cfg)) {
+        h += "Cache-Control: ";
+        h += *cc;
+        h += "\r\n";
+    }
+}
+
+std::string entity_headers(const std::string& url_path, const FileMeta& meta,
+                           const ServerConfig& cfg, const char* coding) {
+    std::string h;
+    append_entity_headers(h, url_path, meta, cfg, coding);
+    return h;
+}
+
+// Compares a header value (an entity-tag list or "*") against etag. Weak
+// comparison ignores the W/ prefix; strong comparison never matches a weak tag.
+static bool etag_matches(std::string_view list, std::string_view tag,
+                         bool strong) {
+    if (tag.compare(0, 2, "W/") == 0) {
+        if (strong) return false;
+        tag.remove_prefix(2);
+    }
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view()
+                                               : list.substr(comma + 1);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+        if (item == "*") return true;
+        if (item.compare(0, 2, "W/") == 0) {
+            if (strong) continue;
+            item.remove_prefix(2);
+        }
+        if (item == tag) return true;
+    }
+    return false;
+}
+
+// If-None-Match takes precedence; If-Modified-Since is only consulted
+// without it
+static bool not_modified(const Connection& c, const FileMeta& m,
+                         const ServerConfig& cfg) {
+    if (!c.req.if_none_match.empty()) {
+        if (cfg.etag == ETagMode::OFF) return false;
+        char etag[80];
+        return etag_matches(c.req.if_none_match,
+                            make_etag(m, cfg.etag == ETagMode::WEAK, etag),
+                            false);
+    }
+    time_t since;
+    if (parse_http_date(c.req.if_modified_since, since))
+        return m.mtime.tv_sec <= since;
+    return false;
+}
+
+// If-Range keeps the Range only while the representation is unchanged;
+// it needs a strong validator, so weak ETags always send the whole body
+static bool if_range_holds(const Connection& c, const FileMeta& m,
+                           const ServerConfig& cfg) {
+    std::string_view v = c.req.if_range;
+    if (v.empty()) return true;
+    if (v.front() == '"' || v.compare(0, 2, "W/") == 0) {
+        char etag[80];
+        return cfg.etag == ETagMode::STRONG &&
+               etag_matches(v, make_etag(m, false, etag), true);
+    }
+    time_t t;
+    return parse_http_date(v, t) && t == m.mtime.tv_sec;
+}
+
+static void set_not_modified(Connection& c, const std::string& url_path,
+                             const FileMeta& m, const char* coding,
+                             const ServerConfig& cfg) {
+    c.status_code = 304;
+    append_status_head(c.out_buf, 304, 0, std::string_view(), c.keep_alive);
+    append_entity_headers(c.out_buf, url_path, m, cfg, coding);
+    c.out_buf += "\r\n";
+    c.file_offset = c.file_size = 0;
+    c.state = ConnState::SENDING_HEADERS;
+}
+
+enum class RangeResult {
+    NONE,            // absent or malformed: serve the whole body
+    SATISFIABLE,
+    UNSATISFIABLE
+};
+
+struct ByteRange {
+    off_t start;
+    off_t end;   // exclusive
+};
+
+static bool parse_offset(std::string_view s, off_t& v) {
+    if (s.empty() || s.size() > 18) return false;
+    v = 0;
+    for (char ch : s) {
+        if (ch < '0' || ch > '9') return false;
+        v = v * 10 + (ch - '0');
+    }
+    return true;
+}
+
+// "bytes=a-b, a-, -n" resolved against size; ranges that start past the
+// end are skipped, and only if all of them are does the request fail
+static RangeResult parse_range(std::string_view spec, off_t size,
+                               ByteRange* out, int& count) {
+    count = 0;
+    if (spec.size() < 6 || strncasecmp(spec.data(), "bytes=", 6) != 0)
+        return RangeResult::NONE;
+    spec.remove_prefix(6);
+
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view()
+                                               : spec.substr(comma + 1);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+        if (item.empty()) continue;
+
+        size_t dash = item.find('-');
+        if (dash == std::string_view::npos) return RangeResult::NONE;
+        std::string_view first = item.substr(0, dash);
+        std::string_view last = item.substr(dash + 1);
+
+        ByteRange r;
+        off_t a = 0, b = 0;
+        if (first.empty()) {
+            if (!parse_offset(last, b)) return RangeResult::NONE;
+            if (b == 0) continue;
+            r.start = b < size ? size - b : 0;
+            r.end = size;
+        } else {
+            if (!parse_offset(first, a)) return RangeResult::NONE;
+            if (last.empty()) {
+                b = size - 1;
+            } else if (!parse_offset(last, b) || b < a) {
+                return RangeResult::NONE;
+            }
+            r.start = a;
+            r.end = b < size ? b + 1 : size;
+        }
+        if (r.start >= size) continue;
+        if (count == MAX_RANGES) return RangeResult::NONE;
+        out[count++] = r;
+    }
+    return count > 0 ? RangeResult::SATISFIABLE : RangeResult::UNSATISFIABLE;
+}
+
+static std::string content_range(off_t start, off_t end, off_t size) {
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "Content-Range: bytes %lld-%lld/%lld\r\n",
+                  (long long)start, (long long)end - 1, (long long)size);
+    return buf;
+}
+
+// Answers a Range request with 206 or 416. A single range narrows
+// file_offset/file_size, so the body goes out on the normal memory or
+// sendfile path. Several ranges become multipart/byteranges: from memory
+// the whole body is rendered into out_buf; for files each part is a
+// delimiter block in out_buf followed by its slice of the file, queued in
+// c.parts. Returns false when the whole body should be served instead.
+static bool apply_range(Connection& c, off_t size, std::string_view mime,
+                        const char* mem, const std::string& entity) {
+    ByteRange ranges[MAX_RANGES];
+    int count = 0;
+    RangeResult rr = parse_range(c.req.range, size, ranges, count);
+    if (rr == RangeResult::NONE) return false;
+
+    c.state = ConnState::SENDING_HEADERS;
+    c.file_offset = c.file_size = 0;
+
+    if (rr == RangeResult::UNSATISFIABLE) {
+        c.status_code = 416;
+        c.out_buf += build_headers(416, 0, mime, c.keep_alive,
+                                   "Content-Range: bytes */" +
+                                   std::to_string(size) + "\r\n");
+        return true;
+    }
+
+    c.status_code = 206;
+    if (count == 1) {
+        c.out_buf += build_headers(206, ranges[0].end - ranges[0].start, mime,
+                                   c.keep_alive,
+                                   content_range(ranges[0].start,
+                                                 ranges[0].end, size) +
+                                   entity);
+        c.file_offset = ranges[0].start;
+        c.file_size = ranges[0].end;
+        c.body_mem = mem;
+        return true;
+    }
+
+    static thread_local uint64_t seq = 0;
+    char boundary[40];
+    std::snprintf(boundary, sizeof(boundary), "%016llx%08llx",
+                  (unsigned long long)monotonic_us(),
+                  (unsigned long long)++seq);
+
+    std::vector<RangePart> parts(count);
+    size_t length = 0;
+    for (int i = 0; i < count; ++i) {
+        parts[i].head = std::string("\r\n--") + boundary +
+                        "\r\nContent-Type: ";
+        parts[i].head.append(mime.data(), mime.size());
+        parts[i].head += "\r\n" +
+                         content_range(ranges[i].start, ranges[i].end, size) +
+                         "\r\n";
+        parts[i].start = ranges[i].start;
+        parts[i].end = ranges[i].end;
+        length += parts[i].head.size() + (ranges[i].end - ranges[i].start);
+    }
+    RangePart tail;
+    tail.head = std::string("\r\n--") + boundary + "--\r\n";
+    length += tail.head.size();
+
+    c.out_buf += build_headers(206, length,
+                               std::string("multipart/byteranges; boundary=") +
+                               boundary, c.keep_alive, entity);
+
+    if (mem) {
+        for (const RangePart& p : parts) {
+            c.out_buf += p.head;
+            c.out_buf.append(mem + p.start, p.end - p.start);
+        }
+        c.out_buf += tail.head;
+        return true;
+    }
+
+    c.out_buf += parts[0].head;
+    c.file_offset = parts[0].start;
+    c.file_size = parts[0].end;
+    parts.erase(parts.begin());
+    parts.push_back(std::move(tail));
+    c.parts = std::move(parts);
+    c.next_part = 0;
+    return true;
+}
+
+// coding is set when m is the precompressed sibling of url_path
+static void serve_mem(Connection& c, const std::string& url_path,
+                      const MemEntry* m, const char* coding, bool ranged,
+                      const ServerConfig& cfg) {
+    FileMeta meta;
+    meta.ino = m->ino;
+    meta.size = (off_t)m->size;
+    meta.mtime = m->mtime;
+    if (not_modified(c, meta, cfg)) {
+        set_not_modified(c, url_path, meta, coding, cfg);
+        return;
+    }
+    const char* mime = coding ? get_mime_type(url_path) : m->mime;
+    // a large packed body goes out with sendfile from the pack file
+    bool from_fd = m->fd >= 0 && cfg.zero_copy &&
+                   m->size > cfg.mem_cache_max_file;
+    if (ranged && if_range_holds(c, meta, cfg) &&
+        apply_range(c, meta.size, mime, from_fd ? nullptr : m->body,
+                    entity_headers(url_path, meta, cfg, coding))) {
+        if (from_fd && c.status_code == 206) {
+            // the ranges were resolved against the body, which starts at
+            // m->offset in the pack
+            c.file_fd = m->fd;
+            c.file_offset += m->offset;
+            c.file_size += m->offset;
+            for (RangePart& p : c.parts) {
+                p.start += m->offset;
+                p.end += m->offset;
+            }
+        }
+        return;
+    }
+
+    c.status_code = 200;
+    c.file_offset = 0;
+    int ka = c.keep_alive ? 1 : 0;
+    const char* headers = coding ? m->encoded_headers[ka] : m->headers[ka];
+    if (c.head_only || !headers) {
+        append_status_head(c.out_buf, 200, c.head_only ? 0 : m->size, mime,
+                           c.keep_alive);
+        append_entity_headers(c.out_buf, url_path, meta, cfg, coding);
+        c.out_buf += "\r\n";
+    } else {
+        c.out_buf.append(headers, coding ? m->encoded_headers_len[ka]
+                                         : m->headers_len[ka]);
+    }
+    if (c.head_only) {
+        c.file_size = 0;
+    } else if (from_fd) {
+        c.file_fd = m->fd;
+        c.file_offset = m->offset;
+        c.file_size = m->offset + (off_t)m->size;
+    } else {
+        c.body_mem = m->body;
+        c.file_size = (off_t)m->size;
+    }
+    c.state = ConnState::SENDING_HEADERS;
+}
+
+static void serve_file(Connection& c, const std::string& url_path,
+                       std::shared_ptr<CachedFile> f, const char* coding,
+                       bool ranged, const ServerConfig& cfg) {
+    FileMeta meta;
+    meta.ino = f->ino;
+    meta.size = f->size;
+    meta.mtime = f->mtime;
+    std::string_view mime = coding ? std::string_view(get_mime_type(url_path))
+                                   : std::string_view(f->mime);
+
+    if (ranged && if_range_holds(c, meta, cfg) &&
+        apply_range(c, f->size, mime, nullptr,
+                    entity_headers(url_path, meta, cfg, coding))) {
+        if (c.status_code == 206) {
+            c.file_fd = f->fd;
+            c.file = std::move(f);
+        }
+        return;
     }
-    oss << "\r\n";
-    return oss.str();
+
+    c.status_code = 200;
+    c.file_size = f->size;
+    c.file_offset = 0;
+
+    if (c.head_only) {
+        append_status_head(c.out_buf, 200, 0, mime, c.keep_alive);
+        append_entity_headers(c.out_buf, url_path, meta, cfg, coding);
+        c.out_buf += "\r\n";
+    } else {
+        int ka = c.keep_alive ? 1 : 0;
+        std::string& headers = coding ? f->encoded_headers[ka] : f->headers[ka];
+        if (headers.empty())
+            headers = build_headers(200, (size_t)f->size, mime, c.keep_alive,
+                                    entity_headers(url_path, meta, cfg, coding));
+        c.out_buf += headers;
+        c.file_fd = f->fd;
+        c.file = std::move(f);
+    }
+
+    c.state = ConnState::SENDING_HEADERS;
+}
+
+// Serves url_path + suffix with Content-Encoding if that sibling exists.
+// Missing siblings are remembered by the file cache, so negotiation costs
+// no syscalls on hot paths.
+static bool serve_variant(Connection& c, const std::string& url_path,
+                          const ContentCoding& cc, bool ranged,
+                          bool conditional, const ServerConfig& cfg) {
+    // reused across requests, like url_path
+    static thread_local std::string path;
+    path.assign(url_path).append(cc.suffix);
+    if (site_pack().loaded()) {
+        const MemEntry* m = site_pack().find(path);
+        if (!m) return false;
+        serve_mem(c, url_path, m, cc.token, ranged, cfg);
+        return true;
+    }
+    if (const MemEntry* m = content_cache().get(path, cfg.doc_root)) {
+        serve_mem(c, url_path, m, cc.token, ranged, cfg);
+        return true;
+    }
+
+    FileMeta meta;
+    if (conditional) {
+        if (!file_cache().lookup_meta(path, cfg.doc_root, meta)) return false;
+        if ((size_t)meta.size <= cfg.max_file_size &&
+            not_modified(c, meta, cfg)) {
+            set_not_modified(c, url_path, meta, cc.token, cfg);
+            return true;
+        }
+    }
+
+    int status = 0;
+    std::shared_ptr<CachedFile> f = file_cache().get(path, cfg.doc_root,
+                                                     status);
+    if (!f || (size_t)f->size > cfg.max_file_size) return false;
+    serve_file(c, url_path, std::move(f), cc.token, ranged, cfg);
+    return true;
 }
 
-static std::string build_simple_html(int status, const std::string& msg) {
-    return "<html><body><h1>" + std::to_string(status) + " " +
-           build_status_text(status) + "</h1><p>" + msg + "</p></body></html>";
+// Paths the response may be served from (negotiated siblings, then
+// url_path) that neither cache can answer without a syscall are stat'ed and
+// opened by the I/O pool while the request waits. A pipelined request
+// behind responses already batched is answered inline, as is one whose
+// paths were just resolved.
+static bool defer_to_io_pool(Connection& c, const std::string& url_path,
+                             const int* order, int n,
+                             const ServerConfig& cfg) {
+    if (c.io_resolved || !io_pool().running() || !c.out_buf.empty() ||
+        !c.batched.empty())
+        return false;
+
+    static thread_local std::vector<std::string> cold;
+    static thread_local std::string path;
+    cold.clear();
+    auto check = [&](const std::string& p) {
+        if (!content_cache().holds(p) && file_cache().cold(p))
+            cold.push_back(p);
+    };
+    for (int i = 0; i < n; ++i) {
+        path.assign(url_path).append(CODINGS[order[i]].suffix);
+        check(path);
+    }
+    check(url_path);
+    if (cold.empty()) return false;
+
+    c.io_ticket = io_pool().resolve(c.fd, cfg.doc_root, cold);
+    return true;
 }
 
+// Appends the response to out_buf: pipelined responses that are already
+// buffered may precede it. false when the request was parked on the I/O
+// pool instead (see defer_to_io_pool); nothing is appended then.
 bool prepare_response(Connection& c, const ServerConfig& cfg) {
-    std::string method = c.method;
-    std::transform(method.begin(), method.end(),
-                   method.begin(), ::toupper);
-
-    c.keep_alive = cfg.keep_alive_default;
-
-    if (method != "GET" && method != "HEAD") {
-        c.status_code = 405;
-        std::string body = build_simple_html(405, "Method not allowed");
-        c.out_buf = build_headers(405, body.size(), "text/html; charset=utf-8",
-                                  c.keep_alive);
-        if (!c.head_only) c.out_buf += body;
-        c.state = ConnState::SENDING_HEADERS;
+    c.keep_alive = wants_keep_alive(c, cfg);
+
+    if (!c.head_only && !method_is(c.req.method, "GET")) {
+        set_simple_response(c, 405, "Method not allowed");
         return true;
     }
 
-    std::string url_path = c.path;
+    std::string_view target = c.req.target;
+    size_t query = target.find('?');
+    if (query != std::string_view::npos) target = target.substr(0, query);
+
+    // a long path would otherwise cost an allocation per request
+    static thread_local std::string url_path;
+    url_path.assign(target.data(), target.size());
     if (url_path.empty() || url_path[0] != '/') {
         url_path = "/";
     }
@@ -106,72 +772,70 @@ bool prepare_response(Connection& c, const ServerConfig& cfg) {
     }
 
     if (contains_dotdot(url_path)) {
-        c.status_code = 403;
-        std::string body = build_simple_html(403, "Forbidden");
-        c.out_buf = build_headers(403, body.size(), "text/html; charset=utf-8",
-                                  c.keep_alive);
-        if (!c.head_only) c.out_buf += body;
-        c.state = ConnState::SENDING_HEADERS;
+        set_simple_response(c, 403, "Forbidden");
         return true;
     }
 
-    std::string fs_path = cfg.doc_root + url_path;
-
-    struct stat st{};
-    if (stat(fs_path.c_str(), &st) != 0) {
-        c.status_code = 404;
-        std::string body = build_simple_html(404, "Not found");
-        c.out_buf = build_headers(404, body.size(), "text/html; charset=utf-8",
-                                  c.keep_alive);
-        if (!c.head_only) c.out_buf += body;
-        c.state = ConnState::SENDING_HEADERS;
+    if (!cfg.metrics_path.empty() && url_path == cfg.metrics_path) {
+        set_metrics_response(c);
         return true;
     }
 
-    if (!S_ISREG(st.st_mode)) {
-        c.status_code = 403;
-        std::string body = build_simple_html(403, "Forbidden");
-        c.out_buf = build_headers(403, body.size(), "text/html; charset=utf-8",
-                                  c.keep_alive);
-        if (!c.head_only) c.out_buf += body;
-        c.state = ConnState::SENDING_HEADERS;
+    bool ranged = !c.head_only && !c.req.range.empty();
+    bool conditional = !c.req.if_none_match.empty() ||
+                       !c.req.if_modified_since.empty();
+
+    int order[CODING_COUNT];
+    int n = 0;
+    if (cfg.precompressed && !c.req.accept_encoding.empty() &&
+        compressible(url_path))
+        n = preferred_codings(c.req.accept_encoding, order);
+
+    if (!site_pack().loaded() && defer_to_io_pool(c, url_path, order, n, cfg))
+        return false;
+
+    for (int i = 0; i < n; ++i) {
+        if (serve_variant(c, url_path, CODINGS[order[i]], ranged,
+                          conditional, cfg))
+            return true;
+    }
+
+    // a loaded pack is the whole site; doc_root is not looked at
+    if (site_pack().loaded()) {
+        if (const MemEntry* m = site_pack().find(url_path))
+            serve_mem(c, url_path, m, nullptr, ranged, cfg);
+        else
+            set_simple_response(c, 404, "Not found");
         return true;
     }
 
-    if ((size_t)st.st_size > cfg.max_file_size) {
-        c.status_code = 403;
-        std::string body = build_simple_html(403, "File too large");
-        c.out_buf = build_headers(403, body.size(), "text/html; charset=utf-8",
-                                  c.keep_alive);
-        if (!c.head_only) c.out_buf += body;
-        c.state = ConnState::SENDING_HEADERS;
+    if (const MemEntry* m = content_cache().get(url_path, cfg.doc_root)) {
+        serve_mem(c, url_path, m, nullptr, ranged, cfg);
         return true;
     }
 
-    c.file_size = st.st_size;
-    c.file_offset = 0;
+    // revalidations are answered from metadata, without opening the file
+    FileMeta meta;
+    if (conditional && file_cache().lookup_meta(url_path, cfg.doc_root, meta) &&
+        (size_t)meta.size <= cfg.max_file_size && not_modified(c, meta, cfg)) {
+        set_not_modified(c, url_path, meta, nullptr, cfg);
+        return true;
+    }
 
-    std::string mime = get_mime_type(fs_path);
-    c.status_code = 200;
+    int status = 0;
+    std::shared_ptr<CachedFile> f = file_cache().get(url_path, cfg.doc_root,
+                                                     status);
+    if (!f) {
+        set_simple_response(c, status,
+                            status == 404 ? "Not found" : "Forbidden");
+        return true;
+    }
 
-    size_t content_len = c.head_only ? 0 : static_cast<size_t>(c.file_size);
-    c.out_buf = build_headers(200, content_len, mime, c.keep_alive);
-    c.out_sent = 0;
-
-    if (!c.head_only) {
-        c.file_fd = ::open(fs_path.c_str(), O_RDONLY);
-        if (c.file_fd < 0) {
-            c.status_code = 404;
-            std::string body = build_simple_html(404, "Not found");
-            c.out_buf = build_headers(404, body.size(),
-                                      "text/html; charset=utf-8",
-                                      c.keep_alive);
-            if (!c.head_only) c.out_buf += body;
-            c.file_size = 0;
-            c.file_offset = 0;
-        }
+    if ((size_t)f->size > cfg.max_file_size) {
+        set_simple_response(c, 403, "File too large");
+        return true;
     }
 
-    c.state = ConnState::SENDING_HEADERS;
+    serve_file(c, url_path, std::move(f), nullptr, ranged, cfg);
     return true;
 }
@@ -2,12 +2,33 @@
 #define HTTP_HPP
 
 #include <string>
+#include <string_view>
 #include "connection.hpp"
 #include "config.hpp"
+#include "file_cache.hpp"
 
-bool parse_request(Connection& c);
-std::string build_status_text(int code);
-std::string get_mime_type(const std::string& path);
+// resumes parsing in_buf; on COMPLETE c.req and c.head_only are set
+ParseStatus parse_request(Connection& c);
+const char* build_status_text(int code);
+const char* get_mime_type(const std::string& path);
+// extra: complete header lines ("Name: value\r\n") added to the block
+std::string build_headers(int status,
+                          size_t content_length,
+                          std::string_view content_type,
+                          bool keep_alive,
+                          const std::string& extra = std::string());
+
+// text types that are worth serving from precompressed siblings
+bool compressible(const std::string& path);
+// the content coding ("br", "zstd", "gzip") of a precompressed sibling
+// such as "/app.js.br", or nullptr
+const char* precompressed_coding(const std::string& path, size_t& suffix_len);
+
+// Vary, ETag, Last-Modified and Cache-Control lines for url_path, plus
+// Content-Encoding when coding is set
+std::string entity_headers(const std::string& url_path, const FileMeta& meta,
+                           const ServerConfig& cfg,
+                           const char* coding = nullptr);
 
 bool prepare_response(Connection& c, const ServerConfig& cfg);
 
@@ -0,0 +1,137 @@
+#include "io_pool.hpp"
+#include "file_cache.hpp"
+#include "doc_watch.hpp"
+
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+IoPool::~IoPool() {
+    stop();
+}
+
+bool IoPool::start(size_t threads) {
+    stop();
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) return false;
+
+    // signals stay with the event loops
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    stopping_ = false;
+    for (size_t i = 0; i < threads; ++i)
+        threads_.emplace_back(&IoPool::run, this);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    return true;
+}
+
+void IoPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& t : threads_) t.join();
+    threads_.clear();
+    queue_.clear();
+    done_.clear();
+    if (event_fd_ >= 0) ::close(event_fd_);
+    event_fd_ = -1;
+}
+
+void IoPool::submit(IoJob&& job) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        queue_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+}
+
+uint64_t IoPool::resolve(int conn_fd, const std::string& doc_root,
+                         const std::vector<std::string>& url_paths) {
+    IoJob job;
+    job.kind = IoJob::RESOLVE;
+    job.conn_fd = conn_fd;
+    job.ticket = ++next_ticket_;
+    job.doc_root = doc_root;
+    job.paths.resize(url_paths.size());
+    for (size_t i = 0; i < url_paths.size(); ++i)
+        job.paths[i].url_path = url_paths[i];
+    uint64_t ticket = job.ticket;
+    submit(std::move(job));
+    return ticket;
+}
+
+void IoPool::readahead(std::shared_ptr<CachedFile> file, int fd, off_t offset,
+                       off_t len) {
+    IoJob job;
+    job.kind = IoJob::READAHEAD;
+    job.file = std::move(file);
+    job.fd = fd;
+    job.offset = offset;
+    job.len = len;
+    submit(std::move(job));
+}
+
+void IoPool::collect(std::vector<IoJob>& done) {
+    uint64_t n;
+    while (::read(event_fd_, &n, sizeof(n)) > 0) {}
+    std::lock_guard<std::mutex> lock(mu_);
+    done.swap(done_);
+}
+
+static void resolve_paths(IoJob& job) {
+    std::string fs_path;
+    for (ResolvedPath& p : job.paths) {
+        fs_path.assign(job.doc_root).append(p.url_path);
+        p.file = open_file(fs_path, p.status);
+        if (!p.file) continue;
+        // start reading the head of the body before the loop sends it; a
+        // large file is also marked sequential for a wider kernel read-ahead
+        off_t head = p.file->size < READAHEAD_WINDOW ? p.file->size
+                                                     : READAHEAD_WINDOW;
+        if (p.file->size >= READAHEAD_MIN)
+            posix_fadvise(p.file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (head > 0)
+            posix_fadvise(p.file->fd, 0, head, POSIX_FADV_WILLNEED);
+    }
+}
+
+void IoPool::run() {
+    for (;;) {
+        IoJob job;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        if (job.kind == IoJob::READAHEAD) {
+            posix_fadvise(job.fd, job.offset, job.len, POSIX_FADV_WILLNEED);
+            continue;
+        }
+
+        job.generation = doc_generation();
+        resolve_paths(job);
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            wake = done_.empty();
+            done_.push_back(std::move(job));
+        }
+        if (wake) {
+            uint64_t one = 1;
+            ssize_t r = ::write(event_fd_, &one, sizeof(one));
+            (void)r;
+        }
+    }
+}
+
+IoPool& io_pool() {
+    static thread_local IoPool pool;
+    return pool;
+}
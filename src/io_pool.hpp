@@ -0,0 +1,87 @@
+#ifndef IO_POOL_HPP
+#define IO_POOL_HPP
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CachedFile;
+
+// What a pool thread found for one URL path under doc_root.
+struct ResolvedPath {
+    std::string                 url_path;
+    std::shared_ptr<CachedFile> file;   // nullptr: status says why
+    int                         status = 0;
+};
+
+struct IoJob {
+    enum Kind { RESOLVE, READAHEAD };
+
+    Kind     kind = RESOLVE;
+    // RESOLVE: the connection parked on it, and the paths to stat and open
+    int      conn_fd = -1;
+    uint64_t ticket = 0;
+    std::string doc_root;
+    std::vector<ResolvedPath> paths;
+    uint64_t generation = 0;   // doc_generation() before the paths were opened
+    // READAHEAD: [offset, offset + len) of fd; file keeps fd open meanwhile
+    std::shared_ptr<CachedFile> file;
+    int      fd = -1;
+    off_t    offset = 0;
+    off_t    len = 0;
+};
+
+// Bytes of a large body the pool asks the kernel to read ahead of the send
+// position, and the smallest body worth doing it for.
+const off_t READAHEAD_WINDOW = 2 * 1024 * 1024;
+const off_t READAHEAD_MIN    = 1024 * 1024;
+
+// A few threads next to one event loop that make the blocking filesystem
+// calls for it: stat()/open() of files the file cache cannot answer, and
+// posix_fadvise() read-ahead of large bodies. A finished RESOLVE job is
+// handed back through an eventfd the loop watches, and the connection
+// waiting for it carries on. READAHEAD jobs complete silently.
+class IoPool {
+public:
+    ~IoPool();
+
+    bool start(size_t threads);
+    void stop();
+    bool running() const { return !threads_.empty(); }
+    int  event_fd() const { return event_fd_; }
+
+    // returns the ticket that comes back with the finished job
+    uint64_t resolve(int conn_fd, const std::string& doc_root,
+                     const std::vector<std::string>& url_paths);
+    void readahead(std::shared_ptr<CachedFile> file, int fd, off_t offset,
+                   off_t len);
+
+    // moves the finished RESOLVE jobs into done; call when event_fd is
+    // readable
+    void collect(std::vector<IoJob>& done);
+
+private:
+    void run();
+    void submit(IoJob&& job);
+
+    std::mutex               mu_;
+    std::condition_variable  cv_;
+    std::deque<IoJob>        queue_;
+    std::vector<IoJob>       done_;
+    bool                     stopping_ = false;
+    std::vector<std::thread> threads_;
+    int                      event_fd_ = -1;
+    uint64_t                 next_ticket_ = 0;
+};
+
+// one per event-loop thread, started by the loop that uses it
+IoPool& io_pool();
+
+#endif
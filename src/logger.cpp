@@ -3,36 +3,225 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <ctime>
 #include <cstring>
-#include <sstream>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-static int g_log_fd = -1;
+namespace {
 
-void init_logger(const std::string& path) {
-    g_log_fd = ::open(path.c_str(),
-                      O_WRONLY | O_CREAT | O_APPEND,
-                      0644);
+enum Channel {
+    CH_SERVER,
+    CH_ACCESS,
+    CH_COUNT
+};
+
+const size_t RING_SIZE = 1 << 20;   // per thread and channel
+const size_t MAX_LINE  = 4096;
+const int    FLUSH_INTERVAL_MS = 10;
+
+// Single-producer single-consumer byte ring. The event-loop thread that
+// owns it appends whole lines; the flusher thread drains them.
+struct LogRing {
+    char buf[RING_SIZE];
+    std::atomic<uint64_t> head{0};   // advanced by the flusher
+    std::atomic<uint64_t> tail{0};   // advanced by the owner
+    std::atomic<uint64_t> dropped{0};
+
+    bool push(const char* data, size_t len) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        if (RING_SIZE - (t - h) < len) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        size_t off = t % RING_SIZE;
+        size_t first = RING_SIZE - off < len ? RING_SIZE - off : len;
+        std::memcpy(buf + off, data, first);
+        std::memcpy(buf, data + first, len - first);
+        tail.store(t + len, std::memory_order_release);
+        return true;
+    }
+};
+
+int g_fd[CH_COUNT] = {-1, -1};
+pid_t g_pid = 0;
+
+std::mutex g_rings_mutex;
+std::vector<std::unique_ptr<LogRing>> g_rings[CH_COUNT];
+std::atomic<bool> g_async{false};
+std::atomic<bool> g_stop{false};
+std::thread g_flusher;
+uint64_t g_reported_drops = 0;
+
+thread_local LogRing* tl_ring[CH_COUNT] = {nullptr, nullptr};
+thread_local time_t   tl_stamp_sec = 0;
+thread_local char     tl_stamp[32];
+thread_local char     tl_line[MAX_LINE];
+
+// "YYYY-MM-DD HH:MM:SS", formatted once per second per thread
+const char* timestamp() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != tl_stamp_sec) {
+        tl_stamp_sec = ts.tv_sec;
+        std::tm tm{};
+        localtime_r(&tl_stamp_sec, &tm);
+        std::strftime(tl_stamp, sizeof(tl_stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+    return tl_stamp;
+}
+
+LogRing* thread_ring(Channel ch) {
+    if (!tl_ring[ch]) {
+        std::unique_ptr<LogRing> r(new LogRing());
+        tl_ring[ch] = r.get();
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        g_rings[ch].push_back(std::move(r));
+    }
+    return tl_ring[ch];
+}
+
+void emit(Channel ch, const char* line, size_t len) {
+    if (g_fd[ch] < 0) return;
+    if (g_async.load(std::memory_order_relaxed))
+        thread_ring(ch)->push(line, len);
+    else
+        ::write(g_fd[ch], line, len);
+}
+
+// drains every ring of a channel with one writev per IOV_MAX chunk
+void flush_channel(Channel ch) {
+    std::vector<iovec> iov;
+    std::vector<std::pair<LogRing*, uint64_t>> done;
+    {
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        for (auto& r : g_rings[ch]) {
+            uint64_t h = r->head.load(std::memory_order_relaxed);
+            uint64_t t = r->tail.load(std::memory_order_acquire);
+            if (h == t) continue;
+            size_t off = h % RING_SIZE;
+            size_t len = t - h;
+            size_t first = RING_SIZE - off < len ? RING_SIZE - off : len;
+            iov.push_back(iovec{r->buf + off, first});
+            if (len > first) iov.push_back(iovec{r->buf, len - first});
+            done.emplace_back(r.get(), t);
+        }
+    }
+    if (iov.empty()) return;
+
+    size_t i = 0;
+    while (i < iov.size()) {
+        int cnt = (int)(iov.size() - i < 1024 ? iov.size() - i : 1024);
+        ssize_t n = ::writev(g_fd[ch], &iov[i], cnt);
+        if (n < 0) break;
+        // a short write on a regular file means the disk is full; the rest
+        // of the batch is dropped rather than retried forever
+        i += cnt;
+    }
+    for (auto& d : done)
+        d.first->head.store(d.second, std::memory_order_release);
+}
+
+uint64_t total_dropped() {
+    uint64_t n = 0;
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    for (int ch = 0; ch < CH_COUNT; ++ch)
+        for (auto& r : g_rings[ch])
+            n += r->dropped.load(std::memory_order_relaxed);
+    return n;
+}
+
+void report_drops() {
+    uint64_t dropped = total_dropped();
+    if (dropped == g_reported_drops) return;
+    char line[160];
+    int len = std::snprintf(line, sizeof(line),
+                            "%s [ERROR] pid %d log ring full, dropped %llu "
+                            "records\n", timestamp(), (int)g_pid,
+                            (unsigned long long)(dropped - g_reported_drops));
+    g_reported_drops = dropped;
+    if (g_fd[CH_SERVER] >= 0) ::write(g_fd[CH_SERVER], line, len);
 }
 
-static void log_write(const std::string& level, const std::string& msg) {
-    if (g_log_fd < 0) return;
+void flusher_main() {
+    for (;;) {
+        bool stopping = g_stop.load(std::memory_order_acquire);
+        for (int ch = 0; ch < CH_COUNT; ++ch) {
+            if (g_fd[ch] >= 0) flush_channel((Channel)ch);
+        }
+        report_drops();
+        if (stopping) return;
+        timespec ts{0, FLUSH_INTERVAL_MS * 1000000L};
+        nanosleep(&ts, nullptr);
+    }
+}
+
+void log_write(const char* level, const std::string& msg) {
+    if (g_fd[CH_SERVER] < 0) return;
 
-    std::time_t t = std::time(nullptr);
-    std::tm tm{};
-    localtime_r(&t, &tm);
+    size_t len = (size_t)std::snprintf(tl_line, MAX_LINE, "%s [%s] pid %d ",
+                                       timestamp(), level, (int)g_pid);
+    size_t room = MAX_LINE - 1 - len;
+    size_t n = msg.size() < room ? msg.size() : room;
+    std::memcpy(tl_line + len, msg.data(), n);
+    len += n;
+    tl_line[len++] = '\n';
+    emit(CH_SERVER, tl_line, len);
+}
+
+size_t append_uint(char* p, uint64_t v) {
+    char tmp[24];
+    size_t n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    for (size_t i = 0; i < n; ++i) p[i] = tmp[n - 1 - i];
+    return n;
+}
+
+size_t append_str(char* p, size_t room, std::string_view s) {
+    size_t n = s.size() < room ? s.size() : room;
+    std::memcpy(p, s.data(), n);
+    return n;
+}
+
+}
 
-    char timebuf[64];
-    std::strftime(timebuf, sizeof(timebuf),
-                  "%Y-%m-%d %H:%M:%S", &tm);
+void init_logger(const std::string& path, const std::string& access_path) {
+    g_pid = getpid();
+    for (int ch = 0; ch < CH_COUNT; ++ch) {
+        if (g_fd[ch] >= 0) ::close(g_fd[ch]);
+        g_fd[ch] = -1;
+    }
+    g_fd[CH_SERVER] = ::open(path.c_str(),
+                             O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                             0644);
+    if (!access_path.empty())
+        g_fd[CH_ACCESS] = ::open(access_path.c_str(),
+                                 O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                 0644);
+}
 
-    std::ostringstream oss;
-    oss << timebuf << " [" << level << "] "
-        << "pid " << getpid() << " "
-        << msg << "\n";
-    std::string line = oss.str();
+void start_async_logger() {
+    g_pid = getpid();
+    if (g_async.load()) return;
+    g_stop = false;
+    g_async = true;
+    g_flusher = std::thread(flusher_main);
+}
 
-    ::write(g_log_fd, line.data(), line.size());
+void stop_async_logger() {
+    if (!g_async.load()) return;
+    g_stop.store(true, std::memory_order_release);
+    g_flusher.join();
+    g_async = false;
 }
 
 void log_info(const std::string& msg) {
@@ -42,3 +231,36 @@ void log_info(const std::string& msg) {
 void log_error(const std::string& msg) {
     log_write("ERROR", msg);
 }
+
+bool access_log_enabled() {
+    return g_fd[CH_ACCESS] >= 0;
+}
+
+// logfmt: "<time> pid=N method=GET path=/x status=200 bytes=N us=N"
+void log_access(std::string_view method, std::string_view path,
+                int status, uint64_t bytes, int64_t duration_us) {
+    if (g_fd[CH_ACCESS] < 0) return;
+
+    // path is capped so that the fixed fields always fit
+    const size_t path_room = MAX_LINE - 256;
+    char* p = tl_line;
+    p += append_str(p, 32, timestamp());
+    p += append_str(p, 5, " pid=");
+    p += append_uint(p, (uint64_t)g_pid);
+    p += append_str(p, 8, " method=");
+    p += append_str(p, 16, method.empty() ? std::string_view("-") : method);
+    p += append_str(p, 6, " path=");
+    p += append_str(p, path_room, path.empty() ? std::string_view("-") : path);
+    p += append_str(p, 8, " status=");
+    p += append_uint(p, (uint64_t)status);
+    p += append_str(p, 7, " bytes=");
+    p += append_uint(p, bytes);
+    p += append_str(p, 4, " us=");
+    p += append_uint(p, duration_us > 0 ? (uint64_t)duration_us : 0);
+    *p++ = '\n';
+    emit(CH_ACCESS, tl_line, p - tl_line);
+}
+
+uint64_t log_dropped() {
+    return total_dropped();
+}
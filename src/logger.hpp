@@ -2,9 +2,28 @@
 #define LOGGER_HPP
 
 #include <string>
+#include <string_view>
+#include <cstdint>
+
+// access_path may be empty to disable the access log; calling it again
+// reopens both files (SIGHUP), not to be used once logging is async
+void init_logger(const std::string& path,
+                 const std::string& access_path = std::string());
+
+// Switches this process to asynchronous logging: records are appended to a
+// per-thread lock-free ring and written out in batches by a background
+// thread. Call in each worker after fork; stop flushes what is left.
+void start_async_logger();
+void stop_async_logger();
 
-void init_logger(const std::string& path);
 void log_info(const std::string& msg);
 void log_error(const std::string& msg);
 
+bool access_log_enabled();
+void log_access(std::string_view method, std::string_view path,
+                int status, uint64_t bytes, int64_t duration_us);
+
+// records lost because a ring was full
+uint64_t log_dropped();
+
 #endif
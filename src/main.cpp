@@ -2,27 +2,31 @@
 #include "config.hpp"
 
 #include <iostream>
-#include <cstring>
-#include <cstdlib>
 
 int main(int argc, char* argv[]) {
     ServerConfig cfg;
 
-    for (int i = 1; i < argc; ++i) {
-        if (!std::strcmp(argv[i], "--port") && i + 1 < argc) {
-            cfg.port = static_cast<uint16_t>(std::atoi(argv[++i]));
-        } else if (!std::strcmp(argv[i], "--root") && i + 1 < argc) {
-            cfg.doc_root = argv[++i];
-        } else if (!std::strcmp(argv[i], "--log") && i + 1 < argc) {
-            cfg.log_path = argv[++i];
-        } else if (!std::strcmp(argv[i], "--workers") && i + 1 < argc) {
-            cfg.workers = std::atoi(argv[++i]);
-        } else {
-            std::cerr << "Usage: " << argv[0]
-                      << " [--port N] [--root DIR] [--log FILE] [--workers N]\n";
-            return 1;
-        }
+    if (!parse_config(argc, argv, cfg)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--config FILE] [--port N] [--root DIR] [--pack FILE]"
+                  << " [--log FILE] [--access-log FILE]"
+                  << " [--workers N|auto] [--threads N|auto]"
+                  << " [--cpu-affinity on|off] [--io-threads N]"
+                  << " [--engine epoll|pselect|uring] [--sendfile on|off]"
+                  << " [--tx-quantum BYTES] [--tx-budget BYTES]"
+                  << " [--file-cache N] [--cache-ttl MS] [--watch on|off]"
+                  << " [--mem-cache BYTES] [--mem-cache-max-file BYTES]"
+                  << " [--backlog N] [--max-connections N] [--reuseport]"
+                  << " [--keep-alive on|off] [--max-requests N]"
+                  << " [--http2 on|off] [--h2-streams N]"
+                  << " [--keep-alive-timeout MS] [--header-timeout MS]"
+                  << " [--send-timeout MS] [--min-send-rate BYTES]"
+                  << " [--drain-timeout MS]"
+                  << " [--metrics-path PATH|off]"
+                  << " [--precompressed on|off] [--etag strong|weak|off]"
+                  << " [--cache-control /PREFIX|.EXT=VALUE]...\n";
+        return 1;
     }
 
-    return run_server(cfg);
+    return run_server(cfg, argv);
 }
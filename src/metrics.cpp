@@ -0,0 +1,264 @@
+#include "metrics.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdarg>
+#include <cstdio>
+#include <new>
+
+namespace {
+
+WorkerMetrics* g_slots = nullptr;
+int            g_workers = 0;
+thread_local WorkerMetrics* g_self = nullptr;   // one slot per loop thread
+
+template <typename T>
+inline void bump(std::atomic<T>& v, T n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline int bucket_of(int64_t us) {
+    if (us <= 0) return 0;
+    int b = 64 - __builtin_clzll((unsigned long long)us);
+    return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+}
+
+// slots that never had a worker are left out of the exposition
+inline bool used(int w) {
+    return g_slots[w].pid.load(std::memory_order_relaxed) != 0;
+}
+
+inline uint64_t load(const std::atomic<uint64_t>& v) {
+    return v.load(std::memory_order_relaxed);
+}
+
+void append(std::string& out, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void append(std::string& out, const char* fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) out.append(buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+void header(std::string& out, const char* name, const char* type,
+            const char* help) {
+    append(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void histogram(std::string& out, const char* name, int worker,
+               const std::atomic<uint64_t>* buckets,
+               const std::atomic<uint64_t>& sum_us) {
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRICS_BUCKETS - 1; ++i) {
+        cumulative += load(buckets[i]);
+        append(out, "%s_bucket{worker=\"%d\",le=\"%g\"} %llu\n", name, worker,
+               (double)(1ULL << i) / 1e6, (unsigned long long)cumulative);
+    }
+    cumulative += load(buckets[METRICS_BUCKETS - 1]);
+    append(out, "%s_bucket{worker=\"%d\",le=\"+Inf\"} %llu\n", name, worker,
+           (unsigned long long)cumulative);
+    append(out, "%s_sum{worker=\"%d\"} %.6f\n", name, worker,
+           load(sum_us) / 1e6);
+    append(out, "%s_count{worker=\"%d\"} %llu\n", name, worker,
+           (unsigned long long)cumulative);
+}
+
+}
+
+bool init_metrics(int slots) {
+    if (slots <= 0) return false;
+    size_t len = sizeof(WorkerMetrics) * (size_t)slots;
+    void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return false;
+    g_slots = static_cast<WorkerMetrics*>(mem);
+    for (int i = 0; i < slots; ++i) new (&g_slots[i]) WorkerMetrics();
+    g_workers = slots;
+    return true;
+}
+
+void attach_metrics(int slot) {
+    if (!g_slots || slot < 0 || slot >= g_workers) return;
+    g_self = &g_slots[slot];
+    g_self->active.store(0, std::memory_order_relaxed);
+    g_self->accept_paused.store(0, std::memory_order_relaxed);
+    g_self->pid.store(getpid(), std::memory_order_relaxed);
+}
+
+void metrics_request(int status, uint64_t bytes, int64_t duration_us) {
+    WorkerMetrics* m = g_self;
+    if (!m) return;
+    bump<uint64_t>(m->requests, 1);
+    bump<uint64_t>(m->response_bytes, bytes);
+    int cls = status / 100 - 1;
+    if (cls >= 0 && cls < 5) bump<uint64_t>(m->status[cls], 1);
+    bump<uint64_t>(m->latency[bucket_of(duration_us)], 1);
+    bump<uint64_t>(m->latency_sum_us, duration_us > 0 ? duration_us : 0);
+}
+
+void metrics_accepted() {
+    if (!g_self) return;
+    bump<uint64_t>(g_self->accepted, 1);
+    bump<int64_t>(g_self->active, 1);
+}
+
+void metrics_closed() {
+    if (!g_self) return;
+    bump<int64_t>(g_self->active, -1);
+}
+
+void metrics_shed() {
+    if (!g_self) return;
+    bump<uint64_t>(g_self->shed, 1);
+}
+
+void metrics_reclaimed(uint64_t n) {
+    if (!g_self) return;
+    bump<uint64_t>(g_self->reclaimed, n);
+}
+
+void metrics_accept_paused(bool paused) {
+    if (!g_self) return;
+    if (paused) bump<uint64_t>(g_self->accept_pauses, 1);
+    g_self->accept_paused.store(paused ? 1 : 0, std::memory_order_relaxed);
+}
+
+void metrics_loop(int64_t busy_us) {
+    WorkerMetrics* m = g_self;
+    if (!m) return;
+    bump<uint64_t>(m->loop_iterations, 1);
+    bump<uint64_t>(m->loop_busy[bucket_of(busy_us)], 1);
+    bump<uint64_t>(m->loop_busy_sum_us, busy_us > 0 ? busy_us : 0);
+}
+
+std::string render_metrics() {
+    std::string out;
+    out.reserve(16384);
+
+    header(out, "http_requests_total", "counter", "Responses completed.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_requests_total{worker=\"%d\"} %llu\n", w,
+               (unsigned long long)load(g_slots[w].requests));
+    }
+
+    header(out, "http_responses_total", "counter",
+           "Responses by status class.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        for (int c = 0; c < 5; ++c)
+            append(out, "http_responses_total{worker=\"%d\",code=\"%dxx\"} "
+                   "%llu\n", w, c + 1,
+                   (unsigned long long)load(g_slots[w].status[c]));
+    }
+
+    header(out, "http_response_bytes_total", "counter",
+           "Response bytes, headers included.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_response_bytes_total{worker=\"%d\"} %llu\n", w,
+               (unsigned long long)load(g_slots[w].response_bytes));
+    }
+
+    header(out, "http_connections_accepted_total", "counter",
+           "Connections accepted.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_connections_accepted_total{worker=\"%d\"} %llu\n",
+               w, (unsigned long long)load(g_slots[w].accepted));
+    }
+
+    header(out, "http_connections_active", "gauge", "Open connections.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_connections_active{worker=\"%d\"} %lld\n", w,
+               (long long)g_slots[w].active.load(std::memory_order_relaxed));
+    }
+
+    header(out, "http_connections_shed_total", "counter",
+           "Connections answered 503 and closed for lack of descriptors.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_connections_shed_total{worker=\"%d\"} %llu\n", w,
+               (unsigned long long)load(g_slots[w].shed));
+    }
+
+    header(out, "http_connections_reclaimed_total", "counter",
+           "Idle keep-alive connections closed at the connection limit.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_connections_reclaimed_total{worker=\"%d\"} %llu\n",
+               w, (unsigned long long)load(g_slots[w].reclaimed));
+    }
+
+    header(out, "http_accept_pauses_total", "counter",
+           "Times the loop stopped accepting, at its limit or out of fds.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_accept_pauses_total{worker=\"%d\"} %llu\n", w,
+               (unsigned long long)load(g_slots[w].accept_pauses));
+    }
+
+    header(out, "http_accept_paused", "gauge",
+           "1 while the loop is not accepting.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "http_accept_paused{worker=\"%d\"} %lld\n", w,
+               (long long)g_slots[w].accept_paused.load(
+                   std::memory_order_relaxed));
+    }
+
+    header(out, "event_loop_iterations_total", "counter",
+           "Event-loop wakeups.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        append(out, "event_loop_iterations_total{worker=\"%d\"} %llu\n", w,
+               (unsigned long long)load(g_slots[w].loop_iterations));
+    }
+
+    header(out, "http_request_duration_seconds", "histogram",
+           "From parsed request head to the last byte handed to the kernel.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        histogram(out, "http_request_duration_seconds", w,
+                  g_slots[w].latency, g_slots[w].latency_sum_us);
+    }
+
+    header(out, "event_loop_busy_seconds", "histogram",
+           "Time an event-loop iteration spent outside the wait.");
+    for (int w = 0; w < g_workers; ++w) {
+        if (!used(w)) continue;
+        histogram(out, "event_loop_busy_seconds", w,
+                  g_slots[w].loop_busy, g_slots[w].loop_busy_sum_us);
+    }
+    return out;
+}
+
+std::string metrics_summary() {
+    uint64_t requests = 0, bytes = 0, accepted = 0, status[5] = {};
+    uint64_t shed = 0, reclaimed = 0, pauses = 0;
+    for (int w = 0; w < g_workers; ++w) {
+        requests += load(g_slots[w].requests);
+        bytes += load(g_slots[w].response_bytes);
+        accepted += load(g_slots[w].accepted);
+        shed += load(g_slots[w].shed);
+        reclaimed += load(g_slots[w].reclaimed);
+        pauses += load(g_slots[w].accept_pauses);
+        for (int c = 0; c < 5; ++c) status[c] += load(g_slots[w].status[c]);
+    }
+    char buf[384];
+    std::snprintf(buf, sizeof(buf),
+                  "Totals: requests=%llu bytes=%llu accepted=%llu "
+                  "2xx=%llu 3xx=%llu 4xx=%llu 5xx=%llu shed=%llu "
+                  "reclaimed=%llu accept_pauses=%llu",
+                  (unsigned long long)requests, (unsigned long long)bytes,
+                  (unsigned long long)accepted, (unsigned long long)status[1],
+                  (unsigned long long)status[2], (unsigned long long)status[3],
+                  (unsigned long long)status[4], (unsigned long long)shed,
+                  (unsigned long long)reclaimed, (unsigned long long)pauses);
+    return buf;
+}
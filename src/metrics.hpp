@@ -0,0 +1,61 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Histogram bucket i counts samples below 2^i microseconds; the last one
+// is open-ended (about 8.4 s and up).
+static const int METRICS_BUCKETS = 24;
+
+// Live counters of one event loop in a MAP_SHARED segment created before
+// fork. Every field has a single writer (that loop's thread), so updates are
+// plain relaxed load+store without locked instructions; readers may see a
+// slightly torn snapshot across fields, never within one. Slots are
+// cache-line aligned so workers never share a line.
+struct alignas(64) WorkerMetrics {
+    std::atomic<int64_t>  pid{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> response_bytes{0};
+    std::atomic<uint64_t> status[5] = {};     // 1xx .. 5xx
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<int64_t>  active{0};           // open connections
+    std::atomic<uint64_t> loop_iterations{0};
+    std::atomic<uint64_t> shed{0};             // answered 503, out of fds
+    std::atomic<uint64_t> reclaimed{0};        // idle, closed to make room
+    std::atomic<uint64_t> accept_pauses{0};
+    std::atomic<int64_t>  accept_paused{0};    // 1 while not accepting
+
+    alignas(64) std::atomic<uint64_t> latency[METRICS_BUCKETS] = {};
+    std::atomic<uint64_t> latency_sum_us{0};
+
+    alignas(64) std::atomic<uint64_t> loop_busy[METRICS_BUCKETS] = {};
+    std::atomic<uint64_t> loop_busy_sum_us{0};
+};
+
+// master, before fork: slots for that many worker processes alive at once
+// (a rolling restart briefly needs more than --workers); false if the
+// segment cannot be mapped, which turns metrics off
+bool init_metrics(int slots);
+// each event-loop thread, after fork: takes over a slot released by an
+// exited process; its counters keep growing, only the gauges start over
+void attach_metrics(int slot);
+
+void metrics_request(int status, uint64_t bytes, int64_t duration_us);
+void metrics_accepted();
+void metrics_closed();
+// admission control (see admission.hpp)
+void metrics_shed();
+void metrics_reclaimed(uint64_t n);
+void metrics_accept_paused(bool paused);
+// time an event-loop iteration spent working, after the wait returned
+void metrics_loop(int64_t busy_us);
+
+// Prometheus text exposition of every worker's slot
+std::string render_metrics();
+// one log line with the totals over all workers
+std::string metrics_summary();
+
+#endif
@@ -0,0 +1,196 @@
+#include "request_parser.hpp"
+
+#include <strings.h>
+#include <cstring>
+
+static inline bool is_ows(char c) {
+    return c == ' ' || c == '\t';
+}
+
+RequestParser::Header RequestParser::lookup(const char* name, size_t len) {
+    switch (len) {
+        case 4:
+            if (!strncasecmp(name, "host", 4)) return H_HOST;
+            break;
+        case 5:
+            if (!strncasecmp(name, "range", 5)) return H_RANGE;
+            break;
+        case 7:
+            if (!strncasecmp(name, "upgrade", 7)) return H_UPGRADE;
+            break;
+        case 8:
+            if (!strncasecmp(name, "if-range", 8)) return H_IF_RANGE;
+            break;
+        case 10:
+            if (!strncasecmp(name, "connection", 10)) return H_CONNECTION;
+            break;
+        case 13:
+            if (!strncasecmp(name, "if-none-match", 13)) return H_IF_NONE_MATCH;
+            break;
+        case 14:
+            if (!strncasecmp(name, "content-length", 14)) return H_CONTENT_LENGTH;
+            if (!strncasecmp(name, "http2-settings", 14)) return H_HTTP2_SETTINGS;
+            break;
+        case 15:
+            if (!strncasecmp(name, "accept-encoding", 15)) return H_ACCEPT_ENCODING;
+            break;
+        case 17:
+            if (!strncasecmp(name, "if-modified-since", 17))
+                return H_IF_MODIFIED_SINCE;
+            if (!strncasecmp(name, "transfer-encoding", 17))
+                return H_TRANSFER_ENCODING;
+            break;
+    }
+    return H_OTHER;
+}
+
+void RequestParser::store_value() {
+    if (cur_ == H_OTHER) return;
+    headers_[cur_].off = tok_start_;
+    headers_[cur_].len = value_end_ > tok_start_ ? value_end_ - tok_start_ : 0;
+}
+
+ParseStatus RequestParser::finish(const char* buf, HttpRequest& req) const {
+    auto view = [buf](const Span& s) {
+        return std::string_view(buf + s.off, s.len);
+    };
+
+    req.method  = view(method_);
+    req.target  = view(target_);
+    req.version = view(version_);
+
+    if (req.version.size() != 8 || req.version.compare(0, 7, "HTTP/1.") != 0)
+        return ParseStatus::INVALID;
+    char minor = req.version[7];
+    if (minor < '0' || minor > '9') return ParseStatus::INVALID;
+    req.version_minor = minor - '0';
+
+    req.connection        = view(headers_[H_CONNECTION]);
+    req.host              = view(headers_[H_HOST]);
+    req.range             = view(headers_[H_RANGE]);
+    req.if_none_match     = view(headers_[H_IF_NONE_MATCH]);
+    req.if_modified_since = view(headers_[H_IF_MODIFIED_SINCE]);
+    req.if_range          = view(headers_[H_IF_RANGE]);
+    req.accept_encoding   = view(headers_[H_ACCEPT_ENCODING]);
+    req.content_length    = view(headers_[H_CONTENT_LENGTH]);
+    req.transfer_encoding = view(headers_[H_TRANSFER_ENCODING]);
+    req.upgrade           = view(headers_[H_UPGRADE]);
+    req.http2_settings    = view(headers_[H_HTTP2_SETTINGS]);
+
+    req.head_len = pos_;
+    return ParseStatus::COMPLETE;
+}
+
+ParseStatus RequestParser::parse(const char* buf, size_t len,
+                                 HttpRequest& req) {
+    while (pos_ < len) {
+        char c = buf[pos_];
+
+        switch (state_) {
+            case S_METHOD:
+                if (c == ' ') {
+                    if (pos_ == tok_start_) return ParseStatus::INVALID;
+                    method_ = Span{tok_start_, pos_ - tok_start_};
+                    tok_start_ = pos_ + 1;
+                    state_ = S_TARGET;
+                } else if (c == '\r' || c == '\n') {
+                    return ParseStatus::INVALID;
+                }
+                break;
+
+            case S_TARGET: {
+                // URLs can be long: jump straight to the separating space
+                const char* sp = static_cast<const char*>(
+                    std::memchr(buf + pos_, ' ', len - pos_));
+                size_t end = sp ? sp - buf : len;
+                if (std::memchr(buf + pos_, '\n', end - pos_))
+                    return ParseStatus::INVALID;
+                if (!sp) {
+                    pos_ = len;
+                    return ParseStatus::INCOMPLETE;
+                }
+                if (end == tok_start_) return ParseStatus::INVALID;
+                target_ = Span{tok_start_, (uint32_t)end - tok_start_};
+                tok_start_ = end + 1;
+                pos_ = end + 1;
+                state_ = S_VERSION;
+                continue;
+            }
+
+            case S_VERSION:
+                if (c == '\r' || c == '\n') {
+                    version_ = Span{tok_start_, pos_ - tok_start_};
+                    state_ = (c == '\r') ? S_REQ_LF : S_HEADER_START;
+                }
+                break;
+
+            case S_REQ_LF:
+            case S_HEADER_LF:
+                if (c != '\n') return ParseStatus::INVALID;
+                state_ = S_HEADER_START;
+                break;
+
+            case S_HEADER_START:
+                if (c == '\r') {
+                    state_ = S_FINAL_LF;
+                } else if (c == '\n') {
+                    ++pos_;
+                    return finish(buf, req);
+                } else if (is_ows(c) || c == ':') {
+                    return ParseStatus::INVALID;
+                } else {
+                    tok_start_ = pos_;
+                    state_ = S_NAME;
+                }
+                break;
+
+            case S_NAME:
+                if (c == ':') {
+                    cur_ = lookup(buf + tok_start_, pos_ - tok_start_);
+                    state_ = S_VALUE_OWS;
+                } else if (c == '\r' || c == '\n' || is_ows(c)) {
+                    return ParseStatus::INVALID;
+                }
+                break;
+
+            case S_VALUE_OWS:
+                if (is_ows(c)) break;
+                tok_start_ = value_end_ = pos_;
+                if (c == '\r' || c == '\n') {
+                    store_value();
+                    state_ = (c == '\r') ? S_HEADER_LF : S_HEADER_START;
+                    break;
+                }
+                state_ = S_VALUE;
+                continue;
+
+            case S_VALUE: {
+                // values make up most of the head; find the line end with
+                // memchr and trim trailing whitespace once
+                const char* nl = static_cast<const char*>(
+                    std::memchr(buf + pos_, '\n', len - pos_));
+                if (!nl) {
+                    pos_ = len;
+                    return ParseStatus::INCOMPLETE;
+                }
+                uint32_t end = nl - buf;
+                value_end_ = end;
+                while (value_end_ > tok_start_ &&
+                       (buf[value_end_ - 1] == '\r' ||
+                        is_ows(buf[value_end_ - 1])))
+                    --value_end_;
+                store_value();
+                pos_ = end + 1;
+                state_ = S_HEADER_START;
+                continue;
+            }
+
+            case S_FINAL_LF:
+                if (c != '\n') return ParseStatus::INVALID;
+                ++pos_;
+                return finish(buf, req);
+        }
+        ++pos_;
+    }
+    return ParseStatus::INCOMPLETE;
+}
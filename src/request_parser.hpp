@@ -0,0 +1,99 @@
+#ifndef REQUEST_PARSER_HPP
+#define REQUEST_PARSER_HPP
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// Views into the connection's input buffer; valid until that buffer is
+// modified (i.e. until the response for this request is finished).
+struct HttpRequest {
+    std::string_view method;
+    std::string_view target;
+    std::string_view version;
+    int              version_minor = 0;
+
+    std::string_view connection;
+    std::string_view host;
+    std::string_view range;
+    std::string_view if_none_match;
+    std::string_view if_modified_since;
+    std::string_view if_range;
+    std::string_view accept_encoding;
+    std::string_view content_length;
+    std::string_view transfer_encoding;
+    std::string_view upgrade;
+    std::string_view http2_settings;
+
+    size_t head_len = 0;   // request line + headers + blank line
+};
+
+enum class ParseStatus {
+    INCOMPLETE,
+    COMPLETE,
+    INVALID
+};
+
+// Resumable single-pass HTTP/1.x request-head parser. It keeps its scan
+// position between calls, so each received byte is looked at once, and it
+// records offsets rather than pointers because the buffer may be
+// reallocated between calls. No heap allocation.
+class RequestParser {
+public:
+    // buf must start at the beginning of the request and keep the bytes
+    // passed in earlier calls
+    ParseStatus parse(const char* buf, size_t len, HttpRequest& req);
+
+    void reset() { *this = RequestParser(); }
+
+private:
+    enum State : uint8_t {
+        S_METHOD,
+        S_TARGET,
+        S_VERSION,
+        S_REQ_LF,
+        S_HEADER_START,
+        S_NAME,
+        S_VALUE_OWS,
+        S_VALUE,
+        S_HEADER_LF,
+        S_FINAL_LF
+    };
+
+    enum Header : uint8_t {
+        H_CONNECTION,
+        H_HOST,
+        H_RANGE,
+        H_IF_NONE_MATCH,
+        H_IF_MODIFIED_SINCE,
+        H_IF_RANGE,
+        H_ACCEPT_ENCODING,
+        H_CONTENT_LENGTH,
+        H_TRANSFER_ENCODING,
+        H_UPGRADE,
+        H_HTTP2_SETTINGS,
+        H_COUNT,
+        H_OTHER = H_COUNT
+    };
+
+    struct Span {
+        uint32_t off = 0;
+        uint32_t len = 0;
+    };
+
+    static Header lookup(const char* name, size_t len);
+    void store_value();
+    ParseStatus finish(const char* buf, HttpRequest& req) const;
+
+    State    state_ = S_METHOD;
+    uint32_t pos_ = 0;
+    uint32_t tok_start_ = 0;
+    uint32_t value_end_ = 0;
+    Header   cur_ = H_OTHER;
+    Span     method_;
+    Span     target_;
+    Span     version_;
+    Span     headers_[H_COUNT];
+};
+
+#endif
@@ -1,35 +1,89 @@
 #include "server.hpp"
 #include "connection.hpp"
+#include "conn_table.hpp"
 #include "logger.hpp"
+#include "event_engine.hpp"
+#include "uring_engine.hpp"
+#include "file_cache.hpp"
+#include "content_cache.hpp"
+#include "site_pack.hpp"
+#include "clock.hpp"
+#include "timer_wheel.hpp"
+#include "tx_scheduler.hpp"
+#include "io_pool.hpp"
+#include "admission.hpp"
+#include "doc_watch.hpp"
+#include "metrics.hpp"
+#include "topology.hpp"
+#include "h2.hpp"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <pthread.h>
 
+#include <atomic>
+#include <thread>
 #include <unordered_map>
+#include <memory>
 #include <vector>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <sstream>
 #include <iostream>
 
+// at most this many event loops exist at once, counting the workers that
+// are still draining during a rolling restart; each needs a metrics slot
+static const int MAX_WORKER_SLOTS = 256;
+// a worker that dies sooner than this after its start is crash-looping
+static const int64_t CRASH_WINDOW_MS = 1000;
+static const int MIN_BACKOFF_MS = 100;
+static const int MAX_BACKOFF_MS = 10000;
+// a rolling restart moves to the next worker when the previous one has
+// drained or after this long, whichever comes first
+static const int64_t ROLL_STEP_MS = 1000;
+static const int DRAIN_POLL_MS = 100;
+// set by the old master for the binary it execs on SIGUSR2
+static const char* LISTEN_FD_ENV = "HTTP_SERVER_LISTEN_FD";
+// sent by a worker's main thread to its loop threads to cut their wait short
+static const int WAKE_SIGNAL = SIGUSR1;
+
 static volatile sig_atomic_t server_running = 1;
+static volatile sig_atomic_t draining = 0;
 
 static void handle_signal(int sig) {
     server_running = 0;
 }
 
+static void handle_quit(int sig) {
+    draining = 1;
+}
+
+// only there to interrupt the wait; the flags are already set
+static void handle_wake(int sig) {}
+
 static int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) return -1;
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-static int create_listen_socket(const ServerConfig& cfg) {
+// With reuse_port every worker binds its own socket to the same address
+// and the kernel spreads incoming connections across them, so a new
+// connection wakes exactly one worker.
+static int create_listen_socket(const ServerConfig& cfg, bool reuse_port,
+                                bool do_listen = true) {
     int fd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0) {
         perror("socket");
@@ -38,6 +92,12 @@ static int create_listen_socket(const ServerConfig& cfg) {
 
     int opt = 1;
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuse_port &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(fd);
+        return -1;
+    }
 
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
@@ -50,7 +110,9 @@ static int create_listen_socket(const ServerConfig& cfg) {
         return -1;
     }
 
-    if (listen(fd, 128) < 0) {
+    if (!do_listen) return fd;
+
+    if (listen(fd, cfg.backlog) < 0) {
         perror("listen");
         close(fd);
         return -1;
@@ -65,164 +127,1010 @@ static int create_listen_socket(const ServerConfig& cfg) {
     return fd;
 }
 
-static void worker_loop(int listen_fd, const ServerConfig& cfg) {
-    std::unordered_map<int, Connection> conns;
+// Takes queued connections until EAGAIN or the loop's connection limit;
+// false if accepting has to pause, at the limit or after the queue was
+// shed for lack of descriptors.
+static bool accept_clients(int listen_fd,
+                           const ServerConfig& cfg,
+                           EventBackend& backend,
+                           TimerWheel& timers,
+                           ConnTable<Connection>& conns,
+                           uint64_t& accepted) {
     while (server_running) {
-        fd_set readfds, writefds;
-        FD_ZERO(&readfds);
-        FD_ZERO(&writefds);
-
-        int maxfd = listen_fd;
-        FD_SET(listen_fd, &readfds);
-
-        for (auto& kv : conns) {
-            int fd = kv.first;
-            Connection& c = kv.second;
-            if (c.state == ConnState::READING_REQUEST) {
-                FD_SET(fd, &readfds);
-            } else if (c.state == ConnState::SENDING_HEADERS ||
-                       c.state == ConnState::SENDING_BODY) {
-                FD_SET(fd, &writefds);
+        if (admission().full(conns.size())) {
+            admission().pause(monotonic_ms());
+            return false;
+        }
+        int client_fd = ::accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (Admission::out_of_fds(errno)) {
+                log_error("accept error: " +
+                          std::string(std::strerror(errno)) + ", shed " +
+                          std::to_string(admission().shed(listen_fd)) +
+                          " queued connections");
+                admission().pause(monotonic_ms(), FD_BACKOFF_MS);
+                return false;
             }
-            if (fd > maxfd) maxfd = fd;
+            log_error("accept error: " + std::string(std::strerror(errno)));
+            return true;
+        }
+        ++accepted;
+        metrics_accepted();
+        set_nonblocking(client_fd);
+        // the tail of a response must not wait for the ACK of the
+        // previous one on a kept-alive connection; headers are still
+        // coalesced with the body via MSG_MORE
+        int one = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (!backend.add(client_fd, EV_READ)) {
+            ::close(client_fd);
+            metrics_closed();
+            continue;
+        }
+        Connection& c = conns.open(client_fd);
+        c.fd = client_fd;
+        c.interest = EV_READ;
+        take_buffers(c);
+        update_timer(c, cfg, timers, monotonic_ms());
+    }
+    return true;
+}
+
+// Runs the connection state machine until it blocks, or a file body has
+// used its allowance, then registers the interest matching the new state.
+// Connections that made progress without hitting EAGAIN are queued so
+// edge-triggered backends don't lose them: file bodies on the scheduler,
+// everything else on pending.
+static void service_connection(Connection& c,
+                               const ServerConfig& cfg,
+                               EventBackend& backend,
+                               TxScheduler& tx,
+                               std::vector<int>& pending,
+                               bool& want_close,
+                               size_t allowance) {
+    want_close = false;
+    c.would_block = false;
+
+    if (c.state == ConnState::CLOSING) {
+        want_close = true;
+        return;
+    }
+
+    // HTTP/2 reads in every state: streams overlap their responses
+    if (c.state == ConnState::READING_REQUEST || c.h2)
+        handle_read(c, cfg, want_close);
+
+    if (!want_close && (c.state == ConnState::SENDING_HEADERS ||
+                        c.state == ConnState::SENDING_BODY))
+        handle_write(c, cfg, want_close, allowance);
+
+    if (want_close) return;
+    // parked on the I/O pool, whose completion resumes it
+    if (c.state == ConnState::PREPARING_RESPONSE) return;
+
+    uint32_t interest = (c.state == ConnState::READING_REQUEST) ? EV_READ
+                                                                : EV_WRITE;
+    if (c.h2) interest = EV_READ | (output_pending(c) ? EV_WRITE : 0);
+    if (interest != c.interest) {
+        if (!backend.modify(c.fd, interest)) {
+            want_close = true;
+            return;
         }
+        c.interest = interest;
+    }
+
+    if (c.would_block) return;
+    if (streaming_body(c)) {
+        tx.activate(c.fd);
+    } else if (!c.queued) {
+        c.queued = true;
+        pending.push_back(c.fd);
+    }
+}
+
+static void close_connection(int fd, EventBackend& backend, TimerWheel& timers,
+                             ConnTable<Connection>& conns) {
+    Connection* c = conns.find(fd);
+    if (!c) return;
+    release_file(*c);
+    c->h2.reset();
+    return_buffers(*c);
+    timers.cancel(fd);
+    backend.remove(fd);
+    ::close(fd);
+    conns.close(fd);
+    metrics_closed();
+}
+
+// Graceful stop: the listener is no longer watched, so other workers (or
+// the next generation) take new connections. A SO_REUSEPORT listener is
+// private to this worker; its queue is emptied and the socket closed so the
+// kernel routes elsewhere.
+static void stop_accepting(int listen_fd, const ServerConfig& cfg,
+                           EventBackend& backend, TimerWheel& timers,
+                           ConnTable<Connection>& conns,
+                           uint64_t& accepted) {
+    backend.remove(listen_fd);
+    if (cfg.reuse_port) {
+        accept_clients(listen_fd, cfg, backend, timers, conns, accepted);
+        ::close(listen_fd);
+    }
+    admission().resume();
+}
+
+// hangs up idle keep-alive connections, see reclaim_idle()
+static size_t close_idle(EventBackend& backend, TimerWheel& timers,
+                         ConnTable<Connection>& conns, size_t max = SIZE_MAX,
+                         int64_t idle_before = INT64_MAX) {
+    return reclaim_idle(
+        conns.fds(), [&](int fd) { return conns.find(fd); },
+        [&](int fd) { close_connection(fd, backend, timers, conns); },
+        max, idle_before);
+}
+
+// While accepting is paused, long-idle connections make room first (see
+// Admission::make_room); the listener is then watched again.
+static void readmit(int listen_fd, EventBackend& backend, TimerWheel& timers,
+                    ConnTable<Connection>& conns) {
+    Admission& adm = admission();
+    int64_t now = monotonic_ms();
+    auto open = [&] { return conns.size(); };
+    auto close = [&](size_t max, int64_t idle_before) {
+        return close_idle(backend, timers, conns, max, idle_before);
+    };
+    if (!adm.make_room(now, open, close)) return;
+    if (!backend.add(listen_fd, EV_READ)) {
+        adm.pause(now, FD_BACKOFF_MS);
+        return;
+    }
+    adm.resume();
+}
+
+// Files resolved by the I/O pool go into the file cache, unless a change
+// they may predate has been applied since, and each request parked on them
+// carries on; one whose connection closed meanwhile (its fd possibly
+// reused) is recognised by the ticket.
+static void resume_parked(const ServerConfig& cfg, EventBackend& backend,
+                          TimerWheel& timers, TxScheduler& tx,
+                          ConnTable<Connection>& conns,
+                          std::vector<IoJob>& done, std::vector<int>& pending,
+                          std::vector<int>& to_close) {
+    done.clear();
+    io_pool().collect(done);
+    for (IoJob& job : done) {
+        if (applied_doc_generation() <= job.generation) {
+            for (ResolvedPath& p : job.paths)
+                file_cache().put(p.url_path, std::move(p.file), p.status);
+        }
+
+        Connection* c = conns.find(job.conn_fd);
+        if (!c) continue;
+        bool want_close = false;
+        if (c->h2) {
+            // one of its streams
+            if (!h2_resume(*c, cfg, job.ticket)) continue;
+        } else {
+            if (c->io_ticket != job.ticket ||
+                c->state != ConnState::PREPARING_RESPONSE)
+                continue;
+            resume_request(*c, cfg, want_close);
+        }
+        if (!want_close)
+            service_connection(*c, cfg, backend, tx, pending, want_close,
+                               cfg.tx_quantum);
+        if (want_close) to_close.push_back(job.conn_fd);
+        else update_timer(*c, cfg, timers, monotonic_ms());
+    }
+    done.clear();
+}
+
+static void worker_loop(int listen_fd, const ServerConfig& cfg,
+                        uint64_t& accepted) {
+    std::unique_ptr<EventBackend> backend = make_event_backend(cfg.engine);
+    if (!backend->add(listen_fd, EV_READ)) {
+        log_error("Cannot watch listening socket");
+        return;
+    }
+    log_info(std::string("Event engine: ") + backend->name() + ", up to " +
+             std::to_string(admission().limit()) + " connections");
+
+    int io_fd = -1;
+    if (cfg.io_threads > 0) {
+        if (io_pool().start(cfg.io_threads) &&
+            backend->add(io_pool().event_fd(), EV_READ))
+            io_fd = io_pool().event_fd();
+        else
+            log_error("Cannot start the file I/O pool, doing file I/O inline");
+        if (io_fd < 0) io_pool().stop();
+    }
+
+    ConnTable<Connection> conns;
+    std::vector<IoEvent> events;
+    std::vector<int> pending;
+    std::vector<int> retry;
+    std::vector<int> to_close;
+    std::vector<int> fired;
+    TimerWheel timers(monotonic_ms());
+    TxScheduler tx(cfg.tx_quantum, cfg.tx_budget);
+    std::vector<IoJob> io_done;
+    bool accepting = true;
+    int64_t drain_deadline = 0;
 
-        struct timespec timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_nsec = 0;
+    while (server_running) {
+        if (draining && accepting) {
+            accepting = false;
+            stop_accepting(listen_fd, cfg, *backend, timers, conns, accepted);
+            drain_deadline = monotonic_ms() + cfg.drain_timeout_ms;
+            log_info("Draining " + std::to_string(conns.size()) +
+                     " connections");
+        }
+        if (!accepting) {
+            close_idle(*backend, timers, conns);
+            if (conns.empty() || monotonic_ms() >= drain_deadline) break;
+        } else if (admission().paused()) {
+            readmit(listen_fd, *backend, timers, conns);
+        }
 
-        sigset_t empty_mask;
-        sigemptyset(&empty_mask);
+        int timeout_ms = pending.empty() && tx.empty()
+                             ? timers.next_timeout(monotonic_ms()) : 0;
+        if (!accepting && (timeout_ms < 0 || timeout_ms > DRAIN_POLL_MS))
+            timeout_ms = DRAIN_POLL_MS;
+        int recheck_ms = admission().recheck_in(monotonic_ms());
+        if (recheck_ms >= 0 && (timeout_ms < 0 || timeout_ms > recheck_ms))
+            timeout_ms = recheck_ms;
+        int ready = backend->wait(events, timeout_ms);
 
-        int ready = pselect(maxfd + 1,
-                            &readfds, &writefds, nullptr,
-                            &timeout, &empty_mask);
-        
-        if (!server_running) break; 
+        if (!server_running) break;
 
         if (ready < 0) {
             if (errno == EINTR) continue;
-            log_error("pselect error: " + std::string(std::strerror(errno)));
+            log_error(std::string(backend->name()) + " error: " +
+                      std::strerror(errno));
             continue;
         }
 
-        if (FD_ISSET(listen_fd, &readfds)) {
-            bool keep_accepting = true;
-            while (keep_accepting && server_running) {
-                sockaddr_in cli{};
-                socklen_t len = sizeof(cli);
-                int client_fd = ::accept(listen_fd, (sockaddr*)&cli, &len);
-                if (client_fd < 0) {
-                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                        keep_accepting = false; 
-                    } else {
-                        log_error("accept error: " +
-                                  std::string(std::strerror(errno)));
-                        keep_accepting = false;
-                    }
-                } else {
-                    if (client_fd >= FD_SETSIZE) {
-                        log_error("Socket fd (" + std::to_string(client_fd) + 
-                                    ") >= FD_SETSIZE, closing connection");
-                        ::close(client_fd);
-                    } else {
-                        set_nonblocking(client_fd);
-                        Connection c;
-                        c.fd = client_fd;
-                        conns.emplace(client_fd, std::move(c));
-                    }
-                }
-            }
-        }
+        int64_t busy_start = monotonic_us();
+        apply_doc_changes();
+        to_close.clear();
+        retry.swap(pending);
 
-        std::vector<int> to_close;
+        for (int fd : retry) {
+            Connection* c = conns.find(fd);
+            if (!c) continue;
+            c->queued = false;
+            bool want_close = false;
+            service_connection(*c, cfg, *backend, tx, pending, want_close,
+                               cfg.tx_quantum);
+            if (want_close) to_close.push_back(fd);
+            else update_timer(*c, cfg, timers, monotonic_ms());
+        }
+        retry.clear();
 
-        for (auto& kv : conns) {
-            int fd = kv.first;
-            Connection& c = kv.second;
-            if (FD_ISSET(fd, &readfds)) {
-                bool want_close = false;
-                handle_read(c, cfg, want_close);
-                if (want_close) to_close.push_back(fd);
+        for (const IoEvent& ev : events) {
+            if (accepting && ev.fd == listen_fd) {
+                if (!admission().paused() &&
+                    !accept_clients(listen_fd, cfg, *backend, timers, conns,
+                                    accepted))
+                    backend->remove(listen_fd);
+                continue;
+            }
+            if (ev.fd == io_fd) {
+                resume_parked(cfg, *backend, timers, tx, conns, io_done,
+                              pending, to_close);
+                continue;
             }
+            Connection* c = conns.find(ev.fd);
+            if (!c) continue;
+            // a file body that can write again waits for its turn
+            if (streaming_body(*c)) {
+                tx.activate(ev.fd);
+                continue;
+            }
+            // a new response goes out at once, up to one quantum of body
+            bool want_close = false;
+            service_connection(*c, cfg, *backend, tx, pending, want_close,
+                               cfg.tx_quantum);
+            if (want_close) to_close.push_back(ev.fd);
+            else update_timer(*c, cfg, timers, monotonic_ms());
         }
 
-        for (auto& kv : conns) {
-            int fd = kv.first;
-            Connection& c = kv.second;
-            if (FD_ISSET(fd, &writefds)) {
-                bool want_close = false;
-                handle_write(c, want_close);
-                if (want_close) to_close.push_back(fd);
+        // file bodies share what is left of the iteration's budget
+        tx.begin_round();
+        size_t allowance = 0;
+        for (int fd; (fd = tx.next_turn(allowance)) >= 0;) {
+            Connection* c = conns.find(fd);
+            if (!c) {
+                tx.remove(fd);
+                continue;
             }
+            uint64_t before = c->bytes_sent;
+            bool want_close = false;
+            service_connection(*c, cfg, *backend, tx, pending, want_close,
+                               allowance);
+            tx.end_turn(fd, (size_t)(c->bytes_sent - before),
+                        !want_close && !c->would_block && streaming_body(*c));
+            if (want_close) to_close.push_back(fd);
+            else update_timer(*c, cfg, timers, monotonic_ms());
+        }
+
+        int64_t now = monotonic_ms();
+        fired.clear();
+        timers.expire(now, fired);
+        for (int fd : fired) {
+            Connection* c = conns.find(fd);
+            if (c && timer_expired(*c, cfg, timers, now))
+                to_close.push_back(fd);
         }
 
         for (int fd : to_close) {
-            auto it = conns.find(fd);
-            if (it != conns.end()) {
-                if (it->second.file_fd >= 0)
-                    ::close(it->second.file_fd);
-                ::close(fd);
-                conns.erase(it);
-            }
+            tx.remove(fd);
+            close_connection(fd, *backend, timers, conns);
         }
+        metrics_loop(monotonic_us() - busy_start);
+    }
+    io_pool().stop();
+}
+
+// Workers inherit the fd limit; the soft one is raised as far as the hard
+// one allows, since connection limits are derived from it.
+static void raise_fd_limit() {
+    struct rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == rl.rlim_max)
+        return;
+    rl.rlim_cur = rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) != 0)
+        log_error("Cannot raise the fd limit: " +
+                  std::string(std::strerror(errno)));
+}
+
+// cached files keep their fds open, so leave most of the fd limit to
+// clients; every loop thread of a worker has its own cache
+static size_t file_cache_capacity(const ServerConfig& cfg, size_t threads) {
+    size_t capacity = cfg.file_cache_entries;
+    struct rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        capacity > rl.rlim_cur / 4 / threads)
+        capacity = rl.rlim_cur / 4 / threads;
+    return capacity;
+}
+
+// The master loads what workers serve from before it forks them: a site
+// pack when one is configured, otherwise the content cache of doc_root.
+// Without a pack, doc_root is watched from before the content cache is
+// read, so workers catch up on any change made while it was built.
+static bool load_site(const ServerConfig& cfg) {
+    if (cfg.pack_path.empty()) {
+        site_pack().close();
+        DocWatcher& watcher = doc_watcher();
+        if (!cfg.watch_root)
+            watcher.stop();
+        else if (!watcher.running() || watcher.root() != cfg.doc_root)
+            watcher.start(cfg.doc_root);
+        watcher.snapshot();
+        content_cache().build(cfg);
+        return true;
+    }
+    if (!site_pack().open(cfg.pack_path, cfg)) return false;
+    doc_watcher().stop();
+    ServerConfig no_cache = cfg;
+    no_cache.mem_cache_budget = 0;
+    content_cache().build(no_cache);
+    return true;
+}
+
+static void log_cache_stats() {
+    const FileCacheStats& st = file_cache().stats();
+    log_info("File cache: hits=" + std::to_string(st.hits) +
+             " misses=" + std::to_string(st.misses) +
+             " revalidations=" + std::to_string(st.revalidations) +
+             " evictions=" + std::to_string(st.evictions) +
+             " invalidations=" + std::to_string(st.invalidations));
+
+    const ContentCacheStats& mst = content_cache().stats();
+    log_info("Content cache: hits=" + std::to_string(mst.hits) +
+             " misses=" + std::to_string(mst.misses) +
+             " stale=" + std::to_string(mst.stale));
+}
+
+
+// runs this thread's event loop until shutdown or the end of a drain
+static void serve(int listen_fd, const ServerConfig& cfg, uint64_t& accepted) {
+    if (cfg.engine != EventEngine::URING ||
+        !run_uring_loop(listen_fd, cfg, server_running, draining, accepted)) {
+        if (cfg.engine == EventEngine::URING)
+            log_error("io_uring unavailable, falling back to epoll");
+        worker_loop(listen_fd, cfg, accepted);
+    }
+}
+
+static std::string cpu_list(const std::vector<int>& cpus) {
+    std::string out;
+    for (int cpu : cpus) {
+        if (!out.empty()) out += ',';
+        out += std::to_string(cpu);
+    }
+    return out;
+}
+
+// One event loop of a multi-threaded worker. Nothing on the request path
+// is shared with its sibling threads: the connection table, timers, file
+// cache, metrics slot and, with reuse_port, the listener are its own.
+struct LoopThread {
+    int         cpu = -1;   // -1: not pinned
+    int         slot = -1;
+    uint64_t    accepted = 0;
+    std::thread thread;
+};
+
+static void run_loop_thread(LoopThread& t, int worker_id, size_t index,
+                            size_t threads, int listen_fd,
+                            const ServerConfig& cfg,
+                            const ContentCache& primary,
+                            std::atomic<size_t>& live) {
+    // pinned before the loop allocates anything, so that its connection
+    // table and buffers are first touched on the right node
+    if (t.cpu >= 0 && !pin_thread(t.cpu))
+        log_error("Worker " + std::to_string(worker_id) + " thread " +
+                  std::to_string(index) + ": cannot pin to CPU " +
+                  std::to_string(t.cpu));
+
+    sigset_t mask;
+    pthread_sigmask(SIG_SETMASK, nullptr, &mask);
+    sigdelset(&mask, WAKE_SIGNAL);
+    set_wait_sigmask(mask);
+
+    attach_metrics(t.slot);
+    size_t cache_entries = file_cache_capacity(cfg, threads);
+    file_cache().configure(cache_entries, cfg.file_cache_ttl_ms);
+    admission().configure(connection_limit(cfg, threads, cache_entries));
+    content_cache().share_from(primary);
+
+    int fd = cfg.reuse_port ? create_listen_socket(cfg, true) : listen_fd;
+    if (fd < 0) {
+        log_error("Worker " + std::to_string(worker_id) + " thread " +
+                  std::to_string(index) + ": cannot create SO_REUSEPORT "
+                  "listener");
+    } else {
+        serve(fd, cfg, t.accepted);
+        log_cache_stats();
+    }
+    live.fetch_sub(1);
+}
+
+// The worker's main thread only relays control signals: the loop threads
+// keep them blocked even while waiting, and are woken with WAKE_SIGNAL
+// once a flag has changed.
+static uint64_t run_threads(int worker_id, int slot,
+                            const std::vector<int>& cpus, int listen_fd,
+                            const ServerConfig& cfg) {
+    sigset_t control;
+    sigemptyset(&control);
+    sigaddset(&control, SIGINT);
+    sigaddset(&control, SIGTERM);
+    sigaddset(&control, SIGQUIT);
+
+    std::vector<LoopThread> loops(cpus.size());
+    std::atomic<size_t> live{loops.size()};
+    for (size_t i = 0; i < loops.size(); ++i) {
+        LoopThread& t = loops[i];
+        t.cpu = cfg.cpu_affinity ? cpus[i] : -1;
+        t.slot = slot < 0 ? -1 : slot + (int)i;
+        t.thread = std::thread(run_loop_thread, std::ref(t), worker_id, i,
+                               loops.size(), listen_fd, std::cref(cfg),
+                               std::cref(content_cache()), std::ref(live));
+    }
+
+    while (live.load() > 0) {
+        timespec ts{0, DRAIN_POLL_MS * 1000000L};
+        int sig = sigtimedwait(&control, nullptr, &ts);
+        if (sig == SIGINT || sig == SIGTERM) server_running = 0;
+        else if (sig == SIGQUIT) draining = 1;
+        else continue;
+        for (LoopThread& t : loops)
+            pthread_kill(t.thread.native_handle(), WAKE_SIGNAL);
+    }
+
+    uint64_t accepted = 0;
+    for (LoopThread& t : loops) {
+        t.thread.join();
+        accepted += t.accepted;
     }
+    return accepted;
 }
 
-static void run_worker(int listen_fd, const ServerConfig& cfg) {
+// cpus has one entry per event-loop thread; a single one runs on the
+// worker's main thread
+static void run_worker(int worker_id, int slot, const std::vector<int>& cpus,
+                       int listen_fd, const ServerConfig& cfg) {
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGQUIT, handle_quit);
+    signal(WAKE_SIGNAL, handle_wake);
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGUSR2, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
     signal(SIGPIPE, SIG_IGN);
 
-    log_info("Worker started, pid=" + std::to_string(getpid()));
-    worker_loop(listen_fd, cfg);
+    // signals are only let through inside the event wait (pselect,
+    // epoll_pwait, io_uring ext arg), so a wait without a deadline cannot
+    // miss a shutdown request; the rest of the master's mask is dropped
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGQUIT);
+    sigaddset(&block, WAKE_SIGNAL);
+    sigprocmask(SIG_SETMASK, &block, nullptr);
+
+    // the whole worker, logger thread included, stays on the CPUs of one
+    // node; loop threads narrow that down to a CPU each
+    bool pinned = !cfg.cpu_affinity || pin_thread(cpus);
+
+    bool threaded = cpus.size() > 1;
+    if (cfg.reuse_port && !threaded) {
+        listen_fd = create_listen_socket(cfg, true);
+        if (listen_fd < 0) {
+            log_error("Worker " + std::to_string(worker_id) +
+                      ": cannot create SO_REUSEPORT listener");
+            return;
+        }
+    }
+
+    start_async_logger();
+    content_cache().set_ttl(cfg.file_cache_ttl_ms);
+
+    if (!pinned)
+        log_error("Worker " + std::to_string(worker_id) +
+                  ": cannot pin to CPUs " + cpu_list(cpus));
+    log_info("Worker " + std::to_string(worker_id) + " started, pid=" +
+             std::to_string(getpid()) + ", threads=" +
+             std::to_string(cpus.size()) +
+             (cfg.cpu_affinity ? ", cpus=" + cpu_list(cpus) : ""));
+    uint64_t accepted = 0;
+    if (threaded) {
+        accepted = run_threads(worker_id, slot, cpus, listen_fd, cfg);
+    } else {
+        attach_metrics(slot);
+        size_t cache_entries = file_cache_capacity(cfg, 1);
+        file_cache().configure(cache_entries, cfg.file_cache_ttl_ms);
+        admission().configure(connection_limit(cfg, 1, cache_entries));
+        serve(listen_fd, cfg, accepted);
+        log_cache_stats();
+    }
+    log_info("Worker " + std::to_string(worker_id) + " accepted " +
+             std::to_string(accepted) + " connections");
     log_info("Worker shutting down cleanly, pid=" + std::to_string(getpid()));
+    stop_async_logger();
 }
 
-int run_server(const ServerConfig& cfg) {
-    int listen_fd = create_listen_socket(cfg);
-    if (listen_fd < 0) return 1;
+namespace {
 
-    init_logger(cfg.log_path);
-    log_info("Server starting (prefork + pselect)");
+// One position in the pool of cfg.workers processes. When its process
+// dies unexpectedly it is refilled after a backoff that grows while the
+// replacements keep crashing right after start.
+struct Seat {
+    pid_t   pid = 0;
+    int     slot = -1;            // first of one metrics slot per thread
+    int     slots = 0;
+    int64_t started_ms = 0;
+    int     backoff_ms = 0;
+    int64_t respawn_at = 0;   // when pid == 0
+};
 
-    struct sigaction sa{};
-    sa.sa_handler = handle_signal;
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGINT, &sa, nullptr); 
-    sigaction(SIGTERM, &sa, nullptr);
-    
-    signal(SIGPIPE, SIG_IGN);
+enum class Stop {
+    NONE,
+    FAST,       // SIGINT/SIGTERM: workers exit at once
+    GRACEFUL    // SIGQUIT: workers finish in-flight responses first
+};
+
+// The master: keeps the pool full and handles the control signals. It
+// never serves requests, and all signals reach it synchronously through
+// sigtimedwait().
+class Supervisor {
+public:
+    Supervisor(const ServerConfig& cfg, int listen_fd, char* argv[],
+               const std::string& exe)
+        : cfg_(cfg), listen_fd_(listen_fd), argv_(argv), exe_(exe),
+          slot_used_(MAX_WORKER_SLOTS, false) {
+        layout();
+    }
+
+    ~Supervisor() {
+        if (sig_fd_ >= 0) ::close(sig_fd_);
+    }
+
+    int run(const sigset_t& signals) {
+        sig_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        seats_.resize(cfg_.workers);
+        for (size_t i = 0; i < seats_.size(); ++i) spawn(i);
+
+        for (;;) {
+            reap();
+            if (stop_ != Stop::NONE && children() == 0) break;
+
+            int sig = next_signal(signals);
+            switch (sig) {
+                case SIGINT:
+                case SIGTERM:
+                    log_info("Fast shutdown");
+                    stop_ = Stop::FAST;
+                    signal_all(SIGTERM);
+                    break;
+                case SIGQUIT:
+                    if (stop_ != Stop::NONE) break;
+                    log_info("Graceful shutdown: draining workers");
+                    stop_ = Stop::GRACEFUL;
+                    signal_all(SIGQUIT);
+                    break;
+                case SIGHUP:
+                    if (stop_ == Stop::NONE) reload();
+                    break;
+                case SIGUSR2:
+                    if (stop_ == Stop::NONE) exec_binary();
+                    break;
+                default:
+                    break;
+            }
+
+            if (stop_ == Stop::NONE) {
+                respawn_due();
+                roll_step();
+            }
+        }
+        return 0;
+    }
+
+private:
+    // The next control signal, or 0 once the nearest deadline has passed.
+    // Changes under doc_root are published meanwhile, which needs the
+    // signals as a descriptor to poll next to inotify; without one they are
+    // waited for alone.
+    int next_signal(const sigset_t& signals) {
+        int64_t deadline = next_deadline();
+        int64_t wait_ms = deadline - monotonic_ms();
+        if (wait_ms < 0) wait_ms = 0;
+
+        if (sig_fd_ < 0) {
+            timespec ts;
+            ts.tv_sec = wait_ms / 1000;
+            ts.tv_nsec = (wait_ms % 1000) * 1000000L;
+            siginfo_t info;
+            return sigtimedwait(&signals, &info,
+                                deadline == INT64_MAX ? nullptr : &ts);
+        }
 
-    // prefork
-    for (int i = 0; i < cfg.workers; ++i) {
+        pollfd fds[2] = {{sig_fd_, POLLIN, 0},
+                         {doc_watcher().fd(), POLLIN, 0}};
+        int n = poll(fds, 2, deadline == INT64_MAX ? -1 : (int)wait_ms);
+        if (n > 0 && (fds[1].revents & POLLIN)) doc_watcher().drain();
+        signalfd_siginfo info;
+        if (::read(sig_fd_, &info, sizeof(info)) == (ssize_t)sizeof(info))
+            return (int)info.ssi_signo;
+        return 0;
+    }
+
+    // the CPUs of every seat's loop threads; also settles --workers auto
+    void layout() {
+        CpuTopology topo = detect_topology();
+        plan_ = plan_workers(topo, cfg_.workers, cfg_.threads);
+        cfg_.workers = (int)plan_.size();
+        size_t threads = 0;
+        for (const auto& cpus : plan_) threads += cpus.size();
+        log_info(std::to_string(topo.cpus()) + " CPUs on " +
+                 std::to_string(topo.nodes.size()) + " NUMA nodes: " +
+                 std::to_string(plan_.size()) + " workers, " +
+                 std::to_string(threads) + " event loops" +
+                 (cfg_.cpu_affinity ? ", pinned" : ""));
+    }
+
+    // a contiguous run, so that a worker's threads use slot, slot + 1, ...
+    int claim_slots(int count) {
+        for (int first = 0; first + count <= MAX_WORKER_SLOTS; ++first) {
+            int n = 0;
+            while (n < count && !slot_used_[first + n]) ++n;
+            if (n == count) {
+                for (int i = 0; i < count; ++i) slot_used_[first + i] = true;
+                return first;
+            }
+            first += n;
+        }
+        return -1;
+    }
+
+    void release_slots(int first, int count) {
+        for (int i = 0; first >= 0 && i < count; ++i)
+            slot_used_[first + i] = false;
+    }
+
+    void spawn(size_t id) {
+        Seat& seat = seats_[id];
+        int slots = (int)plan_[id].size();
+        int slot = claim_slots(slots);
         pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
-            return 1;
-        } else if (pid == 0) {
-            run_worker(listen_fd, cfg);
+        if (pid == 0) {
+            if (sig_fd_ >= 0) ::close(sig_fd_);
+            doc_watcher().close_in_child();
+            run_worker((int)id, slot, plan_[id], listen_fd_, cfg_);
             _exit(0);
         }
+        if (pid < 0) {
+            log_error("fork error: " + std::string(std::strerror(errno)));
+            release_slots(slot, slots);
+            seat.pid = 0;
+            seat.backoff_ms = next_backoff(seat.backoff_ms);
+            seat.respawn_at = monotonic_ms() + seat.backoff_ms;
+            return;
+        }
+        seat.pid = pid;
+        seat.slot = slot;
+        seat.slots = slots;
+        seat.started_ms = monotonic_ms();
     }
 
-    while (server_running) {
+    static int next_backoff(int backoff_ms) {
+        if (backoff_ms == 0) return MIN_BACKOFF_MS;
+        return backoff_ms * 2 < MAX_BACKOFF_MS ? backoff_ms * 2
+                                               : MAX_BACKOFF_MS;
+    }
+
+    static std::string describe(int status) {
+        if (WIFSIGNALED(status))
+            return "killed by signal " + std::to_string(WTERMSIG(status));
+        return "exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+
+    void reap() {
         int status = 0;
-        pid_t pid = wait(&status);
-        if (pid < 0) {
-            if (errno == EINTR) {
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto r = retiring_.find(pid);
+            if (r != retiring_.end()) {
+                release_slots(r->second.first, r->second.second);
+                retiring_.erase(r);
+                log_info("Worker " + std::to_string(pid) + " retired");
+                if (pid == roll_waiting_) roll_next_ms_ = 0;
+                continue;
+            }
+
+            size_t id = 0;
+            while (id < seats_.size() && seats_[id].pid != pid) ++id;
+            if (id == seats_.size()) {
+                // a new master started by SIGUSR2 that gave up
+                log_info("Process " + std::to_string(pid) + " " +
+                         describe(status));
                 continue;
             }
-            if (errno == ECHILD) {
-                break;
+
+            Seat& seat = seats_[id];
+            release_slots(seat.slot, seat.slots);
+            seat.pid = 0;
+            seat.slot = -1;
+            if (stop_ != Stop::NONE) {
+                log_info("Worker " + std::to_string(pid) + " exited");
+                continue;
             }
-            log_error("wait error: " + std::string(std::strerror(errno)));
-            break;
+
+            int64_t now = monotonic_ms();
+            seat.backoff_ms = now - seat.started_ms < CRASH_WINDOW_MS
+                                  ? next_backoff(seat.backoff_ms) : 0;
+            seat.respawn_at = now + seat.backoff_ms;
+            log_error("Worker " + std::to_string(id) + " (pid " +
+                      std::to_string(pid) + ") " + describe(status) +
+                      ", respawning in " + std::to_string(seat.backoff_ms) +
+                      " ms");
+        }
+    }
+
+    size_t children() const {
+        size_t n = retiring_.size();
+        for (const Seat& seat : seats_)
+            if (seat.pid > 0) ++n;
+        return n;
+    }
+
+    void signal_all(int sig) {
+        for (const Seat& seat : seats_)
+            if (seat.pid > 0) kill(seat.pid, sig);
+        for (const auto& r : retiring_) kill(r.first, sig);
+    }
+
+    int64_t next_deadline() const {
+        int64_t deadline = INT64_MAX;
+        if (stop_ != Stop::NONE) return deadline;
+        for (const Seat& seat : seats_)
+            if (seat.pid == 0 && seat.respawn_at < deadline)
+                deadline = seat.respawn_at;
+        if (!roll_queue_.empty() && roll_next_ms_ < deadline)
+            deadline = roll_next_ms_;
+        return deadline;
+    }
+
+    void respawn_due() {
+        int64_t now = monotonic_ms();
+        for (size_t id = 0; id < seats_.size(); ++id)
+            if (seats_[id].pid == 0 && seats_[id].respawn_at <= now)
+                spawn(id);
+    }
+
+    // sends SIGQUIT to the process in a seat and moves it aside
+    void retire(Seat& seat) {
+        if (seat.pid <= 0) return;
+        retiring_[seat.pid] = std::make_pair(seat.slot, seat.slots);
+        kill(seat.pid, SIGQUIT);
+        seat.pid = 0;
+        seat.slot = -1;
+    }
+
+    // replaces one old-generation worker: the new one starts first, so
+    // the pool never runs short while the old one drains
+    void roll_step() {
+        if (roll_queue_.empty() || monotonic_ms() < roll_next_ms_) return;
+        size_t id = roll_queue_.front();
+        roll_queue_.erase(roll_queue_.begin());
+        if (id >= seats_.size()) return;
+
+        pid_t old = seats_[id].pid;
+        retire(seats_[id]);
+        spawn(id);
+        roll_waiting_ = old;
+        roll_next_ms_ = monotonic_ms() + ROLL_STEP_MS;
+        if (roll_queue_.empty())
+            log_info("Reload: last worker replaced");
+    }
+
+    // SIGHUP: the command line (and any --config file) is parsed again, logs
+    // are reopened, the site pack is mapped again or the shared content
+    // cache rebuilt from doc_root, and the workers are replaced one at a
+    // time
+    void reload() {
+        int argc = 0;
+        while (argv_[argc]) ++argc;
+        ServerConfig next;
+        if (!parse_config(argc, argv_, next)) {
+            log_error("Reload: invalid configuration, keeping the current one");
+            return;
+        }
+        if (next.host != cfg_.host || next.port != cfg_.port ||
+            next.reuse_port != cfg_.reuse_port) {
+            log_error("Reload: the listening address cannot change without "
+                      "a binary reload (SIGUSR2); keeping it");
+            next.host = cfg_.host;
+            next.port = cfg_.port;
+            next.reuse_port = cfg_.reuse_port;
+        }
+
+        cfg_ = next;
+        init_logger(cfg_.log_path, cfg_.access_log_path);
+        layout();
+        if (!load_site(cfg_))
+            log_error("Reload: keeping the site loaded before");
+
+        while (seats_.size() > (size_t)cfg_.workers) {
+            retire(seats_.back());
+            seats_.pop_back();
+        }
+        roll_queue_.clear();
+        for (size_t id = 0; id < seats_.size(); ++id)
+            if (seats_[id].pid > 0) roll_queue_.push_back(id);
+        int64_t now = monotonic_ms();
+        while (seats_.size() < (size_t)cfg_.workers) {
+            seats_.emplace_back();
+            seats_.back().respawn_at = now;
         }
-        log_info("Worker " + std::to_string(pid) + " exited");
+        roll_next_ms_ = 0;
+        log_info("Reload: replacing " + std::to_string(roll_queue_.size()) +
+                 " workers, pool size " + std::to_string(cfg_.workers));
     }
 
-    ::close(listen_fd);
+    // SIGUSR2: starts the binary at the original path (possibly replaced on
+    // disk) with the listening socket inherited. Both generations serve
+    // until this master is told to drain with SIGQUIT.
+    void exec_binary() {
+        pid_t pid = fork();
+        if (pid == 0) {
+            sigset_t none;
+            sigemptyset(&none);
+            sigprocmask(SIG_SETMASK, &none, nullptr);
+            if (listen_fd_ >= 0)
+                setenv(LISTEN_FD_ENV, std::to_string(listen_fd_).c_str(), 1);
+            execv(exe_.c_str(), argv_);
+            _exit(127);
+        }
+        if (pid < 0) {
+            log_error("fork error: " + std::string(std::strerror(errno)));
+            return;
+        }
+        log_info("Started " + exe_ + " as pid " + std::to_string(pid) +
+                 "; send SIGQUIT to pid " + std::to_string(getpid()) +
+                 " to retire this generation");
+    }
+
+    ServerConfig cfg_;
+    int listen_fd_;
+    char** argv_;
+    std::string exe_;
+    std::vector<Seat> seats_;
+    std::vector<std::vector<int>> plan_;   // seat -> CPU per loop thread
+    // pid -> first metrics slot and count
+    std::unordered_map<pid_t, std::pair<int, int>> retiring_;
+    std::vector<bool> slot_used_;
+    int sig_fd_ = -1;   // the control signals, read instead of waited for
+    std::vector<size_t> roll_queue_;
+    int64_t roll_next_ms_ = 0;
+    pid_t roll_waiting_ = 0;
+    Stop stop_ = Stop::NONE;
+};
+
+// the listening socket passed down by an old master on SIGUSR2
+int inherited_listener() {
+    const char* value = getenv(LISTEN_FD_ENV);
+    if (!value) return -1;
+    int fd = std::atoi(value);
+    unsetenv(LISTEN_FD_ENV);
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || getsockname(fd, (sockaddr*)&addr, &len) != 0) return -1;
+    return fd;
+}
+
+// argv[0] resolved now, so that SIGUSR2 runs whatever binary is at that
+// path later rather than the one this process was loaded from
+std::string executable_path(const char* argv0) {
+    char buf[PATH_MAX];
+    if (std::strchr(argv0, '/') && realpath(argv0, buf)) return buf;
+    ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (n > 0) return std::string(buf, n);
+    return argv0;
+}
+
+}
+
+int run_server(const ServerConfig& cfg, char* argv[]) {
+    // in reuse_port mode the master only checks that the address is free;
+    // a listening socket here would take its share of connections
+    int listen_fd = cfg.reuse_port ? -1 : inherited_listener();
+    bool inherited = listen_fd >= 0;
+    if (!inherited) {
+        listen_fd = create_listen_socket(cfg, cfg.reuse_port, !cfg.reuse_port);
+        if (listen_fd < 0) return 1;
+        if (cfg.reuse_port) {
+            ::close(listen_fd);
+            listen_fd = -1;
+        }
+    }
+
+    init_logger(cfg.log_path, cfg.access_log_path);
+    log_info(std::string("Server starting (prefork + ") +
+             engine_name(cfg.engine) + ")" +
+             (inherited ? ", listening socket inherited" : ""));
+
+    // the master takes every control signal synchronously; workers reset
+    // the mask after fork
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR2);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    raise_fd_limit();
+    // loaded once here so that every worker maps the same pages
+    if (!load_site(cfg)) return 1;
+    if (!init_metrics(MAX_WORKER_SLOTS))
+        log_error("metrics segment unavailable: " +
+                  std::string(std::strerror(errno)));
+
+    Supervisor supervisor(cfg, listen_fd, argv, executable_path(argv[0]));
+    supervisor.run(signals);
+
+    if (listen_fd >= 0) ::close(listen_fd);
+    log_info(metrics_summary());
     log_info("Bye");
     return 0;
 }
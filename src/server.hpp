@@ -4,6 +4,8 @@
 #include "config.hpp"
 #include <sys/wait.h>
 
-int run_server(const ServerConfig& cfg);
+// argv is kept for SIGHUP (re-parsed into a new config) and SIGUSR2
+// (passed to the new binary)
+int run_server(const ServerConfig& cfg, char* argv[]);
 
 #endif
@@ -0,0 +1,170 @@
+#include "site_pack.hpp"
+#include "logger.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+uint64_t pack_fingerprint(const ServerConfig& cfg) {
+    std::string s;
+    s += cfg.precompressed ? 'p' : '-';
+    s += (char)('0' + (int)cfg.etag);
+    for (const CacheControlRule& r : cfg.cache_control) {
+        s += '\n';
+        s += r.match;
+        s += '=';
+        s += r.value;
+    }
+    uint64_t h = pack_hash(0, s.data(), s.size());
+    return (h << 32) | pack_hash(1, s.data(), s.size());
+}
+
+SitePack::~SitePack() {
+    close();
+}
+
+void SitePack::close() {
+    if (base_) munmap(const_cast<char*>(base_), size_);
+    if (fd_ >= 0) ::close(fd_);
+    base_ = nullptr;
+    size_ = 0;
+    fd_ = -1;
+    buckets_ = nullptr;
+    slots_ = nullptr;
+    entries_.clear();
+}
+
+namespace {
+
+bool in_file(uint64_t off, uint64_t len, size_t size) {
+    return off <= size && len <= size - off;
+}
+
+// the string at off, up to its NUL, lies within the file
+bool string_in_file(const char* base, uint64_t off, uint64_t len,
+                    size_t size) {
+    return in_file(off, len + 1, size) && base[off + len] == '\0';
+}
+
+bool entry_valid(const char* base, const PackEntry& e, size_t size) {
+    if (!string_in_file(base, e.path_off, e.path_len, size) ||
+        !in_file(e.body_off, e.body_len, size) ||
+        !in_file(e.mime_off, 1, size) ||
+        !std::memchr(base + e.mime_off, '\0', size - e.mime_off))
+        return false;
+    for (int ka = 0; ka < 2; ++ka) {
+        if (!string_in_file(base, e.headers_off[ka], e.headers_len[ka], size))
+            return false;
+        if (e.encoded_headers_off[ka] &&
+            !string_in_file(base, e.encoded_headers_off[ka],
+                            e.encoded_headers_len[ka], size))
+            return false;
+    }
+    return true;
+}
+
+}
+
+bool SitePack::open(const std::string& path, const ServerConfig& cfg) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_error("Site pack " + path + ": " + std::strerror(errno));
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackHeader)) {
+        log_error("Site pack " + path + ": not a site pack");
+        ::close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void* mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        log_error("Site pack " + path + " mmap error: " +
+                  std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    const char* base = static_cast<const char*>(mem);
+
+    const PackHeader& h = *reinterpret_cast<const PackHeader*>(base);
+    bool ok = !std::memcmp(h.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) &&
+              h.version == PACK_VERSION && h.file_size == size &&
+              h.buckets_off % alignof(int32_t) == 0 &&
+              h.entries_off % alignof(PackEntry) == 0 &&
+              in_file(h.buckets_off, (uint64_t)h.count * sizeof(int32_t),
+                      size) &&
+              in_file(h.entries_off, (uint64_t)h.count * sizeof(PackEntry),
+                      size);
+    const PackEntry* slots =
+        reinterpret_cast<const PackEntry*>(base + h.entries_off);
+    for (uint32_t i = 0; ok && i < h.count; ++i)
+        ok = entry_valid(base, slots[i], size);
+    if (!ok) {
+        log_error("Site pack " + path + ": damaged or built by another "
+                  "version");
+        munmap(mem, size);
+        ::close(fd);
+        return false;
+    }
+
+    close();
+    base_ = base;
+    size_ = size;
+    fd_ = fd;
+    buckets_ = reinterpret_cast<const int32_t*>(base + h.buckets_off);
+    slots_ = slots;
+
+    // headers rendered for other ETag or Cache-Control options are left
+    // out, and serve_mem() renders them per request
+    bool headers = h.fingerprint == pack_fingerprint(cfg);
+    entries_.resize(h.count);
+    for (uint32_t i = 0; i < h.count; ++i) {
+        const PackEntry& e = slots[i];
+        MemEntry& m = entries_[i];
+        m.body = base + e.body_off;
+        m.size = e.body_len;
+        m.mime = base + e.mime_off;
+        for (int ka = 0; ka < 2 && headers; ++ka) {
+            m.headers[ka] = base + e.headers_off[ka];
+            m.headers_len[ka] = e.headers_len[ka];
+            if (!e.encoded_headers_off[ka]) continue;
+            m.encoded_headers[ka] = base + e.encoded_headers_off[ka];
+            m.encoded_headers_len[ka] = e.encoded_headers_len[ka];
+        }
+        m.ino = (ino_t)e.ino;
+        m.mtime.tv_sec = e.mtime_sec;
+        m.mtime.tv_nsec = e.mtime_nsec;
+        m.fd = fd;
+        m.offset = (off_t)e.body_off;
+    }
+
+    log_info("Site pack " + path + ": " + std::to_string(h.count) +
+             " files, " + std::to_string(size) + " bytes mapped" +
+             (headers ? "" : ", headers rendered per request (built with "
+                             "other --etag/--cache-control/--precompressed)"));
+    return true;
+}
+
+const MemEntry* SitePack::find(const std::string& url_path) const {
+    if (entries_.empty()) return nullptr;
+    uint32_t n = (uint32_t)entries_.size();
+    const char* key = url_path.data();
+    size_t len = url_path.size();
+
+    int32_t d = buckets_[pack_hash(0, key, len) % n];
+    uint32_t slot = d < 0 ? (uint32_t)-(d + 1) : pack_hash(d, key, len) % n;
+    if (slot >= n) return nullptr;
+    const PackEntry& e = slots_[slot];
+    if (e.path_len != len || std::memcmp(base_ + e.path_off, key, len) != 0)
+        return nullptr;
+    return &entries_[slot];
+}
+
+SitePack& site_pack() {
+    static SitePack pack;
+    return pack;
+}
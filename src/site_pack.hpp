@@ -0,0 +1,100 @@
+#ifndef SITE_PACK_HPP
+#define SITE_PACK_HPP
+
+#include "config.hpp"
+#include "content_cache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of a site pack, written offline by tools/pack_site:
+//
+//   PackHeader | int32 displacement per bucket | PackEntry per slot |
+//   paths, MIME types, header blocks and bodies
+//
+// Integers are in host byte order; a pack is built for the machines that
+// serve it. The index is a minimal perfect hash (hash and displace): a key
+// falls into bucket pack_hash(0, key) % count, and that bucket's value d
+// gives its slot, -d - 1 directly when d < 0, else pack_hash(d, key) %
+// count. The path stored in the slot confirms the match.
+
+const char     PACK_MAGIC[8] = {'S', 'I', 'T', 'E', 'P', 'A', 'C', 'K'};
+const uint32_t PACK_VERSION = 1;
+
+struct PackHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;         // entries, buckets and slots alike
+    uint64_t fingerprint;   // pack_fingerprint() of the build config
+    uint64_t buckets_off;
+    uint64_t entries_off;
+    uint64_t file_size;
+};
+
+// offsets are from the start of the file; strings are NUL-terminated
+struct PackEntry {
+    uint64_t path_off;
+    uint64_t body_off;
+    uint64_t body_len;
+    uint64_t mime_off;
+    uint64_t headers_off[2];           // indexed by keep_alive
+    uint64_t encoded_headers_off[2];   // 0 unless a precompressed sibling
+    uint32_t path_len;
+    uint32_t headers_len[2];
+    uint32_t encoded_headers_len[2];
+    uint32_t reserved;
+    uint64_t ino;                      // of the source file, for the ETag
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+};
+
+inline uint32_t pack_hash(uint32_t seed, const char* key, size_t len) {
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// Digest of the options that shape pre-rendered entity headers (ETag mode,
+// Vary, Cache-Control rules). A pack built under other options is still
+// served, with its headers rendered per request instead.
+uint64_t pack_fingerprint(const ServerConfig& cfg);
+
+// A packed doc root mapped read-only once by the master before fork, so
+// every worker and thread serves from the same page-cache pages. Lookups
+// are two hash probes; nothing under doc_root is resolved, stat'ed or
+// opened while a pack is loaded. A new pack has to replace the old one by
+// rename (as pack_site does), never by rewriting the mapped file in place.
+class SitePack {
+public:
+    ~SitePack();
+
+    // replaces the loaded pack only if path is a valid one
+    bool open(const std::string& path, const ServerConfig& cfg);
+    void close();
+
+    bool loaded() const { return base_ != nullptr; }
+
+    // nullptr if url_path is not in the pack
+    const MemEntry* find(const std::string& url_path) const;
+
+    size_t entries() const { return entries_.size(); }
+    size_t bytes() const { return size_; }
+
+private:
+    const char*  base_ = nullptr;
+    size_t       size_ = 0;
+    int          fd_ = -1;
+    const int32_t* buckets_ = nullptr;
+    const PackEntry* slots_ = nullptr;
+    std::vector<MemEntry> entries_;   // by slot
+};
+
+// one per process: built by the master and only read afterwards
+SitePack& site_pack();
+
+#endif
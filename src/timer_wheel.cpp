@@ -0,0 +1,82 @@
+#include "timer_wheel.hpp"
+
+TimerWheel::TimerWheel(int64_t now_ms)
+    : heads_(SLOTS, -1), mins_(SLOTS, INT64_MAX), tick_(now_ms / TICK_MS) {}
+
+void TimerWheel::unlink(int fd) {
+    Node& n = nodes_[fd];
+    if (n.prev >= 0) nodes_[n.prev].next = n.next;
+    else             heads_[n.slot] = n.next;
+    if (n.next >= 0) nodes_[n.next].prev = n.prev;
+    n.prev = n.next = n.slot = -1;
+    --count_;
+}
+
+void TimerWheel::schedule(int fd, int64_t deadline_ms) {
+    if (fd < 0) return;
+    if ((size_t)fd >= nodes_.size()) nodes_.resize(fd + 1);
+    if (nodes_[fd].slot >= 0) unlink(fd);
+
+    // overdue timers go to the current slot and fire on the next expire()
+    int64_t t = deadline_ms / TICK_MS;
+    if (t < tick_) t = tick_;
+    int slot = (int)(t % SLOTS);
+
+    Node& n = nodes_[fd];
+    n.deadline = deadline_ms;
+    n.slot = slot;
+    n.prev = -1;
+    n.next = heads_[slot];
+    if (n.next < 0 || deadline_ms < mins_[slot]) mins_[slot] = deadline_ms;
+    if (n.next >= 0) nodes_[n.next].prev = fd;
+    heads_[slot] = fd;
+    ++count_;
+}
+
+void TimerWheel::cancel(int fd) {
+    if (fd < 0 || (size_t)fd >= nodes_.size() || nodes_[fd].slot < 0) return;
+    unlink(fd);
+}
+
+void TimerWheel::expire(int64_t now_ms, std::vector<int>& fired) {
+    int64_t now_tick = now_ms / TICK_MS;
+    int64_t last = now_tick;
+    if (last - tick_ >= (int64_t)SLOTS) last = tick_ + SLOTS - 1;
+
+    for (int64_t t = tick_; t <= last && count_ > 0; ++t) {
+        int64_t min = INT64_MAX;
+        int fd = heads_[t % SLOTS];
+        while (fd >= 0) {
+            int next = nodes_[fd].next;
+            if (nodes_[fd].deadline <= now_ms) {
+                unlink(fd);
+                fired.push_back(fd);
+            } else if (nodes_[fd].deadline < min) {
+                min = nodes_[fd].deadline;
+            }
+            fd = next;
+        }
+        mins_[t % SLOTS] = min;
+    }
+    // the current slot may still hold timers due later in this tick
+    if (now_tick > tick_) tick_ = now_tick;
+}
+
+int TimerWheel::next_timeout(int64_t now_ms) const {
+    if (count_ == 0) return -1;
+
+    int64_t earliest = INT64_MAX;
+    for (unsigned k = 0; k < SLOTS; ++k) {
+        int64_t t = tick_ + k;
+        if (heads_[t % SLOTS] < 0) continue;
+        int64_t min = mins_[t % SLOTS];
+        if (min < earliest) earliest = min;
+        // due this round; later slots hold nothing earlier
+        if (min < (t + 1) * TICK_MS) break;
+    }
+
+    int64_t wait = earliest - now_ms;
+    if (wait < 0) wait = 0;
+    if (wait > INT32_MAX) wait = INT32_MAX;
+    return (int)wait;
+}
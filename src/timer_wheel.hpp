@@ -0,0 +1,52 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Hashed timing wheel keyed by fd, one timer per fd. schedule() and
+// cancel() are O(1) (intrusive lists indexed by fd); expire() only visits
+// the slots that elapsed since the previous call. Deadlines more than one
+// revolution ahead stay in their slot and are skipped until due.
+// next_timeout() reads a per-slot lower bound on the deadlines instead of
+// the lists, so it costs O(SLOTS) however many timers are armed.
+class TimerWheel {
+public:
+    static const int      TICK_MS = 100;
+    static const unsigned SLOTS   = 512;
+
+    explicit TimerWheel(int64_t now_ms);
+
+    // arms or moves the timer of fd
+    void schedule(int fd, int64_t deadline_ms);
+    void cancel(int fd);
+
+    // disarms every timer whose deadline has passed and appends its fd
+    void expire(int64_t now_ms, std::vector<int>& fired);
+
+    // ms until the earliest deadline, or -1 when nothing is armed
+    int next_timeout(int64_t now_ms) const;
+
+    size_t size() const { return count_; }
+
+private:
+    struct Node {
+        int      prev = -1;
+        int      next = -1;
+        int      slot = -1;   // -1 when not armed
+        int64_t  deadline = 0;
+    };
+
+    void unlink(int fd);
+
+    std::vector<Node> nodes_;
+    std::vector<int>  heads_;
+    // no deadline in the slot is earlier; cancel() may leave it stale-low,
+    // which costs at most an early wakeup until expire() walks the slot
+    std::vector<int64_t> mins_;
+    int64_t           tick_;   // first slot not yet fully expired
+    size_t            count_ = 0;
+};
+
+#endif
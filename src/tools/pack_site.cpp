@@ -0,0 +1,308 @@
+// Офлайн-сборка пакета сайта: весь doc_root складывается в один файл,
+// который сервер отображает в память (--pack FILE) вместо обхода
+// каталога. В пакете для каждого пути лежат тело, MIME-тип, данные для
+// ETag (inode, размер, mtime исходника) и готовые блоки заголовков для
+// keep-alive и close. Предсжатые соседи (.br/.zst/.gz, см. precompress)
+// попадают в пакет как отдельные пути со своими заголовками
+// Content-Encoding.
+//
+// Индекс — минимальный совершенный хеш (hash and displace), формат
+// описан в site_pack.hpp. Заголовки рендерятся тем же кодом, что и в
+// сервере, с теми же опциями (--etag, --cache-control, --precompressed);
+// если сервер запущен с другими, он отдаёт пакет, но заголовки строит
+// на каждый запрос.
+//
+// Пакет пишется во временный файл и переименовывается, так что
+// работающий сервер по SIGHUP всегда видит целый пакет.
+//
+// Сборка и запуск: ./pack_site.sh OUT.pack --root DIR [опции сервера]
+
+#include "../config.hpp"
+#include "../http.hpp"
+#include "../file_cache.hpp"
+#include "../site_pack.hpp"
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t BODY_ALIGN = 64;
+const size_t COPY_CHUNK = 256 * 1024;
+
+struct Source {
+    std::string url_path;
+    std::string fs_path;
+    struct stat st;
+    std::string mime;
+    std::string headers[2];
+    std::string encoded_headers[2];
+};
+
+[[noreturn]] void fail(const std::string& what) {
+    std::fprintf(stderr, "pack_site: %s: %s\n", what.c_str(),
+                 std::strerror(errno));
+    std::exit(1);
+}
+
+void collect(const std::string& root, const std::string& rel,
+             const ServerConfig& cfg, std::vector<Source>& out) {
+    std::string dir_path = root + rel;
+    DIR* dir = opendir(dir_path.c_str());
+    if (!dir) fail(dir_path);
+
+    while (dirent* de = readdir(dir)) {
+        if (!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+            continue;
+        Source s;
+        s.url_path = rel + "/" + de->d_name;
+        s.fs_path = root + s.url_path;
+        if (stat(s.fs_path.c_str(), &s.st) != 0) fail(s.fs_path);
+
+        if (S_ISDIR(s.st.st_mode)) {
+            collect(root, s.url_path, cfg, out);
+        } else if (S_ISREG(s.st.st_mode)) {
+            if ((size_t)s.st.st_size > cfg.max_file_size) {
+                std::fprintf(stderr, "pack_site: %s: больше max_file_size, "
+                             "пропущен\n", s.fs_path.c_str());
+                continue;
+            }
+            out.push_back(std::move(s));
+        }
+    }
+    closedir(dir);
+}
+
+// те же блоки заголовков, что строит ContentCache::build()
+void render(Source& s, const ServerConfig& cfg) {
+    s.mime = get_mime_type(s.fs_path);
+    FileMeta meta;
+    meta.ino = s.st.st_ino;
+    meta.size = s.st.st_size;
+    meta.mtime = s.st.st_mtim;
+    std::string entity = entity_headers(s.url_path, meta, cfg);
+    for (int ka = 0; ka < 2; ++ka)
+        s.headers[ka] = build_headers(200, (size_t)s.st.st_size, s.mime,
+                                      ka != 0, entity);
+
+    size_t suffix_len = 0;
+    const char* coding = precompressed_coding(s.url_path, suffix_len);
+    if (!coding) return;
+    std::string base = s.url_path.substr(0, s.url_path.size() - suffix_len);
+    if (!compressible(base)) return;
+    std::string encoded = entity_headers(base, meta, cfg, coding);
+    for (int ka = 0; ka < 2; ++ka)
+        s.encoded_headers[ka] = build_headers(200, (size_t)s.st.st_size,
+                                              get_mime_type(base), ka != 0,
+                                              encoded);
+}
+
+// Hash and displace: корзины разбираются от самых полных, каждой
+// подбирается смещение d, при котором все её ключи попадают в свободные
+// слоты; корзине из одного ключа просто достаётся свободный слот.
+// Возвращает слот каждого источника.
+std::vector<uint32_t> build_index(const std::vector<Source>& files,
+                                  std::vector<int32_t>& buckets,
+                                  uint32_t& max_d) {
+    uint32_t n = (uint32_t)files.size();
+    std::vector<std::vector<uint32_t>> members(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        const std::string& k = files[i].url_path;
+        members[pack_hash(0, k.data(), k.size()) % n].push_back(i);
+    }
+    std::vector<uint32_t> order(n);
+    for (uint32_t b = 0; b < n; ++b) order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return members[a].size() > members[b].size();
+    });
+
+    buckets.assign(n, 0);
+    std::vector<uint32_t> slot_of(n);
+    std::vector<bool> used(n, false);
+    std::vector<uint32_t> placed;
+    max_d = 0;
+    uint32_t free_slot = 0;
+
+    for (uint32_t b : order) {
+        const std::vector<uint32_t>& keys = members[b];
+        if (keys.empty()) break;
+        if (keys.size() == 1) {
+            while (used[free_slot]) ++free_slot;
+            used[free_slot] = true;
+            slot_of[keys[0]] = free_slot;
+            buckets[b] = -(int32_t)free_slot - 1;
+            continue;
+        }
+        for (uint32_t d = 1;; ++d) {
+            if (d > (uint32_t)INT32_MAX) {
+                std::fprintf(stderr, "pack_site: не удалось построить "
+                             "индекс\n");
+                std::exit(1);
+            }
+            placed.clear();
+            for (uint32_t k : keys) {
+                const std::string& key = files[k].url_path;
+                uint32_t s = pack_hash(d, key.data(), key.size()) % n;
+                if (used[s] ||
+                    std::find(placed.begin(), placed.end(), s) != placed.end())
+                    break;
+                placed.push_back(s);
+            }
+            if (placed.size() < keys.size()) continue;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                used[placed[i]] = true;
+                slot_of[keys[i]] = placed[i];
+            }
+            buckets[b] = (int32_t)d;
+            max_d = std::max(max_d, d);
+            break;
+        }
+    }
+    return slot_of;
+}
+
+size_t align_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+void write_all(int fd, const void* data, size_t len, const std::string& path) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) fail(path);
+        p += n;
+        len -= n;
+    }
+}
+
+void copy_body(int out, const Source& s, const std::string& out_path) {
+    int in = ::open(s.fs_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) fail(s.fs_path);
+    std::vector<char> buf(COPY_CHUNK);
+    size_t left = (size_t)s.st.st_size;
+    while (left > 0) {
+        ssize_t n = ::read(in, buf.data(), std::min(left, buf.size()));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            errno = n == 0 ? EIO : errno;
+            fail(s.fs_path + " (изменился во время сборки?)");
+        }
+        write_all(out, buf.data(), n, out_path);
+        left -= n;
+    }
+    ::close(in);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    ServerConfig cfg;
+    // argv[1] -- выходной файл, дальше опции сервера
+    if (argc < 2 || argv[1][0] == '-' ||
+        !parse_config(argc - 1, argv + 1, cfg)) {
+        std::fprintf(stderr, "Usage: %s OUT.pack --root DIR [--etag "
+                     "strong|weak|off] [--cache-control /PREFIX|.EXT=VALUE]..."
+                     " [--precompressed on|off] [--config FILE]\n", argv[0]);
+        return 1;
+    }
+    std::string out_path = argv[1];
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Source> files;
+    collect(cfg.doc_root, "", cfg, files);
+    for (Source& s : files) render(s, cfg);
+
+    std::vector<int32_t> buckets;
+    uint32_t max_d = 0;
+    std::vector<uint32_t> slot_of = build_index(files, buckets, max_d);
+    uint32_t n = (uint32_t)files.size();
+    std::vector<uint32_t> by_slot(n);
+    for (uint32_t i = 0; i < n; ++i) by_slot[slot_of[i]] = i;
+
+    // заголовок, индекс и записи; затем строки всех записей подряд, чтобы
+    // поиск трогал мало страниц; затем тела
+    PackHeader h{};
+    std::memcpy(h.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    h.version = PACK_VERSION;
+    h.count = n;
+    h.fingerprint = pack_fingerprint(cfg);
+    h.buckets_off = sizeof(PackHeader);
+    h.entries_off = align_up(h.buckets_off + n * sizeof(int32_t),
+                             alignof(PackEntry));
+
+    std::vector<PackEntry> entries(n);
+    std::string strings;
+    size_t strings_off = h.entries_off + n * sizeof(PackEntry);
+    auto put = [&](const std::string& s) {
+        uint64_t off = strings_off + strings.size();
+        strings += s;
+        strings += '\0';
+        return off;
+    };
+    for (uint32_t slot = 0; slot < n; ++slot) {
+        const Source& s = files[by_slot[slot]];
+        PackEntry& e = entries[slot];
+        e.path_off = put(s.url_path);
+        e.path_len = (uint32_t)s.url_path.size();
+        e.mime_off = put(s.mime);
+        for (int ka = 0; ka < 2; ++ka) {
+            e.headers_off[ka] = put(s.headers[ka]);
+            e.headers_len[ka] = (uint32_t)s.headers[ka].size();
+            if (s.encoded_headers[ka].empty()) continue;
+            e.encoded_headers_off[ka] = put(s.encoded_headers[ka]);
+            e.encoded_headers_len[ka] = (uint32_t)s.encoded_headers[ka].size();
+        }
+        e.ino = s.st.st_ino;
+        e.mtime_sec = s.st.st_mtim.tv_sec;
+        e.mtime_nsec = s.st.st_mtim.tv_nsec;
+    }
+    size_t body_off = strings_off + strings.size();
+    for (uint32_t slot = 0; slot < n; ++slot) {
+        const Source& s = files[by_slot[slot]];
+        body_off = align_up(body_off, BODY_ALIGN);
+        entries[slot].body_off = body_off;
+        entries[slot].body_len = (uint64_t)s.st.st_size;
+        body_off += (size_t)s.st.st_size;
+    }
+    h.file_size = body_off;
+
+    std::string tmp_path = out_path + ".tmp";
+    int out = ::open(tmp_path.c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) fail(tmp_path);
+    write_all(out, &h, sizeof(h), tmp_path);
+    write_all(out, buckets.data(), n * sizeof(int32_t), tmp_path);
+    static const char zeros[BODY_ALIGN] = {};
+    size_t pos = h.buckets_off + n * sizeof(int32_t);
+    write_all(out, zeros, h.entries_off - pos, tmp_path);
+    write_all(out, entries.data(), n * sizeof(PackEntry), tmp_path);
+    write_all(out, strings.data(), strings.size(), tmp_path);
+    pos = strings_off + strings.size();
+    for (uint32_t slot = 0; slot < n; ++slot) {
+        write_all(out, zeros, entries[slot].body_off - pos, tmp_path);
+        copy_body(out, files[by_slot[slot]], tmp_path);
+        pos = entries[slot].body_off + entries[slot].body_len;
+    }
+    if (fsync(out) != 0 || ::close(out) != 0) fail(tmp_path);
+    if (rename(tmp_path.c_str(), out_path.c_str()) != 0) fail(out_path);
+
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+    std::printf("%s: %u файлов, %zu байт (индекс и заголовки %zu), "
+                "макс. смещение %u, %.0f мс\n",
+                out_path.c_str(), n, (size_t)h.file_size,
+                strings_off + strings.size(), max_d, ms);
+    return 0;
+}
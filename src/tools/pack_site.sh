@@ -0,0 +1,15 @@
+#!/bin/bash
+# Сборка и запуск упаковщика doc_root в пакет сайта для --pack.
+# Собирается вместе с исходниками сервера (кроме main.cpp): заголовки
+# рендерит тот же код. Аргументы: OUT.pack --root DIR [опции сервера].
+
+SERVER_SOURCE_DIR=".."
+TOOL_BIN="$SERVER_SOURCE_DIR/build/pack_site"
+
+SOURCES=$(ls "$SERVER_SOURCE_DIR"/*.cpp | grep -v '/main\.cpp$')
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread pack_site.cpp $SOURCES \
+    -o "$TOOL_BIN" || exit 1
+
+"$TOOL_BIN" "$@"
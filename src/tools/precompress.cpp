@@ -0,0 +1,279 @@
+// Офлайн-генерация предсжатых вариантов статики: для каждого текстового
+// файла в doc_root рядом кладутся file.br, file.gz и (если при сборке
+// доступен zstd.h) file.zst. Сервер отдаёт их по Accept-Encoding.
+//
+// Файлы обрабатываются параллельно пулом потоков. Вариант пересоздаётся,
+// только если он старше исходника; вариант, который вышел не меньше
+// исходника, не сохраняется (и удаляется, если остался от прошлого запуска).
+//
+// Сборка и запуск: ./precompress.sh [--threads N] [--min-size BYTES] [--force] [DIR]
+
+#include <brotli/encode.h>
+#include <zlib.h>
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define HAVE_ZSTD 1
+#endif
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Source {
+    std::string path;
+    struct stat st;
+};
+
+struct Totals {
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+};
+
+// сжатие в out; false, если кодек не справился
+typedef bool (*Compressor)(const std::string& in, std::string& out);
+
+struct Format {
+    const char* suffix;
+    Compressor  compress;
+    Totals      totals;
+};
+
+// тот же список, что у compressible() в http.cpp
+bool compressible(const std::string& path) {
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos) return false;
+    const char* ext = path.c_str() + dot + 1;
+    return !strcasecmp(ext, "html") || !strcasecmp(ext, "htm") ||
+           !strcasecmp(ext, "css") || !strcasecmp(ext, "js") ||
+           !strcasecmp(ext, "txt") || !strcasecmp(ext, "svg") ||
+           !strcasecmp(ext, "json") || !strcasecmp(ext, "xml");
+}
+
+bool compress_gzip(const std::string& in, std::string& out) {
+    z_stream zs{};
+    // 15 + 16: окно 32K и обёртка gzip вместо zlib
+    if (deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&zs, in.size()) + 32);
+    zs.next_in = (Bytef*)in.data();
+    zs.avail_in = (uInt)in.size();
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = (uInt)out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+bool compress_brotli(const std::string& in, std::string& out) {
+    size_t len = BrotliEncoderMaxCompressedSize(in.size());
+    if (len == 0) len = in.size() + 1024;
+    out.resize(len);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                               BROTLI_MODE_TEXT, in.size(),
+                               (const uint8_t*)in.data(), &len,
+                               (uint8_t*)&out[0]))
+        return false;
+    out.resize(len);
+    return true;
+}
+
+#ifdef HAVE_ZSTD
+bool compress_zstd(const std::string& in, std::string& out) {
+    out.resize(ZSTD_compressBound(in.size()));
+    size_t len = ZSTD_compress(&out[0], out.size(), in.data(), in.size(), 19);
+    if (ZSTD_isError(len)) return false;
+    out.resize(len);
+    return true;
+}
+#endif
+
+Format g_formats[] = {
+    {".br", compress_brotli, {}},
+    {".gz", compress_gzip, {}},
+#ifdef HAVE_ZSTD
+    {".zst", compress_zstd, {}},
+#endif
+};
+
+void collect(const std::string& dir_path, size_t min_size,
+             std::vector<Source>& out) {
+    DIR* dir = opendir(dir_path.c_str());
+    if (!dir) return;
+    while (dirent* de = readdir(dir)) {
+        if (!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+            continue;
+        std::string path = dir_path + "/" + de->d_name;
+        struct stat st{};
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            collect(path, min_size, out);
+        } else if (S_ISREG(st.st_mode) && compressible(path) &&
+                   (size_t)st.st_size >= min_size) {
+            out.push_back(Source{path, st});
+        }
+    }
+    closedir(dir);
+}
+
+bool read_file(const std::string& path, std::string& data) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st{};
+    fstat(fd, &st);
+    data.resize(st.st_size);
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t r = ::read(fd, &data[done], data.size() - done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += r;
+    }
+    ::close(fd);
+    data.resize(done);
+    return true;
+}
+
+// запись во временный файл и rename: сервер никогда не видит недописанный вариант
+bool write_file(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t w = ::write(fd, data.data() + done, data.size() - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        done += w;
+    }
+    ::close(fd);
+    if (done != data.size() || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool up_to_date(const std::string& variant, const struct stat& src) {
+    struct stat st{};
+    if (stat(variant.c_str(), &st) != 0) return false;
+    return st.st_mtim.tv_sec > src.st_mtim.tv_sec ||
+           (st.st_mtim.tv_sec == src.st_mtim.tv_sec &&
+            st.st_mtim.tv_nsec >= src.st_mtim.tv_nsec);
+}
+
+void process(const Source& src, bool force, std::mutex& err_mutex) {
+    std::string data;
+    bool loaded = false;
+    for (Format& f : g_formats) {
+        std::string variant = src.path + f.suffix;
+        if (!force && up_to_date(variant, src.st)) {
+            f.totals.skipped++;
+            continue;
+        }
+        if (!loaded) {
+            if (!read_file(src.path, data)) {
+                std::lock_guard<std::mutex> lock(err_mutex);
+                std::fprintf(stderr, "read %s: %s\n", src.path.c_str(),
+                             std::strerror(errno));
+                return;
+            }
+            loaded = true;
+        }
+
+        std::string out;
+        if (!f.compress(data, out)) {
+            std::lock_guard<std::mutex> lock(err_mutex);
+            std::fprintf(stderr, "compress %s failed\n", variant.c_str());
+            continue;
+        }
+        if (out.size() >= data.size()) {
+            unlink(variant.c_str());
+            continue;
+        }
+        if (!write_file(variant, out)) {
+            std::lock_guard<std::mutex> lock(err_mutex);
+            std::fprintf(stderr, "write %s: %s\n", variant.c_str(),
+                         std::strerror(errno));
+            continue;
+        }
+        f.totals.written++;
+        f.totals.bytes_in += data.size();
+        f.totals.bytes_out += out.size();
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string root = "../www";
+    unsigned threads = std::thread::hardware_concurrency();
+    size_t min_size = 256;
+    bool force = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = (unsigned)std::atoi(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--min-size") && i + 1 < argc) {
+            min_size = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--force")) {
+            force = true;
+        } else if (argv[i][0] != '-') {
+            root = argv[i];
+        } else {
+            std::fprintf(stderr, "Usage: %s [--threads N] [--min-size BYTES]"
+                         " [--force] [DIR]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (threads == 0) threads = 1;
+
+    std::vector<Source> sources;
+    collect(root, min_size, sources);
+
+    std::atomic<size_t> next{0};
+    std::mutex err_mutex;
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            for (;;) {
+                size_t i = next.fetch_add(1);
+                if (i >= sources.size()) return;
+                process(sources[i], force, err_mutex);
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+
+    std::printf("%zu files in %s, %u threads\n", sources.size(), root.c_str(),
+                threads);
+    for (Format& f : g_formats) {
+        uint64_t in = f.totals.bytes_in, out = f.totals.bytes_out;
+        std::printf("%-4s written %llu, up to date %llu, %llu -> %llu bytes"
+                    " (%.1f%%)\n", f.suffix,
+                    (unsigned long long)f.totals.written.load(),
+                    (unsigned long long)f.totals.skipped.load(),
+                    (unsigned long long)in, (unsigned long long)out,
+                    in ? 100.0 * out / in : 0.0);
+    }
+#ifndef HAVE_ZSTD
+    std::printf(".zst skipped: built without zstd.h\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,17 @@
+#!/bin/bash
+# Сборка и запуск генератора предсжатых вариантов (.br/.gz/.zst) для doc_root.
+# Аргументы передаются как есть, по умолчанию обрабатывается ../www.
+
+SERVER_SOURCE_DIR=".."
+TOOL_BIN="$SERVER_SOURCE_DIR/build/precompress"
+
+ZSTD_LIB=""
+if echo '#include <zstd.h>' | g++ -E -x c++ - > /dev/null 2>&1; then
+    ZSTD_LIB="-lzstd"
+fi
+
+mkdir -p "$SERVER_SOURCE_DIR/build"
+g++ -std=c++17 -O2 -Wall -pthread precompress.cpp -o "$TOOL_BIN" \
+    -lz -lbrotlienc $ZSTD_LIB || exit 1
+
+"$TOOL_BIN" "$@"
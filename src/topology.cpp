@@ -0,0 +1,138 @@
+#include "topology.hpp"
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+
+static const char* NODE_DIR = "/sys/devices/system/node";
+
+// "0-3,8-11" -> 0 1 2 3 8 9 10 11
+static std::vector<int> parse_cpu_list(const std::string& s) {
+    std::vector<int> cpus;
+    const char* p = s.c_str();
+    while (*p) {
+        char* end;
+        long first = std::strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = std::strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) cpus.push_back((int)cpu);
+        if (*p != ',') break;
+        ++p;
+    }
+    return cpus;
+}
+
+size_t CpuTopology::cpus() const {
+    size_t n = 0;
+    for (const auto& node : nodes) n += node.size();
+    return n;
+}
+
+CpuTopology detect_topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        CPU_SET(0, &allowed);
+
+    std::vector<std::pair<int, std::vector<int>>> found;
+    std::vector<bool> placed(CPU_SETSIZE, false);
+    if (DIR* dir = opendir(NODE_DIR)) {
+        while (dirent* de = readdir(dir)) {
+            if (std::strncmp(de->d_name, "node", 4) != 0 ||
+                de->d_name[4] < '0' || de->d_name[4] > '9')
+                continue;
+            std::ifstream in(std::string(NODE_DIR) + "/" + de->d_name +
+                             "/cpulist");
+            std::string line;
+            if (!std::getline(in, line)) continue;
+
+            std::vector<int> cpus;
+            for (int cpu : parse_cpu_list(line)) {
+                if (cpu < 0 || cpu >= CPU_SETSIZE || placed[cpu] ||
+                    !CPU_ISSET(cpu, &allowed))
+                    continue;
+                placed[cpu] = true;
+                cpus.push_back(cpu);
+            }
+            // memory-only nodes and nodes outside our cpuset drop out
+            if (!cpus.empty())
+                found.emplace_back(std::atoi(de->d_name + 4), cpus);
+        }
+        closedir(dir);
+    }
+    std::sort(found.begin(), found.end());
+
+    CpuTopology topo;
+    for (auto& f : found) topo.nodes.push_back(std::move(f.second));
+
+    std::vector<int> rest;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed) && !placed[cpu]) rest.push_back(cpu);
+    if (!rest.empty()) {
+        if (topo.nodes.empty()) topo.nodes.push_back(rest);
+        else topo.nodes.front().insert(topo.nodes.front().end(),
+                                       rest.begin(), rest.end());
+    }
+    if (topo.nodes.empty()) topo.nodes.push_back({0});
+    return topo;
+}
+
+// `count` consecutive CPUs of a node from `first`, wrapping around when a
+// worker asks for more threads than the node has CPUs
+static std::vector<int> node_slice(const std::vector<int>& node,
+                                   size_t first, size_t count) {
+    std::vector<int> cpus;
+    for (size_t j = 0; j < count; ++j)
+        cpus.push_back(node[(first + j) % node.size()]);
+    return cpus;
+}
+
+std::vector<std::vector<int>> plan_workers(const CpuTopology& topo,
+                                           int workers, int threads) {
+    std::vector<std::vector<int>> plan;
+    const size_t nodes = topo.nodes.size();
+
+    if (workers <= 0) {
+        for (const auto& node : topo.nodes) {
+            size_t per = threads > 0 ? (size_t)threads : node.size();
+            for (size_t first = 0; first < node.size(); first += per)
+                plan.push_back(node_slice(node, first, per));
+        }
+        return plan;
+    }
+
+    for (int id = 0; id < workers; ++id) {
+        const std::vector<int>& node = topo.nodes[id % nodes];
+        size_t rank = id / nodes;
+        size_t on_node = (workers - id % nodes + nodes - 1) / nodes;
+        size_t per = threads > 0 ? (size_t)threads
+                                 : std::max<size_t>(1, node.size() / on_node);
+        plan.push_back(node_slice(node, rank * per, per));
+    }
+    return plan;
+}
+
+bool pin_thread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    if (CPU_COUNT(&set) == 0) return false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool pin_thread(int cpu) {
+    return pin_thread(std::vector<int>{cpu});
+}
@@ -0,0 +1,29 @@
+#ifndef TOPOLOGY_HPP
+#define TOPOLOGY_HPP
+
+#include <cstddef>
+#include <vector>
+
+// CPUs this process may run on, grouped by NUMA node. Read from
+// /sys/devices/system/node; without it everything is one node.
+struct CpuTopology {
+    std::vector<std::vector<int>> nodes;   // never empty, no empty node
+
+    size_t cpus() const;
+};
+
+CpuTopology detect_topology();
+
+// CPU of every event-loop thread of every worker. A worker never straddles
+// a node: workers are dealt to nodes round-robin and take consecutive CPUs
+// of theirs, `threads` each (0: an equal share of the node). With
+// workers == 0 the node sizes decide how many there are: one per CPU, or
+// per `threads` CPUs, or per node when threads is 0 too.
+std::vector<std::vector<int>> plan_workers(const CpuTopology& topo,
+                                           int workers, int threads);
+
+// binds the calling thread; threads it creates later inherit the set
+bool pin_thread(int cpu);
+bool pin_thread(const std::vector<int>& cpus);
+
+#endif
@@ -0,0 +1,69 @@
+#include "tx_scheduler.hpp"
+
+TxScheduler::TxScheduler(size_t quantum, size_t budget)
+    : quantum_(quantum ? quantum : 1), budget_(budget) {}
+
+void TxScheduler::activate(int fd) {
+    if (fd < 0) return;
+    if ((size_t)fd >= nodes_.size()) nodes_.resize(fd + 1);
+    Node& n = nodes_[fd];
+    if (n.linked) return;
+
+    // joins at the tail, just behind head_
+    n.linked = true;
+    n.deficit = 0;
+    if (head_ < 0) {
+        n.prev = n.next = fd;
+        head_ = fd;
+    } else {
+        int tail = nodes_[head_].prev;
+        n.prev = tail;
+        n.next = head_;
+        nodes_[tail].next = fd;
+        nodes_[head_].prev = fd;
+    }
+    ++count_;
+}
+
+void TxScheduler::remove(int fd) {
+    if (!active(fd)) return;
+    Node& n = nodes_[fd];
+    if (n.next == fd) {
+        head_ = -1;
+    } else {
+        nodes_[n.prev].next = n.next;
+        nodes_[n.next].prev = n.prev;
+        if (head_ == fd) head_ = n.next;
+    }
+    n.prev = n.next = -1;
+    n.linked = false;
+    n.deficit = 0;
+    --count_;
+}
+
+void TxScheduler::begin_round() {
+    turns_left_ = count_;
+    budget_left_ = budget_ ? budget_ : SIZE_MAX;
+}
+
+int TxScheduler::next_turn(size_t& allowance) {
+    if (turns_left_ == 0 || budget_left_ == 0 || head_ < 0) return -1;
+    --turns_left_;
+    int fd = head_;
+    head_ = nodes_[fd].next;
+    Node& n = nodes_[fd];
+    n.deficit += quantum_;
+    allowance = (size_t)n.deficit;
+    return fd;
+}
+
+void TxScheduler::end_turn(int fd, size_t sent, bool backlogged) {
+    budget_left_ -= sent < budget_left_ ? sent : budget_left_;
+    if (!active(fd)) return;
+    if (!backlogged) {
+        remove(fd);
+        return;
+    }
+    Node& n = nodes_[fd];
+    n.deficit -= sent < n.deficit ? sent : n.deficit;
+}
@@ -0,0 +1,57 @@
+#ifndef TX_SCHEDULER_HPP
+#define TX_SCHEDULER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Deficit round-robin over the connections of one loop that are streaming
+// a file body. Each turn adds the quantum to the stream's deficit, and it
+// may send up to its deficit; a round gives every backlogged stream at most
+// one turn and ends early once the loop's byte budget is spent, the next
+// round resuming with the stream after the last one served. A stream that
+// blocks on its socket or completes leaves the ring and loses its deficit.
+// Headers and short bodies are not scheduled: the loop sends them as soon
+// as they are ready, ahead of the round.
+//
+// The ring is an intrusive list indexed by fd, so activate() and remove()
+// are O(1).
+class TxScheduler {
+public:
+    TxScheduler(size_t quantum, size_t budget);
+
+    // fd has body bytes to send and a writable socket; no-op if queued
+    void activate(int fd);
+    void remove(int fd);
+    bool active(int fd) const {
+        return fd >= 0 && (size_t)fd < nodes_.size() && nodes_[fd].linked;
+    }
+
+    void begin_round();
+    // next stream to serve in this round and how many bytes it may send;
+    // -1 when the round is over
+    int next_turn(size_t& allowance);
+    // sent: bytes it put on the wire; backlogged: it could send more
+    void end_turn(int fd, size_t sent, bool backlogged);
+
+    bool   empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+
+private:
+    struct Node {
+        int      prev = -1;
+        int      next = -1;
+        bool     linked = false;
+        uint64_t deficit = 0;
+    };
+
+    size_t            quantum_;
+    size_t            budget_;
+    std::vector<Node> nodes_;
+    int               head_ = -1;   // next stream to get a turn
+    size_t            count_ = 0;
+    size_t            turns_left_ = 0;
+    size_t            budget_left_ = 0;
+};
+
+#endif
@@ -0,0 +1,873 @@
+#include "uring_engine.hpp"
+#include "event_engine.hpp"
+#include "connection.hpp"
+#include "conn_table.hpp"
+#include "file_cache.hpp"
+#include "logger.hpp"
+#include "clock.hpp"
+#include "timer_wheel.hpp"
+#include "metrics.hpp"
+#include "admission.hpp"
+#include "doc_watch.hpp"
+#include "h2.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+
+#include <vector>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+const unsigned RING_ENTRIES  = 4096;
+const unsigned RECV_BUF_SIZE = 4096;
+const unsigned RECV_BUFS     = 1024;
+const uint16_t RECV_BGID     = 0;
+const size_t   FILE_CHUNK    = 16 * 1024;
+const size_t   PIPE_CHUNK    = 64 * 1024;
+const size_t   FILE_PAGE     = 4096;
+const uint64_t NO_OFFSET     = ~0ULL;
+const int      DRAIN_POLL_MS = 100;
+
+enum UringOp : uint8_t {
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND,        // queued output: header blocks and in-memory bodies
+    OP_SPLICE_IN,   // file -> pipe
+    OP_SPLICE_OUT,  // pipe -> socket
+    OP_READ,        // copy path: file -> file_buf
+    OP_SEND_BODY,   // copy path: file_buf -> socket
+    OP_POLL_OUT,    // socket writability before a retried SPLICE_OUT
+    OP_PROVIDE,
+    OP_CANCEL
+};
+
+uint64_t pack(UringOp op, int fd) {
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+UringOp op_of(uint64_t ud) { return (UringOp)(ud >> 32); }
+int     fd_of(uint64_t ud) { return (int)(uint32_t)ud; }
+
+int sys_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+              unsigned flags, void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+int sys_register(int fd, unsigned op, void* arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+class Ring {
+public:
+    // SQ and CQ rings share one mapping (IORING_FEAT_SINGLE_MMAP)
+    ~Ring() {
+        if (ring_ptr_ && ring_ptr_ != MAP_FAILED) munmap(ring_ptr_, ring_len_);
+        if (sqes_ && (void*)sqes_ != MAP_FAILED)
+            munmap(sqes_, sq_entries_ * sizeof(io_uring_sqe));
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool init(unsigned entries) {
+        io_uring_params p{};
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4;
+        fd_ = sys_setup(entries, &p);
+        if (fd_ < 0) return false;
+
+        features_ = p.features;
+        if (!(features_ & IORING_FEAT_SINGLE_MMAP) ||
+            !(features_ & IORING_FEAT_EXT_ARG) ||
+            !(features_ & IORING_FEAT_NODROP)) {
+            errno = ENOTSUP;
+            return false;
+        }
+
+        size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        ring_len_ = sq_len > cq_len ? sq_len : cq_len;
+
+        ring_ptr_ = mmap(nullptr, ring_len_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (ring_ptr_ == MAP_FAILED) return false;
+
+        sqes_ = (io_uring_sqe*)mmap(nullptr,
+                                    p.sq_entries * sizeof(io_uring_sqe),
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, fd_,
+                                    IORING_OFF_SQES);
+        if ((void*)sqes_ == MAP_FAILED) return false;
+
+        char* sq = (char*)ring_ptr_;
+        sq_head_  = (unsigned*)(sq + p.sq_off.head);
+        sq_tail_  = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask_  = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq + p.sq_off.array);
+        sq_entries_ = p.sq_entries;
+        local_tail_ = *sq_tail_;
+
+        char* cq = (char*)ring_ptr_;
+        cq_head_ = (unsigned*)(cq + p.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask_ = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_    = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    bool supports(const std::vector<uint8_t>& ops) {
+        const unsigned n = 256;
+        std::vector<char> buf(sizeof(io_uring_probe) +
+                              n * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = (io_uring_probe*)buf.data();
+        if (sys_register(fd_, IORING_REGISTER_PROBE, probe, n) < 0)
+            return false;
+        for (uint8_t op : ops) {
+            if (op > probe->last_op ||
+                !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                return false;
+        }
+        return true;
+    }
+
+    bool can_skip_cqe() const { return features_ & IORING_FEAT_CQE_SKIP; }
+
+    io_uring_sqe* get_sqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (local_tail_ - head >= sq_entries_) {
+            submit(0, -1);
+            head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            if (local_tail_ - head >= sq_entries_) return nullptr;
+        }
+        unsigned idx = local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[idx] = idx;
+        ++local_tail_;
+        ++pending_;
+        return sqe;
+    }
+
+    // submits everything queued since the last call; with wait_ms >= 0 it
+    // also blocks until one completion arrives or the timeout expires
+    int submit(unsigned wait_nr, int wait_ms) {
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+
+        unsigned flags = 0;
+        __kernel_timespec ts{};
+        io_uring_getevents_arg arg{};
+
+        if (wait_nr > 0) {
+            flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+            arg.sigmask = (uint64_t)(uintptr_t)&wait_sigmask();
+            arg.sigmask_sz = _NSIG / 8;
+            if (wait_ms >= 0) {
+                ts.tv_sec = wait_ms / 1000;
+                ts.tv_nsec = (wait_ms % 1000) * 1000000L;
+                arg.ts = (uint64_t)(uintptr_t)&ts;
+            }
+        }
+
+        int ret = sys_enter(fd_, pending_, wait_nr, flags,
+                            wait_nr > 0 ? &arg : nullptr,
+                            wait_nr > 0 ? sizeof(arg) : 0);
+        if (ret >= 0) pending_ -= (unsigned)ret < pending_ ? ret : pending_;
+        return ret;
+    }
+
+    template <typename F>
+    void for_each_cqe(F&& fn) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            ++head;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            fn(cqe);
+            tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        }
+    }
+
+private:
+    int fd_ = -1;
+    unsigned features_ = 0;
+
+    void*  ring_ptr_ = nullptr;
+    size_t ring_len_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned  sq_mask_ = 0;
+    unsigned  sq_entries_ = 0;
+    unsigned  local_tail_ = 0;
+    unsigned  pending_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned  cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+
+struct UringConn {
+    Connection c;
+    int    inflight = 0;
+    bool   closing = false;
+    bool   recv_armed = false;
+    bool   sending = false;   // a SENDMSG of out_buf is in flight
+    int    pipe_r = -1;
+    int    pipe_w = -1;
+    size_t pipe_bytes = 0;
+    iovec  iov[MAX_OUTPUT_IOV];
+    msghdr msg;
+    std::vector<char> file_buf;
+    size_t file_buf_len = 0;
+    size_t file_buf_sent = 0;
+};
+
+class UringLoop {
+public:
+    UringLoop(int listen_fd, const ServerConfig& cfg, uint64_t& accepted)
+        : listen_fd_(listen_fd), cfg_(cfg), accepted_(accepted),
+          timers_(monotonic_ms()) {}
+
+    bool init() {
+        if (!ring_.init(RING_ENTRIES)) {
+            log_error("io_uring setup failed: " +
+                      std::string(std::strerror(errno)));
+            return false;
+        }
+        if (!ring_.supports({IORING_OP_ACCEPT, IORING_OP_RECV,
+                             IORING_OP_SEND, IORING_OP_SENDMSG,
+                             IORING_OP_SPLICE, IORING_OP_READ,
+                             IORING_OP_PROVIDE_BUFFERS,
+                             IORING_OP_ASYNC_CANCEL})) {
+            log_error("io_uring lacks required opcodes");
+            return false;
+        }
+
+        recv_bufs_.resize((size_t)RECV_BUFS * RECV_BUF_SIZE);
+        io_uring_sqe* sqe = ring_.get_sqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = RECV_BUFS;
+        sqe->addr = (uint64_t)(uintptr_t)recv_bufs_.data();
+        sqe->len = RECV_BUF_SIZE;
+        sqe->off = 0;
+        sqe->buf_group = RECV_BGID;
+        sqe->user_data = pack(OP_PROVIDE, -1);
+
+        arm_accept();
+        return true;
+    }
+
+    void run(const volatile sig_atomic_t& running,
+             const volatile sig_atomic_t& draining) {
+        std::vector<int> fired;
+        std::vector<int> again;
+        int64_t drain_deadline = 0;
+
+        while (running) {
+            if (draining && accepting_) {
+                stop_accepting();
+                drain_deadline = monotonic_ms() + cfg_.drain_timeout_ms;
+                log_info("Draining " + std::to_string(conns_.size()) +
+                         " connections");
+            }
+            if (!accepting_) {
+                close_idle();
+                if (conns_.empty() || monotonic_ms() >= drain_deadline) break;
+            } else if (admission().paused()) {
+                readmit();
+            }
+
+            // recv buffers come back without a completion, so a starved
+            // connection is retried on a short timer
+            int timeout_ms = timers_.next_timeout(monotonic_ms());
+            if (!starved_.empty() && (timeout_ms < 0 || timeout_ms > 10))
+                timeout_ms = 10;
+            if (!accepting_ && (timeout_ms < 0 || timeout_ms > DRAIN_POLL_MS))
+                timeout_ms = DRAIN_POLL_MS;
+            int recheck_ms = admission().recheck_in(monotonic_ms());
+            if (recheck_ms >= 0 && (timeout_ms < 0 || timeout_ms > recheck_ms))
+                timeout_ms = recheck_ms;
+            int ret = ring_.submit(1, timeout_ms);
+            if (!running) break;
+            if (ret < 0 && errno != EINTR && errno != ETIME &&
+                errno != EBUSY) {
+                log_error("io_uring_enter error: " +
+                          std::string(std::strerror(errno)));
+            }
+
+            int64_t busy_start = monotonic_us();
+            apply_doc_changes();
+            ring_.for_each_cqe([this](const io_uring_cqe& cqe) {
+                dispatch(cqe);
+            });
+
+            int64_t now = monotonic_ms();
+            fired.clear();
+            timers_.expire(now, fired);
+            for (int fd : fired) {
+                UringConn* u = conns_.find(fd);
+                if (u && !u->closing && timer_expired(u->c, cfg_, timers_, now))
+                    start_close(*u);
+            }
+
+            if (!starved_.empty()) {
+                again.clear();
+                again.swap(starved_);
+                for (int fd : again) {
+                    UringConn* u = conns_.find(fd);
+                    if (u && !u->closing && !u->recv_armed &&
+                        (u->c.h2 || u->inflight == 0))
+                        arm_recv(*u);
+                }
+            }
+            metrics_loop(monotonic_us() - busy_start);
+        }
+    }
+
+    ~UringLoop() {
+        for (int fd : conns_.fds()) {
+            UringConn& u = *conns_.find(fd);
+            release_file(u.c);
+            close_pipe(u);
+            ::close(fd);
+        }
+    }
+
+private:
+    io_uring_sqe* sqe_for(UringOp op, int fd) {
+        io_uring_sqe* sqe = ring_.get_sqe();
+        if (!sqe) return nullptr;
+        sqe->user_data = pack(op, fd);
+        return sqe;
+    }
+
+    // Graceful stop: no new connections are taken, so the other workers
+    // (or the next generation) get them. A SO_REUSEPORT listener is private
+    // to this worker, so whatever already sits in its queue is accepted
+    // here and the socket closed, letting the kernel route elsewhere.
+    void stop_accepting() {
+        accepting_ = false;
+        cancel_accept();
+        if (cfg_.reuse_port) {
+            for (;;) {
+                int fd = ::accept(listen_fd_, nullptr, nullptr);
+                if (fd < 0) break;
+                add_conn(fd);
+            }
+            ::close(listen_fd_);
+        }
+        admission().resume();
+    }
+
+    // hangs up idle keep-alive connections, see reclaim_idle()
+    size_t close_idle(size_t max = SIZE_MAX, int64_t idle_before = INT64_MAX) {
+        return reclaim_idle(
+            conns_.fds(),
+            [this](int fd) -> const Connection* {
+                const UringConn* u = conns_.find(fd);
+                return u && !u->closing ? &u->c : nullptr;
+            },
+            [this](int fd) {
+                if (UringConn* u = conns_.find(fd)) start_close(*u);
+            },
+            max, idle_before);
+    }
+
+    // connections not on their way out
+    size_t open_conns() const { return conns_.size() - closing_; }
+
+    // The accept stays armed while the loop is under its limit. Paused, the
+    // queue waits in the kernel until Admission::make_room lets it resume.
+    void pause_accepting(int backoff_ms = 0) {
+        admission().pause(monotonic_ms(), backoff_ms);
+        cancel_accept();
+    }
+
+    void readmit() {
+        Admission& adm = admission();
+        auto open = [this] { return open_conns(); };
+        auto close = [this](size_t max, int64_t idle_before) {
+            return close_idle(max, idle_before);
+        };
+        if (!adm.make_room(monotonic_ms(), open, close)) return;
+        adm.resume();
+        // else the cancelled accept re-arms itself when it completes
+        if (!accept_armed_) arm_accept();
+    }
+
+    void arm_accept() {
+        io_uring_sqe* sqe = sqe_for(OP_ACCEPT, listen_fd_);
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd_;
+        sqe->ioprio = multishot_accept_ ? IORING_ACCEPT_MULTISHOT : 0;
+        accept_armed_ = true;
+    }
+
+    void cancel_accept() {
+        if (!accept_armed_) return;
+        io_uring_sqe* sqe = sqe_for(OP_CANCEL, -1);
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = pack(OP_ACCEPT, listen_fd_);
+    }
+
+    void arm_recv(UringConn& u) {
+        io_uring_sqe* sqe = sqe_for(OP_RECV, u.c.fd);
+        if (!sqe) return start_close(u);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = u.c.fd;
+        sqe->len = RECV_BUF_SIZE;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BGID;
+        ++u.inflight;
+        u.recv_armed = true;
+    }
+
+    void provide_buffer(uint16_t bid) {
+        io_uring_sqe* sqe = sqe_for(OP_PROVIDE, -1);
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = (uint64_t)(uintptr_t)(recv_bufs_.data() +
+                                          (size_t)bid * RECV_BUF_SIZE);
+        sqe->len = RECV_BUF_SIZE;
+        sqe->off = bid;
+        sqe->buf_group = RECV_BGID;
+        if (ring_.can_skip_cqe()) sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    }
+
+    static bool has_file_body(const Connection& c) {
+        return !c.head_only && c.file_fd >= 0 && c.file_offset < c.file_size;
+    }
+
+    bool ensure_pipe(UringConn& u) {
+        if (u.pipe_r >= 0) return true;
+        int p[2];
+        if (pipe2(p, O_NONBLOCK | O_CLOEXEC) < 0) {
+            log_error("pipe2 error: " + std::string(std::strerror(errno)));
+            return false;
+        }
+        u.pipe_r = p[0];
+        u.pipe_w = p[1];
+        return true;
+    }
+
+    void close_pipe(UringConn& u) {
+        if (u.pipe_r >= 0) ::close(u.pipe_r);
+        if (u.pipe_w >= 0) ::close(u.pipe_w);
+        u.pipe_r = u.pipe_w = -1;
+        u.pipe_bytes = 0;
+    }
+
+    // Decides the next operation for a connection from its state, the same
+    // way handle_read/handle_write do for the readiness engines.
+    void advance(UringConn& u) {
+        Connection& c = u.c;
+        bool want_close = false;
+
+        while (!u.closing) {
+            if (c.h2) return advance_h2(u);
+            if (c.state == ConnState::READING_REQUEST) {
+                // pipelined requests may already be buffered
+                if (!c.in_buf.empty()) {
+                    process_input(c, cfg_, want_close);
+                    if (want_close) return start_close(u);
+                    if (c.state != ConnState::READING_REQUEST) continue;
+                }
+                return arm_recv(u);
+            }
+            if (c.state == ConnState::CLOSING) {
+                return start_close(u);
+            }
+
+            if (output_pending(c))
+                return submit_send(u);
+
+            if (c.body_mem) {
+                finish_response(c, want_close);
+                if (want_close) return start_close(u);
+                continue;
+            }
+
+            if (c.state == ConnState::SENDING_HEADERS) {
+                if (!has_file_body(c)) {
+                    if (next_range_part(c)) continue;
+                    finish_response(c, want_close);
+                    if (want_close) return start_close(u);
+                    continue;
+                }
+                c.state = ConnState::SENDING_BODY;
+                c.out_buf.clear();
+                c.out_sent = 0;
+            }
+
+            if (u.pipe_bytes > 0 || u.file_buf_sent < u.file_buf_len ||
+                c.file_offset < c.file_size)
+                return submit_body(u);
+
+            if (next_range_part(c)) continue;
+            finish_response(c, want_close);
+            if (want_close) return start_close(u);
+        }
+    }
+
+    // HTTP/2 keeps a RECV armed throughout, next to at most one SENDMSG
+    // that is refilled from the session each time it completes. File DATA
+    // is read inline by h2_fill().
+    void advance_h2(UringConn& u) {
+        Connection& c = u.c;
+        if (c.state == ConnState::CLOSING) return start_close(u);
+        if (!u.recv_armed) arm_recv(u);
+        if (u.closing || u.sending) return;
+        if (!output_pending(c)) {
+            c.out_buf.clear();
+            c.out_sent = 0;
+            h2_fill(c, cfg_.tx_quantum);
+            if (c.state == ConnState::CLOSING) return start_close(u);
+        }
+        if (output_pending(c)) submit_send(u);
+    }
+
+    void submit_send(UringConn& u) {
+        Connection& c = u.c;
+        u.msg = msghdr();
+        u.msg.msg_iov = u.iov;
+        u.msg.msg_iovlen = output_iov(c, u.iov, MAX_OUTPUT_IOV);
+
+        io_uring_sqe* sqe = sqe_for(OP_SEND, c.fd);
+        if (!sqe) return start_close(u);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = c.fd;
+        sqe->addr = (uint64_t)(uintptr_t)&u.msg;
+        sqe->len = 1;
+        if (cfg_.zero_copy && has_file_body(c)) sqe->msg_flags = MSG_MORE;
+        ++u.inflight;
+        u.sending = true;
+    }
+
+    void submit_body(UringConn& u) {
+        Connection& c = u.c;
+
+        if (!cfg_.zero_copy) {
+            if (u.file_buf_sent < u.file_buf_len) {
+                io_uring_sqe* sqe = sqe_for(OP_SEND_BODY, c.fd);
+                if (!sqe) return start_close(u);
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = c.fd;
+                sqe->addr = (uint64_t)(uintptr_t)(u.file_buf.data() +
+                                                  u.file_buf_sent);
+                sqe->len = (uint32_t)(u.file_buf_len - u.file_buf_sent);
+                ++u.inflight;
+                return;
+            }
+            if (u.file_buf.empty()) u.file_buf.resize(FILE_CHUNK);
+            size_t len = FILE_CHUNK;
+            if ((size_t)(c.file_size - c.file_offset) < len)
+                len = c.file_size - c.file_offset;
+            io_uring_sqe* sqe = sqe_for(OP_READ, c.fd);
+            if (!sqe) return start_close(u);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = c.file_fd;
+            sqe->addr = (uint64_t)(uintptr_t)u.file_buf.data();
+            sqe->len = (uint32_t)len;
+            sqe->off = (uint64_t)c.file_offset;
+            ++u.inflight;
+            return;
+        }
+
+        if (!ensure_pipe(u)) return start_close(u);
+
+        if (u.pipe_bytes == 0) {
+            // the pipe holds PIPE_CHUNK worth of pages; an unaligned range
+            // start would need one page more and the short splice would
+            // break the link
+            size_t len = PIPE_CHUNK - (size_t)(c.file_offset % FILE_PAGE);
+            if ((size_t)(c.file_size - c.file_offset) < len)
+                len = c.file_size - c.file_offset;
+
+            io_uring_sqe* in = sqe_for(OP_SPLICE_IN, c.fd);
+            if (!in) return start_close(u);
+            in->opcode = IORING_OP_SPLICE;
+            in->fd = u.pipe_w;
+            in->off = NO_OFFSET;
+            in->splice_fd_in = c.file_fd;
+            in->splice_off_in = (uint64_t)c.file_offset;
+            in->len = (uint32_t)len;
+            in->splice_flags = SPLICE_F_MOVE;
+            in->flags = IOSQE_IO_LINK;
+            ++u.inflight;
+            u.pipe_bytes = len;   // upper bound until SPLICE_IN completes
+        }
+
+        submit_splice_out(u, false);
+    }
+
+    // splice on a non-blocking socket fails with EAGAIN instead of being
+    // polled by the kernel, so a retry waits for POLLOUT in a linked poll
+    void submit_splice_out(UringConn& u, bool after_poll) {
+        Connection& c = u.c;
+        if (after_poll) {
+            io_uring_sqe* poll = sqe_for(OP_POLL_OUT, c.fd);
+            if (!poll) return start_close(u);
+            poll->opcode = IORING_OP_POLL_ADD;
+            poll->fd = c.fd;
+            poll->poll32_events = POLLOUT;
+            poll->flags = IOSQE_IO_LINK;
+            ++u.inflight;
+        }
+
+        io_uring_sqe* out = sqe_for(OP_SPLICE_OUT, c.fd);
+        if (!out) return start_close(u);
+        out->opcode = IORING_OP_SPLICE;
+        out->fd = c.fd;
+        out->off = NO_OFFSET;
+        out->splice_fd_in = u.pipe_r;
+        out->splice_off_in = NO_OFFSET;
+        out->len = (uint32_t)u.pipe_bytes;
+        out->splice_flags = SPLICE_F_MOVE;
+        ++u.inflight;
+    }
+
+    void start_close(UringConn& u) {
+        if (!u.closing) {
+            u.closing = true;
+            ++closing_;
+            u.c.state = ConnState::CLOSING;
+            timers_.cancel(u.c.fd);
+            if (u.inflight > 0) {
+                ::shutdown(u.c.fd, SHUT_RDWR);
+                io_uring_sqe* sqe = sqe_for(OP_CANCEL, -1);
+                if (sqe) {
+                    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                    sqe->fd = u.c.fd;
+                    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD |
+                                        IORING_ASYNC_CANCEL_ALL;
+                }
+            }
+        }
+        maybe_destroy(u);
+    }
+
+    // the fd stays open until the kernel is done with it, so its number
+    // cannot be reused while completions are still in flight
+    void maybe_destroy(UringConn& u) {
+        if (!u.closing || u.inflight > 0) return;
+        int fd = u.c.fd;
+        release_file(u.c);
+        u.c.h2.reset();
+        return_buffers(u.c);
+        close_pipe(u);
+        ::close(fd);
+        conns_.close(fd);
+        --closing_;
+        metrics_closed();
+    }
+
+    void on_accept(const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            if (cqe.res == -EINVAL && multishot_accept_) {
+                log_info("io_uring: multishot accept unsupported, re-arming");
+                multishot_accept_ = false;
+            }
+            accept_armed_ = false;
+            if (accepting_ && !admission().paused()) arm_accept();
+        }
+        if (cqe.res < 0) {
+            if (Admission::out_of_fds(-cqe.res) && accepting_) {
+                log_error("accept error: " +
+                          std::string(std::strerror(-cqe.res)) + ", shed " +
+                          std::to_string(admission().shed(listen_fd_)) +
+                          " queued connections");
+                pause_accepting(FD_BACKOFF_MS);
+            } else if (cqe.res != -EINVAL && cqe.res != -ECANCELED) {
+                log_error("accept error: " +
+                          std::string(std::strerror(-cqe.res)));
+            }
+            return;
+        }
+        add_conn(cqe.res);
+        if (accepting_ && !admission().paused() &&
+            admission().full(open_conns()))
+            pause_accepting();
+    }
+
+    void add_conn(int fd) {
+        ++accepted_;
+        metrics_accepted();
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags != -1) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        UringConn& u = conns_.open(fd);
+        u.c.fd = fd;
+        take_buffers(u.c);
+        update_timer(u.c, cfg_, timers_, monotonic_ms());
+        arm_recv(u);
+    }
+
+    void on_recv(UringConn& u, const io_uring_cqe& cqe) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0 && !u.closing)
+                u.c.in_buf.append(recv_bufs_.data() +
+                                  (size_t)bid * RECV_BUF_SIZE, cqe.res);
+            provide_buffer(bid);
+        }
+        if (u.closing) return;
+
+        if (cqe.res == -ENOBUFS) {
+            starved_.push_back(u.c.fd);
+            return;
+        }
+        if (cqe.res <= 0) {
+            if (cqe.res < 0 && cqe.res != -ECONNRESET)
+                log_error("recv error: " +
+                          std::string(std::strerror(-cqe.res)));
+            return start_close(u);
+        }
+
+        bool want_close = false;
+        process_input(u.c, cfg_, want_close);
+        if (want_close) return start_close(u);
+        advance(u);
+    }
+
+    void on_sent(UringConn& u, const io_uring_cqe& cqe, UringOp op) {
+        if (u.closing) return;
+        if (cqe.res < 0) return start_close(u);
+
+        Connection& c = u.c;
+        size_t n = (size_t)cqe.res;
+        c.bytes_sent += n;
+        if (op == OP_SEND)
+            output_advance(c, n);
+        else
+            u.file_buf_sent += n;
+        advance(u);
+    }
+
+    void on_file(UringConn& u, const io_uring_cqe& cqe, UringOp op) {
+        Connection& c = u.c;
+
+        if (op == OP_SPLICE_IN) {
+            // SPLICE_OUT is linked behind this one and completes next
+            if (cqe.res > 0) {
+                c.file_offset += cqe.res;
+                u.pipe_bytes = cqe.res;
+            } else if (!u.closing) {
+                u.pipe_bytes = 0;
+                start_close(u);
+            }
+            return;
+        }
+
+        if (op == OP_READ) {
+            if (u.closing) return;
+            if (cqe.res <= 0) return start_close(u);
+            c.file_offset += cqe.res;
+            u.file_buf_len = cqe.res;
+            u.file_buf_sent = 0;
+            return advance(u);
+        }
+
+        // OP_SPLICE_OUT
+        if (u.closing) return;
+        if (cqe.res == -EAGAIN) return submit_splice_out(u, true);
+        // a short SPLICE_IN cancels the linked SPLICE_OUT
+        if (cqe.res == -ECANCELED && u.pipe_bytes > 0)
+            return submit_splice_out(u, false);
+        if (cqe.res < 0) return start_close(u);
+        c.bytes_sent += cqe.res;
+        u.pipe_bytes -= (size_t)cqe.res < u.pipe_bytes ? cqe.res
+                                                       : u.pipe_bytes;
+        advance(u);
+    }
+
+    void dispatch(const io_uring_cqe& cqe) {
+        UringOp op = op_of(cqe.user_data);
+        if (op == OP_PROVIDE || op == OP_CANCEL) return;
+        if (op == OP_ACCEPT) return on_accept(cqe);
+
+        UringConn* found = conns_.find(fd_of(cqe.user_data));
+        if (!found) return;
+        UringConn& u = *found;
+        --u.inflight;
+
+        switch (op) {
+            case OP_RECV:
+                u.recv_armed = false;
+                on_recv(u, cqe);
+                break;
+            case OP_SEND:
+                u.sending = false;
+                on_sent(u, cqe, op);
+                break;
+            case OP_SEND_BODY:
+                on_sent(u, cqe, op);
+                break;
+            case OP_POLL_OUT:
+                if (cqe.res < 0 && !u.closing) start_close(u);
+                break;
+            case OP_SPLICE_IN:
+            case OP_SPLICE_OUT:
+            case OP_READ:
+                on_file(u, cqe, op);
+                break;
+            default:
+                break;
+        }
+
+        // the handlers may have destroyed it
+        if (!conns_.find(fd_of(cqe.user_data))) return;
+        if (!u.closing) update_timer(u.c, cfg_, timers_, monotonic_ms());
+        maybe_destroy(u);
+    }
+
+    int listen_fd_;
+    const ServerConfig& cfg_;
+    uint64_t& accepted_;
+    Ring ring_;
+    bool multishot_accept_ = true;
+    bool accepting_ = true;
+    bool accept_armed_ = false;
+    size_t closing_ = 0;
+    std::vector<char> recv_bufs_;
+    ConnTable<UringConn> conns_;
+    std::vector<int> starved_;
+    TimerWheel timers_;
+};
+
+}
+
+bool run_uring_loop(int listen_fd,
+                    const ServerConfig& cfg,
+                    const volatile sig_atomic_t& running,
+                    const volatile sig_atomic_t& draining,
+                    uint64_t& accepted) {
+    UringLoop loop(listen_fd, cfg, accepted);
+    if (!loop.init()) return false;
+    log_info("Event engine: io_uring, up to " +
+             std::to_string(admission().limit()) + " connections");
+    loop.run(running, draining);
+    return true;
+}
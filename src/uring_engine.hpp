@@ -0,0 +1,23 @@
+#ifndef URING_ENGINE_HPP
+#define URING_ENGINE_HPP
+
+#include "config.hpp"
+
+#include <csignal>
+#include <cstdint>
+
+// Completion-based worker loop on io_uring: multishot accept, recv into
+// provided buffers, header send and linked file->pipe->socket splices,
+// all submitted in one io_uring_enter() per iteration. The Connection
+// state machine is reused as is. Once draining is set the loop stops
+// accepting and returns when its remaining responses are done.
+//
+// Returns false before serving anything if the kernel lacks a required
+// feature, so the caller can fall back to a readiness engine.
+bool run_uring_loop(int listen_fd,
+                    const ServerConfig& cfg,
+                    const volatile sig_atomic_t& running,
+                    const volatile sig_atomic_t& draining,
+                    uint64_t& accepted);
+
+#endif